@@ -21,10 +21,449 @@
 
 #include "Index.h"
 #include "ReadByVariant.h"
+#include "ReadBySample.h"
+
+#ifndef _WIN32
+#   include <pthread.h>
+#   define JSEQ_PREFETCH
+#endif
+
+static const double NaN = 0.0/0.0;
 
 
 using namespace JSeqArray;
 
+
+/// fill 'out' with the chromosome strings of codes, allocating one Julia
+/// string for each chromosome
+static void chrom_code_to_string(CChromIndex &Chrom, const C_Int32 *code,
+	size_t n, jl_array_t *out)
+{
+	const vector<string> &tab = Chrom.CodeTable();
+	vector<jl_value_t*> ss(tab.size(), NULL);
+	jl_value_t **p = (jl_value_t**)jl_array_data(out);
+	for (; n > 0; n--)
+	{
+		const int k = (*code++) - 1;
+		if (!ss[k])
+			ss[k] = jl_pchar_to_string(tab[k].c_str(), tab[k].size());
+		*p++ = ss[k];  // 'out' is rooted, and so are the strings in it
+		jl_gc_wb(out, ss[k]);
+	}
+}
+
+
+// ===========================================================
+// Reading variables block by block
+// ===========================================================
+
+/// Read genotypes, dosages, positions and chromosomes of consecutive blocks
+/// with the decoders and the variant cursor kept alive across blocks;
+/// if Depth > 0, genotypes and dosages of the following blocks are decoded
+/// in a separate thread while the user-defined function is running
+class COREARRAY_DLL_LOCAL CBlockReader
+{
+public:
+	/// constructor
+	CBlockReader()
+	{
+		File = NULL; Geno = NULL; Dosage = NULL;
+		Roots = NULL; VarSel = NULL; VarCursor = 0;
+		NumPref = Depth = NumBlock = BlockSize = NumVariant = 0;
+		Ploidy = SampNum = 0;
+		StopFlag = Started = false;
+	}
+	/// destructor, stop and wait for the reader thread
+	~CBlockReader()
+	{
+	#ifdef JSEQ_PREFETCH
+		if (Started)
+		{
+			pthread_mutex_lock(&Mutex);
+			StopFlag = true;
+			pthread_cond_broadcast(&Cond);
+			pthread_mutex_unlock(&Mutex);
+			pthread_join(Thread, NULL);
+			pthread_cond_destroy(&Cond);
+			pthread_mutex_destroy(&Mutex);
+		}
+	#endif
+		if (Geno) delete Geno;
+		if (Dosage) delete Dosage;
+	}
+
+	/// return true if the variable can be read by this object
+	static bool Supported(const char *name)
+	{
+		return (strcmp(name, "genotype")==0) ||
+			(strcmp(name, "#dosage")==0) || (strcmp(name, "$dosage")==0) ||
+			(strcmp(name, "#dosage_alt")==0) ||
+			(strcmp(name, "$dosage_alt")==0) ||
+			(strcmp(name, "#genotype_packed")==0) ||
+			(strcmp(name, "$genotype_packed")==0) ||
+			(strcmp(name, "position")==0) || (strcmp(name, "chromosome")==0) ||
+			(strcmp(name, "$chrom_code")==0);
+	}
+
+	/// initialize with the current selection, and start the reader thread if
+	/// depth > 0, 'roots' is a rooted Vector{Any} with depth*NumPrefetch(names)
+	void Init(CFileInfo &file, const vector<string> &names, int bsize,
+		int depth, jl_array_t *roots)
+	{
+		File = &file;
+		NumVariant = file.VariantSelNum();
+		BlockSize = bsize;
+		NumBlock = NumVariant / bsize;
+		if (NumVariant % bsize) NumBlock ++;
+		Ploidy = file.Ploidy();
+		SampNum = file.SampleSelNum();
+		VarSel = file.Selection().pVariant();
+		VarCursor = 0;
+
+		// decoders and indexing objects are created in the main thread
+		for (size_t i=0; i < names.size(); i++)
+		{
+			int k = Kind(names[i].c_str());
+			VarKind.push_back(k);
+			VarIdx.push_back(k==KIND_GENO || k==KIND_DOSAGE ||
+				k==KIND_PACKED || k==KIND_ALT ? NumPref++ : -1);
+			if ((k == KIND_GENO) || (k == KIND_PACKED))
+			{
+				if (!Geno) Geno = new CApply_Variant_Geno(file);
+			} else if ((k == KIND_DOSAGE) || (k == KIND_ALT))
+			{
+				if (!Dosage) Dosage = new CApply_Variant_Dosage(file);
+			} else if (k == KIND_POS)
+				file.Position();
+			else if ((k == KIND_CHROM) || (k == KIND_CODE))
+				file.Chromosome();
+		}
+		for (size_t i=0; i < VarKind.size(); i++)
+			if (VarIdx[i] >= 0) PrefKind.push_back(VarKind[i]);
+
+	#ifdef JSEQ_PREFETCH
+		if ((depth > 0) && (NumPref > 0) && (SampNum > 0))
+		{
+			Depth = (depth < NumBlock) ? depth : NumBlock;
+			Roots = roots;
+			SlotState.assign(Depth, 0);
+			for (int i=0; i < Depth; i++) Queue(i);
+
+			pthread_mutex_init(&Mutex, NULL);
+			pthread_cond_init(&Cond, NULL);
+			if (pthread_create(&Thread, NULL, thread_proc, this) != 0)
+			{
+				pthread_cond_destroy(&Cond);
+				pthread_mutex_destroy(&Mutex);
+				throw ErrSeqArray("Fails to create the prefetching thread.");
+			}
+			Started = true;
+		}
+	#endif
+	}
+
+	/// the number of variables decoded by the genotype and dosage readers
+	static int NumPrefetch(const vector<string> &names)
+	{
+		int n = 0;
+		for (size_t i=0; i < names.size(); i++)
+		{
+			int k = Kind(names[i].c_str());
+			if (k==KIND_GENO || k==KIND_DOSAGE || k==KIND_PACKED ||
+				k==KIND_ALT) n ++;
+		}
+		return n;
+	}
+
+	/// whether the i-th variable is read by this object
+	inline bool Has(size_t i) const
+		{ return File && (VarKind[i] >= 0); }
+
+	/// get the variables of the block 'idx', and save them to the rooted
+	/// 'list_args' according to the positions of variable names
+	void Read(int idx, jl_value_t **list_args)
+	{
+		const int cnt = BlockCount(idx);
+		if (Started)
+		{
+		#ifdef JSEQ_PREFETCH
+			const int slot = idx % Depth;
+			pthread_mutex_lock(&Mutex);
+			while ((SlotState[slot] != 2) && ErrMsg.empty())
+				pthread_cond_wait(&Cond, &Mutex);
+			string msg = ErrMsg;
+			pthread_mutex_unlock(&Mutex);
+			if (!msg.empty()) throw ErrSeqArray(msg);
+
+			jl_value_t **p = (jl_value_t**)jl_array_data(Roots) + slot*NumPref;
+			for (size_t i=0; i < VarIdx.size(); i++)
+				if (VarIdx[i] >= 0) list_args[i] = p[VarIdx[i]];
+		#endif
+		} else if (NumPref > 0)
+		{
+			vector<C_UInt8*> buf(NumPref);
+			for (size_t i=0; i < VarIdx.size(); i++)
+			{
+				if (VarIdx[i] >= 0)
+				{
+					jl_array_t *a = NeedArray(VarKind[i], cnt);
+					list_args[i] = (jl_value_t*)a;
+					buf[VarIdx[i]] = (C_UInt8*)jl_array_data(a);
+				}
+			}
+			if (SampNum > 0)
+				ReadBlock(cnt, &buf[0]);
+		}
+
+		// positions and chromosomes
+		size_t st = VarCursor;
+		for (int n=cnt; n > 0; VarCursor++)
+			if (VarSel[VarCursor]) n--;
+		for (size_t i=0; i < VarKind.size(); i++)
+		{
+			if (VarKind[i] == KIND_POS)
+				list_args[i] = (jl_value_t*)ReadPos(st, cnt);
+			else if (VarKind[i] == KIND_CHROM)
+				list_args[i] = (jl_value_t*)ReadChrom(st, cnt);
+			else if (VarKind[i] == KIND_CODE)
+				list_args[i] = (jl_value_t*)ReadChromCode(st, cnt);
+		}
+	}
+
+	/// release the block 'idx' after the variables are rooted
+	void Release(int idx)
+	{
+	#ifdef JSEQ_PREFETCH
+		if (Started)
+		{
+			const int slot = idx % Depth;
+			pthread_mutex_lock(&Mutex);
+			SlotState[slot] = 0;
+			pthread_mutex_unlock(&Mutex);
+			if (idx + Depth < NumBlock) Queue(idx + Depth);
+		}
+	#endif
+	}
+
+private:
+	static const int KIND_GENO   = 0;
+	static const int KIND_DOSAGE = 1;
+	static const int KIND_POS    = 2;
+	static const int KIND_CHROM  = 3;
+	static const int KIND_PACKED = 4;
+	static const int KIND_ALT    = 5;
+	static const int KIND_CODE   = 6;
+
+	CFileInfo *File;
+	CApply_Variant_Geno *Geno;      ///< genotype decoder
+	CApply_Variant_Dosage *Dosage;  ///< dosage decoder
+	vector<int> VarKind;   ///< KIND_* for each name, or -1
+	vector<int> VarIdx;    ///< the index of decoded variable for each name
+	vector<int> PrefKind;  ///< KIND_* for each decoded variable
+	C_BOOL *VarSel;        ///< the variant selection
+	size_t VarCursor;      ///< the variant index of the next block
+	int NumPref, Depth, NumBlock, BlockSize, NumVariant;
+	int Ploidy, SampNum;
+	bool StopFlag, Started;
+
+	jl_array_t *Roots;      ///< Vector{Any} holding the arrays of all slots
+	vector<int> SlotState;  ///< 0: empty, 1: allocated, 2: ready
+	string ErrMsg;          ///< the error message from the reader thread
+#ifdef JSEQ_PREFETCH
+	pthread_t Thread;
+	pthread_mutex_t Mutex;     ///< protecting the slot states
+	pthread_cond_t Cond;
+#endif
+
+	static int Kind(const char *name)
+	{
+		if (strcmp(name, "genotype") == 0)
+			return KIND_GENO;
+		else if ((strcmp(name, "#dosage")==0) || (strcmp(name, "$dosage")==0))
+			return KIND_DOSAGE;
+		else if (strcmp(name, "position") == 0)
+			return KIND_POS;
+		else if (strcmp(name, "chromosome") == 0)
+			return KIND_CHROM;
+		else if ((strcmp(name, "#genotype_packed")==0) ||
+				(strcmp(name, "$genotype_packed")==0))
+			return KIND_PACKED;
+		else if ((strcmp(name, "#dosage_alt")==0) ||
+				(strcmp(name, "$dosage_alt")==0))
+			return KIND_ALT;
+		else if (strcmp(name, "$chrom_code") == 0)
+			return KIND_CODE;
+		return -1;
+	}
+
+	/// the number of variants in the block 'idx'
+	inline int BlockCount(int idx) const
+	{
+		int n = NumVariant - idx*BlockSize;
+		return (n < BlockSize) ? n : BlockSize;
+	}
+
+	/// allocate a Julia array for genotypes or dosages in the main thread
+	jl_array_t *NeedArray(int kind, int cnt)
+	{
+		if (kind == KIND_GENO)
+		{
+			jl_value_t *atype = jl_apply_array_type(jl_uint8_type, 3);
+			return jl_alloc_array_3d(atype, Ploidy, SampNum, cnt);
+		} else if (kind == KIND_PACKED)
+		{
+			jl_value_t *atype = jl_apply_array_type(jl_uint8_type, 2);
+			return jl_alloc_array_2d(atype, (ssize_t(SampNum)*Ploidy + 3) / 4,
+				cnt);
+		} else {
+			jl_value_t *atype = jl_apply_array_type(jl_uint8_type, 2);
+			return jl_alloc_array_2d(atype, SampNum, cnt);
+		}
+	}
+
+	/// decode 'cnt' variants to the buffers of decoded variables
+	void ReadBlock(int cnt, C_UInt8 *buf[])
+	{
+		for (; cnt > 0; cnt--)
+		{
+			CSeqLock lock(File->Mutex(), !Started);
+			for (int i=0; i < NumPref; i++)
+			{
+				if (PrefKind[i] == KIND_GENO)
+				{
+					Geno->ReadGenoData(buf[i]);
+					buf[i] += ssize_t(SampNum) * Ploidy;
+				} else if (PrefKind[i] == KIND_PACKED)
+				{
+					Geno->ReadGenoPacked(buf[i]);
+					buf[i] += Geno->PackedSize();
+				} else if (PrefKind[i] == KIND_ALT)
+				{
+					Dosage->ReadDosageAlt(buf[i]);
+					buf[i] += SampNum;
+				} else {
+					Dosage->ReadDosage(buf[i]);
+					buf[i] += SampNum;
+				}
+			}
+			if (Geno) Geno->Next();
+			if (Dosage) Dosage->Next();
+		}
+	}
+
+	/// positions of 'cnt' selected variants starting from 'st'
+	jl_array_t *ReadPos(size_t st, int cnt)
+	{
+		jl_value_t *atype = jl_apply_array_type(jl_int32_type, 1);
+		jl_array_t *rv = jl_alloc_array_1d(atype, cnt);
+		int *p = (int*)jl_array_data(rv);
+		const int *base = &File->Position()[0];
+		for (size_t i=st; cnt > 0; i++)
+			if (VarSel[i]) { *p++ = base[i]; cnt--; }
+		return rv;
+	}
+
+	/// chromosomes of 'cnt' selected variants starting from 'st'
+	jl_array_t *ReadChrom(size_t st, int cnt)
+	{
+		jl_value_t *atype = jl_apply_array_type(jl_string_type, 1);
+		jl_array_t *rv = jl_alloc_array_1d(atype, cnt);
+		JL_GC_PUSH1(&rv);
+		CChromIndex &Chrom = File->Chromosome();
+		vector<C_Int32> code(cnt);
+		if (cnt > 0)
+		{
+			Chrom.GetCodes(VarSel, st, cnt, &code[0]);
+			chrom_code_to_string(Chrom, &code[0], cnt, rv);
+		}
+		JL_GC_POP();
+		return rv;
+	}
+
+	/// chromosome codes of 'cnt' selected variants starting from 'st'
+	jl_array_t *ReadChromCode(size_t st, int cnt)
+	{
+		jl_value_t *atype = jl_apply_array_type(jl_int32_type, 1);
+		jl_array_t *rv = jl_alloc_array_1d(atype, cnt);
+		File->Chromosome().GetCodes(VarSel, st, cnt,
+			(C_Int32*)jl_array_data(rv));
+		return rv;
+	}
+
+#ifdef JSEQ_PREFETCH
+	/// allocate Julia arrays for the block 'idx' in the main thread
+	void Queue(int idx)
+	{
+		const int slot = idx % Depth;
+		const int cnt = BlockCount(idx);
+		jl_value_t **p = (jl_value_t**)jl_array_data(Roots) + slot*NumPref;
+		for (int i=0; i < NumPref; i++)
+		{
+			jl_array_t *a = NeedArray(PrefKind[i], cnt);
+			p[i] = (jl_value_t*)a;
+			jl_gc_wb(Roots, a);
+		}
+		if (Started) pthread_mutex_lock(&Mutex);
+		SlotState[slot] = 1;
+		if (Started)
+		{
+			pthread_cond_broadcast(&Cond);
+			pthread_mutex_unlock(&Mutex);
+		}
+	}
+
+	/// the reader thread
+	void Run()
+	{
+		vector<C_UInt8*> buf(NumPref);
+		try {
+			for (int idx=0; idx < NumBlock; idx++)
+			{
+				const int slot = idx % Depth;
+				pthread_mutex_lock(&Mutex);
+				while ((SlotState[slot] != 1) && !StopFlag)
+					pthread_cond_wait(&Cond, &Mutex);
+				bool stop = StopFlag;
+				jl_value_t **p = (jl_value_t**)jl_array_data(Roots) +
+					slot*NumPref;
+				for (int i=0; i < NumPref; i++)
+					buf[i] = (C_UInt8*)jl_array_data((jl_array_t*)p[i]);
+				pthread_mutex_unlock(&Mutex);
+				if (stop) return;
+
+				ReadBlock(BlockCount(idx), &buf[0]);
+
+				pthread_mutex_lock(&Mutex);
+				SlotState[slot] = 2;
+				pthread_cond_broadcast(&Cond);
+				pthread_mutex_unlock(&Mutex);
+			}
+		} catch (std::exception &E) {
+			SetError(E.what());
+		} catch (const char *E) {
+			SetError(E);
+		} catch (...) {
+			SetError(NULL);
+		}
+	}
+
+	void SetError(const char *msg)
+	{
+		pthread_mutex_lock(&Mutex);
+		ErrMsg = (msg && *msg) ? msg : "Unknown error in the prefetching thread.";
+		pthread_cond_broadcast(&Cond);
+		pthread_mutex_unlock(&Mutex);
+	}
+
+	static void *thread_proc(void *ptr)
+	{
+		((CBlockReader*)ptr)->Run();
+		return NULL;
+	}
+#endif
+};
+
+
 extern "C"
 {
 
@@ -42,6 +481,106 @@ static bool is_logical(PdGDSObj Node)
 
 
 // get data
+/// get chromosome codes and positions of selected variants
+static void GetChromPos(CFileInfo &File, vector<C_Int32> &code,
+	vector<C_Int32> &pos)
+{
+	if (code.empty()) return;
+	C_BOOL *s = File.Selection().pVariant();
+	File.Chromosome().GetCodes(s, 0, code.size(), &code[0]);
+	const C_Int32 *base = &File.Position()[0];
+	C_Int32 *p = &pos[0];
+	for (size_t m=File.VariantNum(); m > 0; m--, base++)
+		if (*s++) *p++ = *base;
+}
+
+/// check whether the chromosome codes fit in variant keys
+static void CheckVariantKeyCode(CFileInfo &File)
+{
+	const size_t MaxCode = (1 << VARKEY_CHROM_BITS) - 1;
+	if (File.Chromosome().CodeTable().size() > MaxCode)
+	{
+		throw ErrSeqArray(
+			"Variant keys support at most %d distinct chromosomes.",
+			(int)MaxCode);
+	}
+}
+
+/// get the alleles of selected variants
+static void GetSelAllele(CFileInfo &File, vector<string> &allele)
+{
+	PdAbstractArray N = File.GetObj("allele", TRUE);
+	if ((GDS_Array_DimCnt(N) != 1) ||
+			(GDS_Array_GetTotalCount(N) != File.VariantNum()))
+		throw ErrSeqArray("Invalid dimension of 'allele'.");
+	if (allele.empty()) return;
+	C_BOOL *ss = File.Selection().pVariant();
+	GDS_Array_ReadDataEx(N, NULL, NULL, &ss, &allele[0], svStrUTF8);
+}
+
+/// get the alleles of selected variants in a contiguous buffer,
+/// mode = 0 for reference, 1 for alternative and 2 for all alleles;
+/// return Vector{Any}[index, offset, data] where the variant i has the
+/// alleles index[i]:index[i+1]-1, and the allele j is data[offset[j]:offset[j+1]-1]
+static jl_array_t* GetAlleleData(CFileInfo &File, int mode)
+{
+	int n = File.VariantSelNum();
+	vector<string> allele(n);
+	GetSelAllele(File, allele);
+
+	// parse once: the starting and ending positions of alleles
+	vector<C_Int32> index(n + 1), offset(1, 1);
+	vector<const char*> pstart;
+	index[0] = 1;
+	size_t nbyte = 0;
+	for (int i=0; i < n; i++)
+	{
+		const char *p = allele[i].c_str();
+		const char *end = p + allele[i].size();
+		for (int k=0; ; k++)
+		{
+			const char *s = vec_char_find_comma(p, end - p);
+			if ((mode == 2) || ((mode == 0) && (k == 0)) ||
+				((mode == 1) && (k > 0)))
+			{
+				pstart.push_back(p);
+				nbyte += s - p;
+				offset.push_back(nbyte + 1);
+			}
+			if ((s >= end) || (mode == 0)) break;
+			p = s + 1;
+		}
+		index[i+1] = offset.size();
+	}
+
+	// output
+	jl_array_t *Index=NULL, *Offset=NULL, *Data=NULL;
+	JL_GC_PUSH3(&Index, &Offset, &Data);
+	jl_value_t *atype = jl_apply_array_type(jl_int32_type, 1);
+	Index = jl_alloc_array_1d(atype, index.size());
+	memcpy(jl_array_data(Index), &index[0], sizeof(C_Int32)*index.size());
+	Offset = jl_alloc_array_1d(atype, offset.size());
+	memcpy(jl_array_data(Offset), &offset[0], sizeof(C_Int32)*offset.size());
+	atype = jl_apply_array_type(jl_uint8_type, 1);
+	Data = jl_alloc_array_1d(atype, nbyte);
+	C_UInt8 *d = (C_UInt8*)jl_array_data(Data);
+	for (size_t j=0; j < pstart.size(); j++)
+	{
+		size_t m = offset[j+1] - offset[j];
+		memcpy(d, pstart[j], m);
+		d += m;
+	}
+
+	atype = jl_apply_array_type(jl_any_type, 1);
+	jl_array_t *rv_ans = jl_alloc_array_1d(atype, 3);
+	jl_value_t **ptr = (jl_value_t**)jl_array_data(rv_ans);
+	ptr[0] = (jl_value_t*)Index; jl_gc_wb(rv_ans, Index);
+	ptr[1] = (jl_value_t*)Offset; jl_gc_wb(rv_ans, Offset);
+	ptr[2] = (jl_value_t*)Data; jl_gc_wb(rv_ans, Data);
+	JL_GC_POP();
+	return rv_ans;
+}
+
 static jl_array_t* VarGetData(CFileInfo &File, const char *name)
 {
 	static const char *ERR_DIM = "Invalid dimension of '%s'.";
@@ -89,30 +628,43 @@ static jl_array_t* VarGetData(CFileInfo &File, const char *name)
 		if (n > 0)
 		{
 			CChromIndex &Chrom = File.Chromosome();
-			jl_value_t **p = (jl_value_t**)jl_array_data(rv_ans);
-			C_BOOL *s = Sel.pVariant();
-			size_t m = File.VariantNum();
-			string lastss;
-			jl_value_t *last = NULL;
-			for (size_t i=0; i < m; i++)
-			{
-				if (*s++)
-				{
-					const string &ss = Chrom[i];
-					if (ss != lastss)
-					{
-						lastss = ss;
-						last = NULL;
-					}
-					if (!last)
-						last = jl_pchar_to_string(lastss.c_str(), lastss.size());
-					*p++ = last;
-					jl_gc_wb(rv_ans, last);
-				}
-			}
+			vector<C_Int32> code(n);
+			Chrom.GetCodes(Sel.pVariant(), 0, n, &code[0]);
+			chrom_code_to_string(Chrom, &code[0], n, rv_ans);
+		}
+		JL_GC_POP();
+
+	} else if (strcmp(name, "$chrom_code") == 0)
+	{
+		// ===========================================================
+		// chromosome codes, indexing "$chrom_table" from 1
+
+		int n = File.VariantSelNum();
+		jl_value_t *atype = jl_apply_array_type(jl_int32_type, 1);
+		rv_ans = jl_alloc_array_1d(atype, n);
+		if (n > 0)
+		{
+			File.Chromosome().GetCodes(Sel.pVariant(), 0, n,
+				(C_Int32*)jl_array_data(rv_ans));
+		}
+
+	} else if (strcmp(name, "$chrom_table") == 0)
+	{
+		// ===========================================================
+		// the symbol table of chromosomes
+
+		const vector<string> &tab = File.Chromosome().CodeTable();
+		jl_value_t *atype = jl_apply_array_type(jl_string_type, 1);
+		rv_ans = jl_alloc_array_1d(atype, tab.size());
+		JL_GC_PUSH1(&rv_ans);
+		jl_value_t **p = (jl_value_t**)jl_array_data(rv_ans);
+		for (size_t i=0; i < tab.size(); i++)
+		{
+			p[i] = jl_pchar_to_string(tab[i].c_str(), tab[i].size());
+			jl_gc_wb(rv_ans, p[i]);
 		}
 		JL_GC_POP();
-	
+
 	} else if ( (strcmp(name, "variant.id")==0) ||
 		(strcmp(name, "allele")==0) ||
 		(strcmp(name, "annotation/id")==0) ||
@@ -139,7 +691,28 @@ static jl_array_t* VarGetData(CFileInfo &File, const char *name)
 		int nSample  = File.SampleSelNum();
 		int nVariant = File.VariantSelNum();
 
-		if ((nSample > 0) && (nVariant > 0))
+		if ((nSample > 0) && (nVariant > 0) && !File.SampleCacheFN().empty() &&
+			((C_Int64)nSample*CApply_Sample_Geno::SELECT_RATIO <= File.SampleNum()))
+		{
+			// a few samples, read from the sample-major genotype file
+			CApply_Sample_Geno NodeSamp(File);
+			jl_value_t *atype = jl_apply_array_type(jl_uint8_type, 3);
+			rv_ans = jl_alloc_array_3d(atype, File.Ploidy(), nSample, nVariant);
+			C_UInt8 *base = (C_UInt8*)jl_array_data(rv_ans);
+			const ssize_t P = File.Ploidy();
+			const ssize_t SIZE = (ssize_t)nSample * P;
+			vector<C_UInt8> buf((size_t)nVariant * P);
+			for (int i=0; i < nSample; i++)
+			{
+				NodeSamp.ReadGenoData(&buf[0]);
+				NodeSamp.Next();
+				// scatter (ploidy, variant) to (ploidy, sample, variant)
+				C_UInt8 *p = base + i*P;
+				const C_UInt8 *s = &buf[0];
+				for (int j=0; j < nVariant; j++, p+=SIZE, s+=P)
+					memcpy(p, s, P);
+			}
+		} else if ((nSample > 0) && (nVariant > 0))
 		{
 			// initialize GDS genotype Node
 			CApply_Variant_Geno NodeVar(File);
@@ -157,6 +730,29 @@ static jl_array_t* VarGetData(CFileInfo &File, const char *name)
 			rv_ans = jl_alloc_array_3d(atype, File.Ploidy(), nSample, 0);
 		}
 
+	} else if ((strcmp(name, "#genotype_packed")==0) ||
+		(strcmp(name, "$genotype_packed")==0))
+	{
+		// ===========================================================
+		// genotypic data in 2-bit codes
+
+		ssize_t nSample  = File.SampleSelNum();
+		ssize_t nVariant = File.VariantSelNum();
+		ssize_t nByte = (nSample * File.Ploidy() + 3) / 4;
+
+		jl_value_t *atype = jl_apply_array_type(jl_uint8_type, 2);
+		if ((nSample > 0) && (nVariant > 0))
+		{
+			CApply_Variant_Geno NodeVar(File);
+			rv_ans = jl_alloc_array_2d(atype, nByte, nVariant);
+			C_UInt8 *base = (C_UInt8*)jl_array_data(rv_ans);
+			do {
+				NodeVar.ReadGenoPacked(base);
+				base += nByte;
+			} while (NodeVar.Next());
+		} else
+			rv_ans = jl_alloc_array_2d(atype, nByte, 0);
+
 	} else if (strcmp(name, "@genotype") == 0)
 	{
 		static const char *VarName = "genotype/@data";
@@ -194,6 +790,164 @@ static jl_array_t* VarGetData(CFileInfo &File, const char *name)
 			rv_ans = jl_alloc_array_2d(atype, nSample, 0);
 		}
 
+	} else if (strcmp(name, "#dosage_alt")==0 || strcmp(name, "$dosage_alt")==0)
+	{
+		// ===========================================================
+		// dosage data of alternative alleles
+
+		ssize_t nSample  = File.SampleSelNum();
+		ssize_t nVariant = File.VariantSelNum();
+
+		jl_value_t *atype = jl_apply_array_type(jl_uint8_type, 2);
+		if ((nSample > 0) && (nVariant > 0))
+		{
+			CApply_Variant_Dosage NodeVar(File);
+			rv_ans = jl_alloc_array_2d(atype, nSample, nVariant);
+			C_UInt8 *base = (C_UInt8*)jl_array_data(rv_ans);
+			do {
+				NodeVar.ReadDosageAlt(base);
+				base += nSample;
+			} while (NodeVar.Next());
+		} else
+			rv_ans = jl_alloc_array_2d(atype, nSample, 0);
+
+	} else if (strcmp(name, "#dosage_sp")==0 || strcmp(name, "$dosage_sp")==0)
+	{
+		// ===========================================================
+		// dosage data of each alternative allele
+
+		ssize_t nSample  = File.SampleSelNum();
+		ssize_t nVariant = File.VariantSelNum();
+
+		jl_array_t *Index = NULL;
+		jl_array_t *Dat = NULL;
+		JL_GC_PUSH2(&Index, &Dat);
+
+		// the numbers of alternative alleles
+		jl_value_t *atype = jl_apply_array_type(jl_int32_type, 1);
+		Index = jl_alloc_array_1d(atype, nVariant);
+		C_Int32 *pI = (C_Int32*)jl_array_data(Index);
+		ssize_t nTotal = 0;
+		if (nVariant > 0)
+		{
+			CApply_Variant_NumAllele NodeVar(File);
+			for (ssize_t i=0; i < nVariant; i++)
+			{
+				int n = NodeVar.GetNumAllele() - 1;
+				pI[i] = (n > 0) ? n : 0;
+				nTotal += pI[i];
+				NodeVar.Next();
+			}
+		}
+
+		atype = jl_apply_array_type(jl_uint8_type, 2);
+		Dat = jl_alloc_array_2d(atype, nSample, nTotal);
+		if ((nSample > 0) && (nTotal > 0))
+		{
+			CApply_Variant_Dosage NodeVar(File);
+			C_UInt8 *base = (C_UInt8*)jl_array_data(Dat);
+			for (ssize_t i=0; i < nVariant; i++)
+			{
+				NodeVar.ReadDosageAllele(base, pI[i] + 1);
+				base += nSample * pI[i];
+				NodeVar.Next();
+			}
+		}
+
+		atype = jl_apply_array_type(jl_any_type, 1);
+		rv_ans = jl_alloc_array_1d(atype, 2);
+		void **ptr = (void**)jl_array_data(rv_ans);
+		ptr[0] = Index; jl_gc_wb(rv_ans, Index);
+		ptr[1] = Dat; jl_gc_wb(rv_ans, Dat);
+		JL_GC_POP();
+
+	} else if (strcmp(name, "$af")==0 || strcmp(name, "$missing_rate")==0)
+	{
+		// ===========================================================
+		// reference allele frequencies or missing rates of variants
+
+		ssize_t nVariant = File.VariantSelNum();
+		jl_value_t *atype = jl_apply_array_type(jl_float64_type, 1);
+		rv_ans = jl_alloc_array_1d(atype, nVariant);
+		double *p = (double*)jl_array_data(rv_ans);
+		bool is_af = (strcmp(name, "$af") == 0);
+
+		if (File.SampleSelNum() > 0)
+		{
+			if (nVariant > 0)
+			{
+				CApply_Variant_Dosage NodeVar(File);
+				const size_t n = (size_t)File.SampleSelNum() * File.Ploidy();
+				do {
+					size_t nRef, nMiss;
+					NodeVar.CountAllele(nRef, nMiss);
+					if (is_af)
+						*p++ = (n > nMiss) ? double(nRef) / (n - nMiss) : NaN;
+					else
+						*p++ = double(nMiss) / n;
+				} while (NodeVar.Next());
+			}
+		} else {
+			for (ssize_t i=0; i < nVariant; i++) p[i] = NaN;
+		}
+
+	} else if (strcmp(name, "$geno_count") == 0)
+	{
+		// ===========================================================
+		// the numbers of samples with 0, 1, ..., ploidy reference alleles
+		// and missing genotypes
+
+		ssize_t nVariant = File.VariantSelNum();
+		ssize_t nRow = File.Ploidy() + 2;
+		jl_value_t *atype = jl_apply_array_type(jl_int32_type, 2);
+		rv_ans = jl_alloc_array_2d(atype, nRow, nVariant);
+		C_Int32 *p = (C_Int32*)jl_array_data(rv_ans);
+
+		if (File.SampleSelNum() > 0)
+		{
+			if (nVariant > 0)
+			{
+				CApply_Variant_Dosage NodeVar(File);
+				do {
+					NodeVar.CountGenotype(p);
+					p += nRow;
+				} while (NodeVar.Next());
+			}
+		} else {
+			memset(p, 0, sizeof(C_Int32)*nRow*nVariant);
+		}
+
+	} else if (strcmp(name, "$sample_af")==0 ||
+		strcmp(name, "$sample_missing_rate")==0)
+	{
+		// ===========================================================
+		// reference allele frequencies or missing rates of samples
+
+		ssize_t nSample  = File.SampleSelNum();
+		ssize_t nVariant = File.VariantSelNum();
+		jl_value_t *atype = jl_apply_array_type(jl_float64_type, 1);
+		rv_ans = jl_alloc_array_1d(atype, nSample);
+		double *p = (double*)jl_array_data(rv_ans);
+
+		vector<C_Int32> nRef(nSample, 0), nMiss(nSample, 0);
+		if ((nSample > 0) && (nVariant > 0))
+		{
+			CApply_Variant_Dosage NodeVar(File);
+			do {
+				NodeVar.AddSampleCount(&nRef[0], &nMiss[0]);
+			} while (NodeVar.Next());
+		}
+
+		const C_Int64 n = (C_Int64)nVariant * File.Ploidy();
+		if (strcmp(name, "$sample_af") == 0)
+		{
+			for (ssize_t i=0; i < nSample; i++)
+				p[i] = (n > nMiss[i]) ? double(nRef[i]) / (n - nMiss[i]) : NaN;
+		} else {
+			for (ssize_t i=0; i < nSample; i++)
+				p[i] = (n > 0) ? double(nMiss[i]) / n : NaN;
+		}
+
 	} else if (strcmp(name, "phase") == 0)
 	{
 		// ===========================================================
@@ -356,112 +1110,48 @@ static jl_array_t* VarGetData(CFileInfo &File, const char *name)
 			NodeVar.Next();
 		}
 
-/*
-	} else if (strcmp(name, "#ref")==0 || strcmp(name, "$ref")==0)
+	} else if ((strcmp(name, "#ref")==0) || (strcmp(name, "$ref")==0) ||
+		(strcmp(name, "#alt")==0) || (strcmp(name, "$alt")==0) ||
+		(strcmp(name, "$allele_offsets")==0))
 	{
 		// ===========================================================
-		// the reference allele
-
-		PdAbstractArray N = File.GetObj("allele", TRUE);
-		// check
-		if ((GDS_Array_DimCnt(N) != 1) ||
-				(GDS_Array_GetTotalCount(N) != File.VariantNum()))
-			throw ErrSeqArray(ERR_DIM, name);
-		// read
-		size_t n = File.VariantSelNum();
-		vector<string> buffer(n);
-		C_BOOL *ss = Sel.pVariant();
-		GDS_Array_ReadDataEx(N, NULL, NULL, &ss, &buffer[0], svStrUTF8);
-		// output
-		rv_ans = numpy_new_string(n);
-		PyObject **pi = (PyObject**)numpy_getptr(rv_ans);
-		for (size_t i=0; i < n; i++)
-		{
-			const char *p = buffer[i].c_str();
-			size_t m = 0;
-			for (const char *s=p; *s!=',' && *s!=0; s++) m++;
-			numpy_setval(rv_ans, pi, PYSTR_SET2(p, m));
-			pi ++;
-		}
+		// reference, alternative or all alleles in a contiguous buffer
 
-	} else if (strcmp(name, "#alt")==0 || strcmp(name, "$alt")==0)
-	{
-		// ===========================================================
-		// the reference allele
+		int mode = (strcmp(name+1, "ref")==0) ? 0 :
+			((strcmp(name+1, "alt")==0) ? 1 : 2);
+		rv_ans = GetAlleleData(File, mode);
 
-		PdAbstractArray N = File.GetObj("allele", TRUE);
-		// check
-		if ((GDS_Array_DimCnt(N) != 1) ||
-				(GDS_Array_GetTotalCount(N) != File.VariantNum()))
-			throw ErrSeqArray(ERR_DIM, name);
-		// read
-		size_t n = File.VariantSelNum();
-		vector<string> buffer(n);
-		C_BOOL *ss = Sel.pVariant();
-		GDS_Array_ReadDataEx(N, NULL, NULL, &ss, &buffer[0], svStrUTF8);
-		// output
-		rv_ans = numpy_new_string(n);
-		PyObject **pi = (PyObject**)numpy_getptr(rv_ans);
-		for (size_t i=0; i < n; i++)
-		{
-			const char *p = buffer[i].c_str();
-			for (; *p!=',' && *p!=0; p++);
-			if (*p == ',') p++;
-			numpy_setval(rv_ans, pi, PYSTR_SET(p));
-			pi ++;
-		}
-*/
 
 	} else if (strcmp(name, "#chrom_pos")==0 || strcmp(name, "$chrom_pos")==0)
 	{
 		// ===========================================================
-		// chromosome-position
-
-		PdAbstractArray N1 = File.GetObj("chromosome", TRUE);
-		PdAbstractArray N2 = File.GetObj("position", TRUE);
-		C_Int64 n1 = GDS_Array_GetTotalCount(N1);
-		C_Int64 n2 = GDS_Array_GetTotalCount(N2);
-		if ((n1 != n2) || (n1 != File.VariantNum()))
-			throw ErrSeqArray("Invalid dimension of 'chromosome' or 'position'.");
-
-		vector<string> chr;
-		vector<C_Int32> pos;
+		// chromosome-position, "_1", "_2", ... for duplicates
 
 		int n = File.VariantSelNum();
-		chr.resize(n);
-		pos.resize(n);
-		C_BOOL *ss = Sel.pVariant();
-
-		GDS_Array_ReadDataEx(N1, NULL, NULL, &ss, &chr[0], svStrUTF8);
-		GDS_Array_ReadDataEx(N2, NULL, NULL, &ss, &pos[0], svInt32);
-
-		char buf1[1024] = { 0 };
-		char buf2[1024] = { 0 };
-		char *p1 = buf1, *p2 = buf2;
-		int dup = 0;
+		vector<C_Int32> code(n), pos(n);
+		GetChromPos(File, code, pos);
+		const vector<string> &tab = File.Chromosome().CodeTable();
 
 		jl_value_t *atype = jl_apply_array_type(jl_string_type, 1);
-		rv_ans = jl_alloc_array_1d(atype, n1);
+		rv_ans = jl_alloc_array_1d(atype, n);
 		JL_GC_PUSH1(&rv_ans);
 		jl_value_t **p = (jl_value_t**)jl_array_data(rv_ans);
 
-		for (size_t i=0; i < (size_t)n1; i++,p++)
+		char buf[1024];
+		int dup = 0;
+		for (int i=0; i < n; i++, p++)
 		{
-			snprintf(p1, sizeof(buf1), "%s:%d", chr[i].c_str(), pos[i]);
-			if (strcmp(p1, p2) == 0)
+			const char *chr = tab[code[i]-1].c_str();
+			if ((i > 0) && (code[i] == code[i-1]) && (pos[i] == pos[i-1]))
 			{
 				dup ++;
-				snprintf(p1, sizeof(buf1), "%s:%d_%d", chr[i].c_str(),
-					pos[i], dup);
-				*p = jl_cstr_to_string(p1);
-				jl_gc_wb(rv_ans, *p);
+				snprintf(buf, sizeof(buf), "%s:%d_%d", chr, pos[i], dup);
 			} else {
-				char *tmp;
-				tmp = p1; p1 = p2; p2 = tmp;
-				*p = jl_cstr_to_string(p2);
-				jl_gc_wb(rv_ans, *p);
+				snprintf(buf, sizeof(buf), "%s:%d", chr, pos[i]);
 				dup = 0;
 			}
+			*p = jl_cstr_to_string(buf);
+			jl_gc_wb(rv_ans, *p);
 		}
 
 		JL_GC_POP();
@@ -471,43 +1161,51 @@ static jl_array_t* VarGetData(CFileInfo &File, const char *name)
 		// ===========================================================
 		// chromosome-position-allele
 
-		PdAbstractArray N1 = File.GetObj("chromosome", TRUE);
-		PdAbstractArray N2 = File.GetObj("position", TRUE);
-		PdAbstractArray N3 = File.GetObj("allele", TRUE);
-		C_Int64 n1 = GDS_Array_GetTotalCount(N1);
-		C_Int64 n2 = GDS_Array_GetTotalCount(N2);
-		C_Int64 n3 = GDS_Array_GetTotalCount(N3);
-		if ((n1 != n2) || (n1 != n3) || (n1 != File.VariantNum()))
-			throw ErrSeqArray("Invalid dimension of 'chromosome', 'position' or 'allele'.");
-
 		int n = File.VariantSelNum();
-		vector<string> chr(n);
-		vector<C_Int32> pos(n);
+		vector<C_Int32> code(n), pos(n);
+		GetChromPos(File, code, pos);
+		const vector<string> &tab = File.Chromosome().CodeTable();
 		vector<string> allele(n);
+		GetSelAllele(File, allele);
 
-		C_BOOL *ss = Sel.pVariant();
-		GDS_Array_ReadDataEx(N1, NULL, NULL, &ss, &chr[0], svStrUTF8);
-		GDS_Array_ReadDataEx(N2, NULL, NULL, &ss, &pos[0], svInt32);
-		GDS_Array_ReadDataEx(N3, NULL, NULL, &ss, &allele[0], svStrUTF8);
-
-		char buf[65536] = { 0 };
 		jl_value_t *atype = jl_apply_array_type(jl_string_type, 1);
-		rv_ans = jl_alloc_array_1d(atype, n1);
+		rv_ans = jl_alloc_array_1d(atype, n);
 		JL_GC_PUSH1(&rv_ans);
 		jl_value_t **p = (jl_value_t**)jl_array_data(rv_ans);
 
-		for (size_t i=0; i < (size_t)n1; i++,p++)
+		string buf;
+		char tmp[64];
+		for (int i=0; i < n; i++, p++)
 		{
-			const char *s = allele[i].c_str();
-			for (char *p=(char*)s; *p != 0; p++)
-				if (*p == ',') *p = '_';
-			snprintf(buf, sizeof(buf), "%s:%d_%s", chr[i].c_str(), pos[i], s);
-			*p = jl_cstr_to_string(buf);
+			snprintf(tmp, sizeof(tmp), ":%d_", pos[i]);
+			buf = tab[code[i]-1];
+			buf.append(tmp);
+			buf.append(allele[i]);
+			replace(buf.end() - allele[i].size(), buf.end(), ',', '_');
+			*p = jl_pchar_to_string(buf.c_str(), buf.size());
 			jl_gc_wb(rv_ans, *p);
 		}
 
 		JL_GC_POP();
 
+	} else if (strcmp(name, "$variant_key") == 0)
+	{
+		// ===========================================================
+		// 64-bit variant keys of chromosome code, position and alleles
+
+		CheckVariantKeyCode(File);
+		int n = File.VariantSelNum();
+		vector<C_Int32> code(n), pos(n);
+		GetChromPos(File, code, pos);
+		vector<string> allele(n);
+		GetSelAllele(File, allele);
+
+		jl_value_t *atype = jl_apply_array_type(jl_uint64_type, 1);
+		rv_ans = jl_alloc_array_1d(atype, n);
+		C_UInt64 *p = (C_UInt64*)jl_array_data(rv_ans);
+		for (int i=0; i < n; i++)
+			p[i] = GetVariantKey(code[i], pos[i], allele[i].c_str());
+
 	} else {
 		throw ErrSeqArray(
 			"'%s' is not a standard variable name, and the standard format:\n"
@@ -521,6 +1219,186 @@ static jl_array_t* VarGetData(CFileInfo &File, const char *name)
 }
 
 
+// the data type of a Julia array, or svCustom if not supported
+static C_SVType ArraySVType(jl_array_t *a)
+{
+	jl_value_t *t = jl_array_eltype((jl_value_t*)a);
+	if (t == (jl_value_t*)jl_int8_type)
+		return svInt8;
+	else if (t == (jl_value_t*)jl_uint8_type)
+		return svUInt8;
+	else if (t == (jl_value_t*)jl_int16_type)
+		return svInt16;
+	else if (t == (jl_value_t*)jl_uint16_type)
+		return svUInt16;
+	else if (t == (jl_value_t*)jl_int32_type)
+		return svInt32;
+	else if (t == (jl_value_t*)jl_uint32_type)
+		return svUInt32;
+	else if (t == (jl_value_t*)jl_int64_type)
+		return svInt64;
+	else if (t == (jl_value_t*)jl_uint64_type)
+		return svUInt64;
+	else if (t == (jl_value_t*)jl_float32_type)
+		return svFloat32;
+	else if (t == (jl_value_t*)jl_float64_type)
+		return svFloat64;
+	return svCustom;
+}
+
+// check the element type and dimension of a Julia array
+static void CheckArray(jl_array_t *a, const char *name, C_SVType sv,
+	int ndim, const size_t dim[])
+{
+	if ((sv != svCustom) && (ArraySVType(a) != sv))
+		throw ErrSeqArray("Invalid element type of the output array for '%s'.", name);
+	bool flag = (jl_array_ndims(a) == ndim);
+	for (int i=0; flag && (i < ndim); i++)
+		flag = (jl_array_dim(a, i) == dim[i]);
+	if (!flag)
+		throw ErrSeqArray("Invalid dimension of the output array for '%s'.", name);
+}
+
+// get data, and save to a preallocated Julia array
+static void VarGetDataInto(CFileInfo &File, const char *name, jl_array_t *out)
+{
+	TSelection &Sel = File.Selection();
+
+	if (strcmp(name, "position") == 0)
+	{
+		// ===========================================================
+		// position
+
+		size_t dim[1] = { (size_t)File.VariantSelNum() };
+		CheckArray(out, name, svInt32, 1, dim);
+		if (dim[0] > 0)
+		{
+			const int *base = &File.Position()[0];
+			int *p = (int*)jl_array_data(out);
+			C_BOOL *s = Sel.pVariant();
+			for (size_t m=File.VariantNum(); m > 0; m--)
+			{
+				if (*s++) *p++ = *base;
+				base ++;
+			}
+		}
+
+	} else if (strcmp(name, "$chrom_code") == 0)
+	{
+		// ===========================================================
+		// chromosome codes
+
+		size_t dim[1] = { (size_t)File.VariantSelNum() };
+		CheckArray(out, name, svInt32, 1, dim);
+		if (dim[0] > 0)
+		{
+			File.Chromosome().GetCodes(Sel.pVariant(), 0, dim[0],
+				(C_Int32*)jl_array_data(out));
+		}
+
+	} else if (strcmp(name, "genotype") == 0)
+	{
+		// ===========================================================
+		// genotypic data
+
+		size_t dim[3] = { (size_t)File.Ploidy(), (size_t)File.SampleSelNum(),
+			(size_t)File.VariantSelNum() };
+		CheckArray(out, name, svUInt8, 3, dim);
+		if ((dim[1] > 0) && (dim[2] > 0))
+		{
+			CApply_Variant_Geno NodeVar(File);
+			C_UInt8 *base = (C_UInt8*)jl_array_data(out);
+			ssize_t SIZE = (ssize_t)dim[1] * dim[0];
+			do {
+				NodeVar.ReadGenoData(base);
+				base += SIZE;
+			} while (NodeVar.Next());
+		}
+
+	} else if ((strcmp(name, "#genotype_packed")==0) ||
+		(strcmp(name, "$genotype_packed")==0))
+	{
+		// ===========================================================
+		// genotypic data in 2-bit codes
+
+		size_t dim[2] = {
+			((size_t)File.SampleSelNum() * File.Ploidy() + 3) / 4,
+			(size_t)File.VariantSelNum() };
+		CheckArray(out, name, svUInt8, 2, dim);
+		if ((File.SampleSelNum() > 0) && (dim[1] > 0))
+		{
+			CApply_Variant_Geno NodeVar(File);
+			C_UInt8 *base = (C_UInt8*)jl_array_data(out);
+			do {
+				NodeVar.ReadGenoPacked(base);
+				base += dim[0];
+			} while (NodeVar.Next());
+		}
+
+	} else if (strcmp(name, "#dosage")==0 || strcmp(name, "$dosage")==0)
+	{
+		// ===========================================================
+		// dosage data
+
+		size_t dim[2] = { (size_t)File.SampleSelNum(),
+			(size_t)File.VariantSelNum() };
+		CheckArray(out, name, svUInt8, 2, dim);
+		if ((dim[0] > 0) && (dim[1] > 0))
+		{
+			CApply_Variant_Dosage NodeVar(File);
+			C_UInt8 *base = (C_UInt8*)jl_array_data(out);
+			do {
+				NodeVar.ReadDosage(base);
+				base += dim[0];
+			} while (NodeVar.Next());
+		}
+
+	} else if ((strncmp(name, "annotation/format/", 18) == 0) &&
+		(name[18] != '@'))
+	{
+		// ===========================================================
+		// annotation/format, the data part (sample, the number of entries)
+
+		GDS_PATH_PREFIX_CHECK(name);
+		string name1 = string(name) + "/data";
+		string name2 = string(name) + "/@data";
+		PdAbstractArray N = File.GetObj(name1.c_str(), TRUE);
+		if (GDS_Array_DimCnt(N) != 2)
+			throw ErrSeqArray("Invalid dimension of '%s'.", name1.c_str());
+
+		CIndex &V = File.VarIndex(name2);
+		int var_start, var_count;
+		vector<C_BOOL> var_sel;
+		V.GetSel(Sel.pVariant(), var_start, var_count, var_sel, NULL);
+
+		size_t dim[2] = { (size_t)File.SampleSelNum(),
+			(size_t)GetNumOfTRUE(var_sel.empty() ? NULL : &var_sel[0],
+				var_sel.size()) };
+		C_SVType sv = ArraySVType(out);
+		if (sv == svCustom)
+			throw ErrSeqArray("Invalid element type of the output array for '%s'.", name);
+		CheckArray(out, name, sv, 2, dim);
+
+		if ((dim[0] > 0) && (dim[1] > 0))
+		{
+			C_BOOL *ss[2] = { &var_sel[0], Sel.pSample() };
+			C_Int32 dimst[2]  = { var_start, 0 };
+			C_Int32 dimcnt[2];
+			GDS_Array_GetDim(N, dimcnt, 2);
+			dimcnt[0] = var_count;
+			GDS_Array_ReadDataEx(N, dimst, dimcnt, ss, jl_array_data(out), sv);
+		}
+
+	} else {
+		throw ErrSeqArray(
+			"'%s' is not supported, and the output array can be filled for\n"
+			"    genotype, #genotype_packed, #dosage, position, $chrom_code,\n"
+			"    annotation/format/VARIABLE_NAME",
+			name);
+	}
+}
+
+
 /// Get data from a working space
 COREARRAY_DLL_EXPORT jl_array_t* SEQ_GetData(int file_id, const char *name)
 {
@@ -529,21 +1407,172 @@ COREARRAY_DLL_EXPORT jl_array_t* SEQ_GetData(int file_id, const char *name)
 		// File information
 		CFileInfo &File = GetFileInfo(file_id);
 		// Get data
+		CSeqLock lock(File.Mutex());
 		rv_ans = VarGetData(File, name);
 	COREARRAY_CATCH
 	return rv_ans;
 }
 
 
-/// Apply functions over variants in block
+/// Get data from a working space, and save to a preallocated array
+COREARRAY_DLL_EXPORT void SEQ_GetDataInto(int file_id, const char *name,
+	jl_array_t *out)
+{
+	COREARRAY_TRY
+		// File information
+		CFileInfo &File = GetFileInfo(file_id);
+		// Get data
+		CSeqLock lock(File.Mutex());
+		VarGetDataInto(File, name, out);
+	COREARRAY_CATCH
+}
+
+
+/// Get the variant keys of external variants with the chromosome codes of
+/// the file, unknown chromosomes have the code 0 which matches no variant
+COREARRAY_DLL_EXPORT jl_array_t* SEQ_VariantKey(int file_id,
+	jl_array_t *chrom, jl_array_t *pos, jl_array_t *allele)
+{
+	jl_array_t *rv_ans = NULL;
+	COREARRAY_TRY
+		CFileInfo &File = GetFileInfo(file_id);
+		CSeqLock lock(File.Mutex());
+		CChromIndex &Chrom = File.Chromosome();
+		CheckVariantKeyCode(File);
+
+		size_t n = jl_array_len(chrom);
+		if ((jl_array_len(pos) != n) || (jl_array_len(allele) != n))
+			throw ErrSeqArray("'pos' and 'allele' should have the same length as 'chrom'.");
+		jl_value_t **pChr = (jl_value_t**)jl_array_data(chrom);
+		const C_Int32 *pPos = (const C_Int32*)jl_array_data(pos);
+		jl_value_t **pAllele = (jl_value_t**)jl_array_data(allele);
+
+		jl_value_t *atype = jl_apply_array_type(jl_uint64_type, 1);
+		rv_ans = jl_alloc_array_1d(atype, n);
+		C_UInt64 *p = (C_UInt64*)jl_array_data(rv_ans);
+		// chromosomes are usually sorted in the external data
+		string last;
+		int code = 0;
+		for (size_t i=0; i < n; i++)
+		{
+			const char *s = jl_string_ptr(pChr[i]);
+			if ((i == 0) || (last != s))
+			{
+				last = s;
+				code = Chrom.Code(last);
+			}
+			p[i] = GetVariantKey(code, pPos[i], jl_string_ptr(pAllele[i]));
+		}
+	COREARRAY_CATCH
+	return rv_ans;
+}
+
+
+/// whether two allele lists are equal, case-insensitive as the variant keys
+static bool AlleleEqual(const char *s1, const char *s2)
+{
+	for (; *s1 && *s2; s1++, s2++)
+		if (toupper((C_UInt8)*s1) != toupper((C_UInt8)*s2)) return false;
+	return (*s1 == 0) && (*s2 == 0);
+}
+
+/// Match external variants to the selected variants by a hash join of the
+/// variant keys, and each hit is confirmed by the chromosome, position and
+/// alleles, return the indices of selected variants starting from 1, or 0
+/// if not found
+COREARRAY_DLL_EXPORT jl_array_t* SEQ_MatchVariant(int file_id,
+	jl_array_t *chrom, jl_array_t *pos, jl_array_t *allele)
+{
+	jl_array_t *rv_ans = NULL;
+	COREARRAY_TRY
+		CFileInfo &File = GetFileInfo(file_id);
+		CSeqLock lock(File.Mutex());
+		CChromIndex &Chrom = File.Chromosome();
+		CheckVariantKeyCode(File);
+
+		size_t n = jl_array_len(chrom);
+		if ((jl_array_len(pos) != n) || (jl_array_len(allele) != n))
+			throw ErrSeqArray("'pos' and 'allele' should have the same length as 'chrom'.");
+		jl_value_t **pChr = (jl_value_t**)jl_array_data(chrom);
+		const C_Int32 *pPos = (const C_Int32*)jl_array_data(pos);
+		jl_value_t **pAllele = (jl_value_t**)jl_array_data(allele);
+
+		// the selected variants
+		int nVar = File.VariantSelNum();
+		vector<C_Int32> code(nVar), vpos(nVar);
+		GetChromPos(File, code, vpos);
+		vector<string> valle(nVar);
+		GetSelAllele(File, valle);
+
+		// open addressing with linear probing, load factor <= 0.5,
+		// 0 is an empty slot since the variant keys have nonzero codes;
+		// the variants with the same key are all kept in the order of
+		// variants, since different alleles could have the same hash
+		size_t size = 16;
+		while (size < 2*(size_t)nVar) size <<= 1;
+		const size_t mask = size - 1;
+		vector<C_UInt64> tab_key(size, 0);
+		vector<C_Int32> tab_idx(size, 0);
+		for (int i=0; i < nVar; i++)
+		{
+			C_UInt64 k = GetVariantKey(code[i], vpos[i], valle[i].c_str());
+			size_t h = (k * 0x9E3779B97F4A7C15ULL) >> 32;
+			for (h &= mask; tab_key[h] != 0; h = (h + 1) & mask) { }
+			tab_key[h] = k; tab_idx[h] = i + 1;
+		}
+
+		// probe, chromosomes are usually sorted in the external data
+		jl_value_t *atype = jl_apply_array_type(jl_int32_type, 1);
+		rv_ans = jl_alloc_array_1d(atype, n);
+		C_Int32 *p = (C_Int32*)jl_array_data(rv_ans);
+		string last;
+		int ecode = 0;
+		for (size_t i=0; i < n; i++)
+		{
+			const char *s = jl_string_ptr(pChr[i]);
+			if ((i == 0) || (last != s))
+			{
+				last = s;
+				ecode = Chrom.Code(last);
+			}
+			C_Int32 idx = 0;
+			if (ecode > 0)
+			{
+				const char *a = jl_string_ptr(pAllele[i]);
+				const C_UInt64 k = GetVariantKey(ecode, pPos[i], a);
+				size_t h = (k * 0x9E3779B97F4A7C15ULL) >> 32;
+				for (h &= mask; tab_key[h] != 0; h = (h + 1) & mask)
+				{
+					if (tab_key[h] != k) continue;
+					int j = tab_idx[h] - 1;
+					if ((code[j] == ecode) && (vpos[j] == pPos[i]) &&
+						AlleleEqual(valle[j].c_str(), a))
+					{
+						idx = j + 1; break;
+					}
+				}
+			}
+			p[i] = idx;
+		}
+	COREARRAY_CATCH
+	return rv_ans;
+}
+
+
+/// Apply functions over variants in block, the readers of genotypes, dosages,
+/// positions and chromosomes are kept across blocks, and genotypes and dosages
+/// are decoded in a separate thread with the queue depth 'prefetch' if > 0
 COREARRAY_DLL_EXPORT jl_array_t* SEQ_BApply_Variant(int file_id,
 	jl_value_t *name, jl_function_t *fun, const char *asis,
-	int bsize, C_BOOL verbose, jl_array_t *args)
+	int bsize, int prefetch, C_BOOL verbose, jl_array_t *args)
 {
 	if (bsize < 1)
 		jl_error("'bsize' must be >= 1.");
+	if (prefetch < 0)
+		jl_error("'prefetch' must be >= 0.");
 
 	jl_array_t *rv_ans = NULL;
+	jl_value_t *exc = NULL;  // the exception from the user-defined function
 	COREARRAY_TRY
 
 		// get a list of variable name
@@ -594,70 +1623,116 @@ COREARRAY_DLL_EXPORT jl_array_t* SEQ_BApply_Variant(int file_id,
 		jl_value_t **ArgPtr = (jl_value_t**)jl_array_data(args);
 
 		// protect
-		JL_GC_PUSH1(&rv_ans);
-
-		// local selection
-		File.SelList.push_back(TSelection());
-		TSelection &Sel = File.SelList.back();
-		Sel.Sample = Selection.Sample;
-		Sel.Variant.resize(File.VariantNum());
+		jl_array_t *pref_roots = NULL;
+		JL_GC_PUSH3(&rv_ans, &pref_roots, &exc);
 
-		C_BOOL *pBase, *pSel, *pEnd;
-		pBase = pSel = Selection.pVariant();
-		pEnd = pBase + Selection.Variant.size();
-
-		// progress object
-		CProgressStdOut progress(NumBlock, verbose);
-
-		// for-loop
-		for (int idx=0; idx < NumBlock; idx++)
+		// reading genotypes, dosages, positions and chromosomes block by block
+		CBlockReader Reader;
+		int nPref = CBlockReader::NumPrefetch(name_list);
+		if ((prefetch > 0) && (nPref > 0))
+		{
+			jl_value_t *atype = jl_apply_array_type(jl_any_type, 1);
+			int depth = (prefetch < NumBlock) ? prefetch : NumBlock;
+			pref_roots = jl_alloc_array_1d(atype, depth*nPref);
+		} else
+			prefetch = 0;
 		{
-			// assign sub-selection
+			CSeqLock lock(File.Mutex());
+			Reader.Init(File, name_list, bsize, prefetch, pref_roots);
+		}
+
+		// local selection, which is popped if any exception is thrown
+		list<TSelection> &SelList = File.SelList();
+		SelList.push_back(TSelection());
+		try {
+			TSelection &Sel = SelList.back();
+			Sel.Sample = Selection.Sample;
+			Sel.SampleSelCnt = Selection.SampleSelCnt;
+			Sel.Variant.resize(File.VariantNum(), FALSE);
+
+			C_BOOL *pBase, *pSel, *pEnd;
+			pBase = pSel = Selection.pVariant();
+			pEnd = pBase + Selection.Variant.size();
+			// the range of selected variants in the previous block
+			C_BOOL *pBlockStart=pBase, *pBlockEnd=pBase;
+
+			// progress object
+			CProgressStdOut progress(NumBlock, verbose);
+
+			// for-loop
+			for (int idx=0; idx < NumBlock; idx++)
 			{
-				C_BOOL *pNewSel = Sel.pVariant();
-				memset(pNewSel, 0, Sel.Variant.size());
-				// for-loop
-				for (int bs=bsize; bs > 0; bs--)
+				// assign sub-selection
 				{
-					while ((pSel < pEnd) && (*pSel == FALSE))
-						pSel ++;
-					if (pSel < pEnd)
+					C_BOOL *pNewSel = Sel.pVariant();
+					// only clear the range of the previous block
+					memset(pNewSel + (pBlockStart - pBase), 0, pBlockEnd - pBlockStart);
+					int cnt = 0;
+					// for-loop
+					for (int bs=bsize; bs > 0; bs--)
 					{
-						pNewSel[pSel - pBase] = TRUE;
-						pSel ++;
-					} else
-						break;
+						while ((pSel < pEnd) && (*pSel == FALSE))
+							pSel ++;
+						if (pSel < pEnd)
+						{
+							if (cnt == 0) pBlockStart = pSel;
+							pNewSel[pSel - pBase] = TRUE;
+							pSel ++; cnt ++;
+						} else
+							break;
+					}
+					pBlockEnd = pSel;
+					Sel.VariantSelCnt = cnt;
 				}
-			}
 
-			jl_value_t **list_args;
-			JL_GC_PUSHARGS(list_args, nVar+nArgs);
+				jl_value_t **list_args;
+				JL_GC_PUSHARGS(list_args, nVar+nArgs);
 
-			// load data
-			for (size_t i=0; i < nVar; i++)
-				list_args[i] = (jl_value_t*)VarGetData(File, name_list[i].c_str());
-			for (size_t i=0; i < nArgs; i++)
-				list_args[nVar+i] = ArgPtr[i];
+				// load data
+				Reader.Read(idx, list_args);
+				for (size_t i=0; i < nVar; i++)
+				{
+					if (!Reader.Has(i))
+					{
+						CSeqLock lock(File.Mutex());
+						list_args[i] = (jl_value_t*)VarGetData(File,
+							name_list[i].c_str());
+					}
+				}
+				Reader.Release(idx);
+				for (size_t i=0; i < nArgs; i++)
+					list_args[nVar+i] = ArgPtr[i];
 
-			// call Julia function
-			jl_value_t *rv = jl_call(fun, list_args, nVar+nArgs);
-			// save
-			if (rv_ans)
-			{
-				void **ptr = (void**)jl_array_data(rv_ans);
-				ptr[idx] = rv;
-				jl_gc_wb(rv_ans, rv);
-			}
+				// call Julia function
+				jl_value_t *rv = jl_call(fun, list_args, nVar+nArgs);
+				if (!rv && (exc = jl_exception_occurred()))
+				{
+					JL_GC_POP();
+					break;
+				}
+				// save
+				if (rv_ans)
+				{
+					void **ptr = (void**)jl_array_data(rv_ans);
+					ptr[idx] = rv;
+					jl_gc_wb(rv_ans, rv);
+				}
 
-			JL_GC_POP();
+				JL_GC_POP();
 
-			progress.Forward();
+				progress.Forward();
+			}
 		}
-
-		File.SelList.pop_back();
+		catch (...) {
+			SelList.pop_back();
+			throw;
+		}
+		SelList.pop_back();
 		JL_GC_POP();
 
 	COREARRAY_CATCH
+	// rethrow the exception after the reader thread and selection are released
+	if (exc) jl_throw(exc);
 	if (!rv_ans) rv_ans = (jl_array_t*)jl_nothing;
 	return rv_ans;
 }
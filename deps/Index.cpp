@@ -20,6 +20,14 @@
 // If not, see <http://www.gnu.org/licenses/>.
 
 #include "Index.h"
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#   include <process.h>
+#   define getpid    _getpid
+#else
+#   include <unistd.h>
+#endif
 
 using namespace std;
 
@@ -36,9 +44,6 @@ static double NaN = 0.0/0.0;
 CIndex::CIndex()
 {
 	TotalLength = 0;
-	Position = 0;
-	AccSum = 0;
-	AccIndex = AccOffset = 0;
 }
 
 void CIndex::Init(PdContainer Obj)
@@ -85,9 +90,7 @@ void CIndex::Init(PdContainer Obj)
 		Lengths.push_back(repeat);					
 	}
 
-	Position = 0;
-	AccSum = 0;
-	AccIndex = AccOffset = 0;
+	InitRLE();
 }
 
 void CIndex::InitOne(int num)
@@ -96,39 +99,44 @@ void CIndex::InitOne(int num)
 	Values.push_back(1);
 	Lengths.clear();
 	Lengths.push_back(num);
-	TotalLength = num;
-	Position = 0;
-	AccSum = 0;
-	AccIndex = AccOffset = 0;
+	InitRLE();
 }
 
-void CIndex::GetInfo(size_t pos, C_Int64 &Sum, int &Value)
+void CIndex::InitRLE()
 {
-	if (pos >= TotalLength)
-		throw ErrSeqArray("Invalid position in CIndex.");
-	if (pos < Position)
-	{
-		Position = 0;
-		AccSum = 0;
-		AccIndex = AccOffset = 0;
-	}
-	for (; Position < pos; )
+	TotalLength = 0;
+	for (size_t i=0; i < Lengths.size(); i++)
+		TotalLength += Lengths[i];
+	Checkpoint.Init(Values, Lengths);
+}
+
+void CIndex::LocateRun(size_t pos, TRunCursor &Cur) const
+{
+	size_t end = Cur.AccStart + Lengths[Cur.AccIndex];
+	if ((pos < Cur.AccStart) || (pos >= end))
 	{
-		size_t L = Lengths[AccIndex];
-		size_t n = L - AccOffset;
-		if ((Position + n) <= pos)
+		// sequential access, check the next run first
+		if ((pos >= end) && (Cur.AccIndex+1 < Lengths.size()) &&
+			(pos < end + Lengths[Cur.AccIndex+1]))
 		{
-			AccSum += (Values[AccIndex] * n);
-			AccIndex ++; AccOffset = 0;
+			Cur.AccSum += (C_Int64)Values[Cur.AccIndex] * Lengths[Cur.AccIndex];
+			Cur.AccStart = end;
+			Cur.AccIndex ++;
 		} else {
-			n = pos - Position;
-			AccSum += (Values[AccIndex] * n);
-			AccOffset += n;
+			Checkpoint.Find(Values, Lengths, pos, Cur.AccIndex, Cur.AccStart,
+				Cur.AccSum);
 		}
-		Position += n;
 	}
-	Sum = AccSum;
-	Value = Values[AccIndex];
+}
+
+void CIndex::GetInfo(size_t pos, C_Int64 &Sum, int &Value,
+	TRunCursor &Cur) const
+{
+	if (pos >= TotalLength)
+		throw ErrSeqArray("Invalid position in CIndex.");
+	LocateRun(pos, Cur);
+	Value = Values[Cur.AccIndex];
+	Sum = Cur.AccSum + (C_Int64)Value * (pos - Cur.AccStart);
 }
 
 jl_array_t* CIndex::GetLen_Sel(const C_BOOL sel[])
@@ -182,12 +190,21 @@ jl_array_t* CIndex::GetLen_Sel(const C_BOOL sel[])
 jl_array_t* CIndex::GetLen_Sel(const C_BOOL sel[], int &out_var_start,
 	int &out_var_count, vector<C_BOOL> &out_var_sel)
 {
-	size_t n;
-	const C_BOOL *p = (C_BOOL *)vec_i8_cnt_nonzero_ptr((const int8_t *)sel,
-		TotalLength, &n);
+	size_t n = GetNumOfTRUE(sel, TotalLength);
 	// create a numpy array object
 	jl_value_t *atype = jl_apply_array_type(jl_int32_type, 1);
 	jl_array_t *rv_ans = jl_alloc_array_1d(atype, n);
+	GetSel(sel, out_var_start, out_var_count, out_var_sel,
+		(int*)jl_array_data(rv_ans));
+	return rv_ans;
+}
+
+void CIndex::GetSel(const C_BOOL sel[], int &out_var_start,
+	int &out_var_count, vector<C_BOOL> &out_var_sel, int *out_len)
+{
+	size_t n;
+	const C_BOOL *p = (C_BOOL *)vec_i8_cnt_nonzero_ptr((const int8_t *)sel,
+		TotalLength, &n);
 	out_var_start = 0;
 	out_var_count = 0;
 
@@ -216,7 +233,6 @@ jl_array_t* CIndex::GetLen_Sel(const C_BOOL sel[], int &out_var_start,
 		int *pVV = pV;
 		C_UInt32 *pLL = pL;
 		size_t LL = L;
-		int *pAns = (int*)jl_array_data(rv_ans);
 		for (size_t m=n; m > 0; )
 		{
 			if (L == 0)
@@ -228,7 +244,7 @@ jl_array_t* CIndex::GetLen_Sel(const C_BOOL sel[], int &out_var_start,
 			out_var_count += (*pV);
 			if (*p++)
 			{
-				*pAns++ = *pV;
+				if (out_len) *out_len++ = *pV;
 				m --;
 			}
 		}
@@ -254,8 +270,6 @@ jl_array_t* CIndex::GetLen_Sel(const C_BOOL sel[], int &out_var_start,
 	} else {
 		out_var_sel.clear();
 	}
-
-	return rv_ans;
 }
 
 
@@ -265,9 +279,6 @@ jl_array_t* CIndex::GetLen_Sel(const C_BOOL sel[], int &out_var_start,
 CGenoIndex::CGenoIndex()
 {
 	TotalLength = 0;
-	Position = 0;
-	AccSum = 0;
-	AccIndex = AccOffset = 0;
 }
 
 void CGenoIndex::Init(PdContainer Obj)
@@ -314,38 +325,44 @@ void CGenoIndex::Init(PdContainer Obj)
 		Lengths.push_back(repeat);					
 	}
 
-	Position = 0;
-	AccSum = 0;
-	AccIndex = AccOffset = 0;
+	InitRLE();
 }
 
-void CGenoIndex::GetInfo(size_t pos, C_Int64 &Sum, C_UInt8 &Value)
+void CGenoIndex::InitRLE()
 {
-	if (pos >= TotalLength)
-		throw ErrSeqArray("Invalid position in CIndex.");
-	if (pos < Position)
-	{
-		Position = 0;
-		AccSum = 0;
-		AccIndex = AccOffset = 0;
-	}
-	for (; Position < pos; )
+	TotalLength = 0;
+	for (size_t i=0; i < Lengths.size(); i++)
+		TotalLength += Lengths[i];
+	Checkpoint.Init(Values, Lengths);
+}
+
+void CGenoIndex::LocateRun(size_t pos, TRunCursor &Cur) const
+{
+	size_t end = Cur.AccStart + Lengths[Cur.AccIndex];
+	if ((pos < Cur.AccStart) || (pos >= end))
 	{
-		size_t L = Lengths[AccIndex];
-		size_t n = L - AccOffset;
-		if ((Position + n) <= pos)
+		// sequential access, check the next run first
+		if ((pos >= end) && (Cur.AccIndex+1 < Lengths.size()) &&
+			(pos < end + Lengths[Cur.AccIndex+1]))
 		{
-			AccSum += (Values[AccIndex] * n);
-			AccIndex ++; AccOffset = 0;
+			Cur.AccSum += (C_Int64)Values[Cur.AccIndex] * Lengths[Cur.AccIndex];
+			Cur.AccStart = end;
+			Cur.AccIndex ++;
 		} else {
-			n = pos - Position;
-			AccSum += (Values[AccIndex] * n);
-			AccOffset += n;
+			Checkpoint.Find(Values, Lengths, pos, Cur.AccIndex, Cur.AccStart,
+				Cur.AccSum);
 		}
-		Position += n;
 	}
-	Sum = AccSum;
-	Value = Values[AccIndex] & 0x0F;
+}
+
+void CGenoIndex::GetInfo(size_t pos, C_Int64 &Sum, C_UInt8 &Value,
+	TRunCursor &Cur) const
+{
+	if (pos >= TotalLength)
+		throw ErrSeqArray("Invalid position in CIndex.");
+	LocateRun(pos, Cur);
+	Sum = Cur.AccSum + (C_Int64)Values[Cur.AccIndex] * (pos - Cur.AccStart);
+	Value = Values[Cur.AccIndex] & 0x0F;
 }
 
 
@@ -373,45 +390,102 @@ void CChromIndex::AddChrom(PdGDSFolder Root)
 	GDS_Array_ReadData(varChrom, &idx, &len, &last, svStrUTF8);
 	idx ++;
 
-	TRange rng;
-	rng.Start = 0;
-	rng.Length = 1;
-
-	Map.clear();
-	PosToChr.Clear();
+	int start = 0, length = 1;
+	Clear();
 
 	const C_Int32 NMAX = 4096;
-	string txt[NMAX];
+	vector<string> txt(NMAX);
 
 	while (idx < NumChrom)
 	{
 		len = NumChrom - idx;
 		if (len > NMAX) len = NMAX;
-		GDS_Array_ReadData(varChrom, &idx, &len, &txt, svStrUTF8);
+		GDS_Array_ReadData(varChrom, &idx, &len, &txt[0], svStrUTF8);
 		for (int i=0; i < len; i++)
 		{
 			if (txt[i] == last)
 			{
-				rng.Length ++;
+				length ++;
 			} else {
-				Map[last].push_back(rng);
-				PosToChr.Add(last, rng.Length);
+				AddRun(last, start, length);
 				last = string(txt[i].begin(), txt[i].end());
-				rng.Start = idx + i;
-				rng.Length = 1;
+				start = idx + i;
+				length = 1;
 			}
 		}
 		idx += len;
 	}
 
-	Map[last].push_back(rng);
-	PosToChr.Add(last, rng.Length);
+	AddRun(last, start, length);
+	Init();
+}
+
+void CChromIndex::AddRun(const string &chr, int start, int len)
+{
+	TRange rng;
+	rng.Start = start;
+	rng.Length = len;
+	Map[chr].push_back(rng);
+	PosToChr.Add(chr, len);
+	// intern the chromosome
+	map<string, int>::iterator it = _CodeMap.find(chr);
+	int code;
+	if (it == _CodeMap.end())
+	{
+		_CodeTable.push_back(chr);
+		code = _CodeTable.size();
+		_CodeMap[chr] = code;
+	} else
+		code = it->second;
+	_RunCodes.push_back(code);
+	_RunStarts.push_back(start);
+}
+
+void CChromIndex::Init()
+{
 	PosToChr.Init();
 }
 
 void CChromIndex::Clear()
 {
 	Map.clear();
+	PosToChr.Clear();
+	_RunCodes.clear();
+	_RunStarts.clear();
+	_CodeTable.clear();
+	_CodeMap.clear();
+}
+
+int CChromIndex::Code(const string &chr) const
+{
+	map<string, int>::const_iterator it = _CodeMap.find(chr);
+	return (it != _CodeMap.end()) ? it->second : 0;
+}
+
+size_t CChromIndex::RunIndex(size_t pos) const
+{
+	if (_RunStarts.empty() || (pos >= PosToChr.TotalCount()))
+		throw ErrSeqArray("Invalid variant index in the chromosome index.");
+	return upper_bound(_RunStarts.begin(), _RunStarts.end(), pos) -
+		_RunStarts.begin() - 1;
+}
+
+void CChromIndex::GetCodes(const C_BOOL *sel, size_t st, size_t cnt,
+	C_Int32 *out) const
+{
+	if (cnt <= 0) return;
+	// the run containing 'st'
+	size_t k = RunIndex(st);
+	const vector<C_UInt32> &Lens = RunLengths();
+	size_t ed = _RunStarts[k] + Lens[k];
+	for (size_t i=st; cnt > 0; i++)
+	{
+		if (i >= ed)
+		{
+			k ++; ed += Lens[k];
+		}
+		if (sel[i]) { *out++ = _RunCodes[k]; cnt--; }
+	}
 }
 
 size_t CChromIndex::RangeTotalLength(const TRangeList &RngList)
@@ -429,15 +503,15 @@ size_t CChromIndex::RangeTotalLength(const TRangeList &RngList)
 // Genomic Range Set
 // ===========================================================
 
-bool CRangeSet::less_range::operator()(const TRange &lhs, const TRange &rhs) const
+CRangeSet::CRangeSet()
 {
-	// -1 for two possible adjacent regions
-	return (lhs.End < rhs.Start-1);
+	_Merged = true;
 }
 
 void CRangeSet::Clear()
 {
-	_RangeSet.clear();
+	_List.clear();
+	_Merged = true;
 }
 
 void CRangeSet::AddRange(int start, int end)
@@ -445,31 +519,82 @@ void CRangeSet::AddRange(int start, int end)
 	if (end < start) end = start;
 	TRange rng;
 	rng.Start = start; rng.End = end;
+	_List.push_back(rng);
+	_Merged = false;
+}
 
-	do {
-		set<TRange, less_range>::iterator it = _RangeSet.find(rng);
-		if (it != _RangeSet.end())
+void CRangeSet::Init()
+{
+	if (_Merged) return;
+	sort(_List.begin(), _List.end());
+	// merge in place, -1 for two possible adjacent regions
+	size_t k = 0;
+	for (size_t i=1; i < _List.size(); i++)
+	{
+		TRange &r = _List[k];
+		if ((C_Int64)_List[i].Start - 1 <= r.End)
 		{
-			if ((rng.Start < it->Start) || (rng.End > it->End))
-			{
-				if (rng.Start > it->Start) rng.Start = it->Start;
-				if (rng.End < it->End) rng.End = it->End;
-				_RangeSet.erase(it);
-			} else
-				break;
-		} else {
-			_RangeSet.insert(rng);
-			break;
-		}
-	} while (1);
+			if (_List[i].End > r.End) r.End = _List[i].End;
+		} else
+			_List[++k] = _List[i];
+	}
+	if (!_List.empty()) _List.resize(k + 1);
+	_Merged = true;
 }
 
-bool CRangeSet::IsIncluded(int point)
+int CRangeSet::Find(int point) const
 {
-	TRange rng;
-	rng.Start = rng.End = point;
-	set<TRange, less_range>::iterator it = _RangeSet.find(rng);
-	return it != _RangeSet.end();
+	if (!_Merged)
+		throw ErrSeqArray("CRangeSet::Init() should be called.");
+	// the first range with Start > point
+	size_t lo = 0, hi = _List.size();
+	while (lo < hi)
+	{
+		size_t mid = (lo + hi) / 2;
+		if (_List[mid].Start <= point) lo = mid + 1; else hi = mid;
+	}
+	if ((lo > 0) && (point <= _List[lo-1].End))
+		return lo - 1;
+	return -1;
+}
+
+bool CRangeSet::IsIncluded(int point) const
+{
+	return Find(point) >= 0;
+}
+
+void CRangeSet::Select(const C_Int32 *pos, size_t n, bool sorted,
+	C_BOOL *sel, C_Int32 *id, int id_base) const
+{
+	if (!_Merged)
+		throw ErrSeqArray("CRangeSet::Init() should be called.");
+	if (sorted)
+	{
+		// merge-join, O(n + k)
+		const TRange *r = _List.empty() ? NULL : &_List[0];
+		const TRange *r_end = r + _List.size();
+		for (size_t i=0; (i < n) && (r < r_end); i++)
+		{
+			const C_Int32 p = pos[i];
+			while ((r < r_end) && (r->End < p)) r ++;
+			if ((r < r_end) && (r->Start <= p))
+			{
+				sel[i] = TRUE;
+				if (id) id[i] = (r - &_List[0]) + id_base;
+			}
+		}
+	} else {
+		// O(n log k)
+		for (size_t i=0; i < n; i++)
+		{
+			int k = Find(pos[i]);
+			if (k >= 0)
+			{
+				sel[i] = TRUE;
+				if (id) id[i] = k + id_base;
+			}
+		}
+	}
 }
 
 
@@ -481,10 +606,18 @@ bool CRangeSet::IsIncluded(int point)
 static const char *ERR_DIM = "Invalid dimension of '%s'.";
 static const char *ERR_FILE_ROOT = "CFileInfo::FileRoot should be initialized.";
 
+/// the counter of opened files, increased under GDSFile_ID_Mutex
+static C_Int64 FileInfo_Generation = 0;
+
 CFileInfo::CFileInfo(PdGDSFolder root)
 {
 	_Root = NULL;
+	_Generation = 0;
 	_SampleNum = _VariantNum = 0;
+	_CacheGDSSize = _CacheGDSMTime = 0;
+	_CacheModified = false;
+	_PosSorted = -1;
+	_MainSelVer = 0;
 	ResetRoot(root);
 }
 
@@ -500,9 +633,18 @@ void CFileInfo::ResetRoot(PdGDSFolder root)
 	{
 		// initialize
 		_Root = root;
-		SelList.clear();
+		_Generation = ++FileInfo_Generation;
+		_SelList.clear();
+		_MainSel = TSelection();
+		_MainSelVer = 0;
+		_SelVer.clear();
 		_Chrom.Clear();
 		_Position.clear();
+		_PosSorted = -1;
+		_NumAllele.clear();
+		_CacheFN.clear();
+		_CacheModified = false;
+		_SampCacheFN.clear();
 
 		// sample.id
 		PdAbstractArray Node = GDS_Node_Path(root, "sample.id", TRUE);
@@ -533,14 +675,65 @@ void CFileInfo::ResetRoot(PdGDSFolder root)
 	}
 }
 
+list<TSelection> &CFileInfo::SelList()
+{
+	CSeqLock lock(_Mutex);
+	int tid = jl_threadid();
+	list<TSelection> &sl = _SelList[tid];
+	if (sl.empty() && (tid != 0))
+	{
+		// a new thread starts from the published selection of the main thread
+		if (_MainSelVer > 0)
+			sl.push_back(_MainSel);
+		_SelVer[tid] = _MainSelVer;
+	}
+	return sl;
+}
+
+void CFileInfo::PublishSelection()
+{
+	if (jl_threadid() != 0) return;
+	// copy in the main thread, the only thread changing its selection
+	TSelection &s = Selection();
+	TSelection t;
+	t.PackedSample.Pack(s.pSample(), s.Sample.size());
+	t.PackedVariant.Pack(s.pVariant(), s.Variant.size());
+	t.SampleSelCnt = s.SampleSelCnt;
+	t.VariantSelCnt = s.VariantSelCnt;
+	CSeqLock lock(_Mutex);
+	_MainSel = t;
+	_MainSelVer ++;
+}
+
+void CFileInfo::SyncSelection()
+{
+	const int tid = jl_threadid();
+	if (tid == 0) return;
+	CSeqLock lock(_Mutex);
+	map<int, list<TSelection> >::iterator it = _SelList.find(tid);
+	if (it == _SelList.end()) return;  // seeded in SelList()
+	// keep the selections pushed by the thread itself
+	if (it->second.size() > 1) return;
+	int &ver = _SelVer[tid];
+	if (ver != _MainSelVer)
+	{
+		it->second.clear();
+		if (_MainSelVer > 0)
+			it->second.push_back(_MainSel);
+		ver = _MainSelVer;
+	}
+}
+
 TSelection &CFileInfo::Selection()
 {
 	if (!_Root)
 		throw ErrSeqArray(ERR_FILE_ROOT);
-	if (SelList.empty())
-		SelList.push_back(TSelection());
+	list<TSelection> &sl = SelList();
+	if (sl.empty())
+		sl.push_back(TSelection());
 
-	TSelection &s = SelList.back();
+	TSelection &s = sl.back();
+	s.Unpack();
 	if (s.Sample.empty())
 		s.Sample.resize(_SampleNum, TRUE);
 	if (s.Variant.empty())
@@ -553,8 +746,12 @@ CChromIndex &CFileInfo::Chromosome()
 {
 	if (!_Root)
 		throw ErrSeqArray(ERR_FILE_ROOT);
+	CSeqLock lock(_Mutex);
 	if (_Chrom.Empty())
+	{
 		_Chrom.AddChrom(_Root);
+		_CacheModified = true;
+	}
 	return _Chrom;
 }
 
@@ -562,6 +759,7 @@ vector<C_Int32> &CFileInfo::Position()
 {
 	if (!_Root)
 		throw ErrSeqArray(ERR_FILE_ROOT);
+	CSeqLock lock(_Mutex);
 	if (_Position.empty())
 	{
 		PdAbstractArray N = GetObj("position", TRUE);
@@ -572,22 +770,78 @@ vector<C_Int32> &CFileInfo::Position()
 		// read
 		_Position.resize(_VariantNum);
 		GDS_Array_ReadData(N, NULL, NULL, &_Position[0], svInt32);
+		_CacheModified = true;
 	}
 	return _Position;
 }
 
+bool CFileInfo::PositionSorted()
+{
+	CSeqLock lock(_Mutex);
+	if (_PosSorted < 0)
+	{
+		CChromIndex &Chrom = Chromosome();
+		vector<C_Int32> &Pos = Position();
+		const C_Int32 *pos = Pos.empty() ? NULL : &Pos[0];
+		// check each run of chromosome
+		_PosSorted = 1;
+		const vector<C_UInt32> &Lens = Chrom.RunLengths();
+		for (size_t i=0; (i < Lens.size()) && _PosSorted; i++)
+		{
+			for (C_UInt32 n=Lens[i]; n > 1; n--, pos++)
+				if (pos[0] > pos[1]) { _PosSorted = 0; break; }
+			pos ++;
+		}
+	}
+	return (_PosSorted > 0);
+}
+
+vector<C_Int32> &CFileInfo::NumAllele()
+{
+	if (!_Root)
+		throw ErrSeqArray(ERR_FILE_ROOT);
+	CSeqLock lock(_Mutex);
+	if (_NumAllele.empty() && (_VariantNum > 0))
+	{
+		PdAbstractArray N = GetObj("allele", TRUE);
+		// check
+		if ((GDS_Array_DimCnt(N) != 1) ||
+				(GDS_Array_GetTotalCount(N) != _VariantNum))
+			throw ErrSeqArray(ERR_DIM, "allele");
+		// read in large sequential chunks
+		const C_Int32 NMAX = 4096;
+		vector<string> buf(NMAX);
+		vector<C_Int32> num(_VariantNum);
+		for (C_Int32 st=0; st < _VariantNum; )
+		{
+			C_Int32 len = _VariantNum - st;
+			if (len > NMAX) len = NMAX;
+			GDS_Array_ReadData(N, &st, &len, &buf[0], svStrUTF8);
+			for (C_Int32 i=0; i < len; i++)
+				num[st + i] = GetNumOfAllele(buf[i].c_str());
+			st += len;
+		}
+		_NumAllele.swap(num);
+		_CacheModified = true;
+	}
+	return _NumAllele;
+}
+
 CGenoIndex &CFileInfo::GenoIndex()
 {
+	CSeqLock lock(_Mutex);
 	if (_GenoIndex.Empty())
 	{
 		PdAbstractArray I = GetObj("genotype/@data", TRUE);
 		_GenoIndex.Init(I);
+		_CacheModified = true;
 	}
 	return _GenoIndex;
 }
 
 CIndex &CFileInfo::VarIndex(const string &varname)
 {
+	CSeqLock lock(_Mutex);
 	CIndex &I = _VarIndex[varname];
 	if (I.Empty())
 	{
@@ -596,6 +850,7 @@ CIndex &CFileInfo::VarIndex(const string &varname)
 			I.InitOne(_VariantNum);
 		else
 			I.Init(N);
+		_CacheModified = true;
 	}
 	return I;
 }
@@ -610,13 +865,508 @@ PdAbstractArray CFileInfo::GetObj(const char *name, C_BOOL MustExist)
 int CFileInfo::SampleSelNum()
 {
 	TSelection &sel = Selection();
-	return vec_i8_cnt_nonzero((C_Int8*)&sel.Sample[0], _SampleNum);
+	if (sel.SampleSelCnt < 0)
+		sel.SampleSelCnt = vec_i8_cnt_nonzero((C_Int8*)sel.pSample(), _SampleNum);
+	return sel.SampleSelCnt;
 }
 
 int CFileInfo::VariantSelNum()
 {
 	TSelection &sel = Selection();
-	return vec_i8_cnt_nonzero((C_Int8*)&sel.Variant[0], _VariantNum);
+	if (sel.VariantSelCnt < 0)
+		sel.VariantSelCnt = vec_i8_cnt_nonzero((C_Int8*)sel.pVariant(), _VariantNum);
+	return sel.VariantSelCnt;
+}
+
+
+
+// ===========================================================
+// Index cache file
+// ===========================================================
+
+static const char INDEX_CACHE_MAGIC[8] = { 'J','S','E','Q','I','D','X', 0 };
+static const C_UInt32 INDEX_CACHE_VERSION = 1;
+
+/// the header of index cache file
+struct TIndexCacheHeader
+{
+	char Magic[8];        ///< INDEX_CACHE_MAGIC
+	C_UInt32 Version;     ///< INDEX_CACHE_VERSION
+	C_Int32 SampleNum;    ///< the total number of samples
+	C_Int32 VariantNum;   ///< the total number of variants
+	C_UInt32 NumSection;  ///< the number of sections
+	C_Int64 GDSSize;      ///< the size of GDS file
+	C_Int64 GDSMTime;     ///< the last modification time of GDS file
+};
+
+/// the header of a section in index cache file, followed by the name
+/// and 8-byte aligned arrays
+struct TIndexCacheSection
+{
+	char Tag[4];        ///< "PATH", "GENO", "POS_", "CHRM", "NALE" or "VIDX"
+	C_UInt32 NameLen;   ///< the length of section name
+	C_Int64 Count;      ///< the number of elements
+};
+
+static const char *ERR_CACHE_WRITE = "Fails to write the index cache file.";
+static const char *ERR_CACHE_READ = "Invalid index cache file.";
+
+/// write a buffer to file with 8-byte alignment
+static void cache_write(FILE *f, const void *buf, size_t size)
+{
+	static const char zero[8] = { 0 };
+	if ((size > 0) && (fwrite(buf, 1, size, f) != size))
+		throw ErrSeqArray(ERR_CACHE_WRITE);
+	size_t r = size & 0x07;
+	if (r && (fwrite(zero, 1, 8-r, f) != 8-r))
+		throw ErrSeqArray(ERR_CACHE_WRITE);
+}
+
+/// read a buffer from file with 8-byte alignment
+static void cache_read(FILE *f, void *buf, size_t size)
+{
+	char zero[8];
+	if ((size > 0) && (fread(buf, 1, size, f) != size))
+		throw ErrSeqArray(ERR_CACHE_READ);
+	size_t r = size & 0x07;
+	if (r && (fread(zero, 1, 8-r, f) != 8-r))
+		throw ErrSeqArray(ERR_CACHE_READ);
+}
+
+static void cache_write_section(FILE *f, const char tag[], const string &name,
+	C_Int64 count)
+{
+	TIndexCacheSection S;
+	memcpy(S.Tag, tag, sizeof(S.Tag));
+	S.NameLen = name.size();
+	S.Count = count;
+	cache_write(f, &S, sizeof(S));
+	cache_write(f, name.c_str(), name.size());
+}
+
+template<typename TYPE>
+	static void cache_write_array(FILE *f, const vector<TYPE> &v)
+{
+	cache_write(f, v.empty() ? NULL : &v[0], sizeof(TYPE)*v.size());
+}
+
+/// the number of bytes from the current position to the end of file
+static C_Int64 cache_remaining(FILE *f, C_Int64 file_size)
+{
+	long p = ftell(f);
+	if (p < 0)
+		throw ErrSeqArray(ERR_CACHE_READ);
+	return file_size - p;
+}
+
+template<typename TYPE>
+	static void cache_read_array(FILE *f, vector<TYPE> &v, C_Int64 count,
+		C_Int64 file_size)
+{
+	// a corrupt count should not allocate more than the file has
+	if ((count < 0) ||
+			(count > cache_remaining(f, file_size) / (C_Int64)sizeof(TYPE)))
+		throw ErrSeqArray(ERR_CACHE_READ);
+	v.resize(count);
+	cache_read(f, v.empty() ? NULL : &v[0], sizeof(TYPE)*v.size());
+}
+
+
+/// the sum of run lengths
+static C_Int64 cache_total(const vector<C_UInt32> &len)
+{
+	C_Int64 n = 0;
+	for (size_t i=0; i < len.size(); i++) n += len[i];
+	return n;
+}
+
+
+void CFileInfo::_SetGDSStat(const char *gds_fn)
+{
+	struct stat st;
+	if (stat(gds_fn, &st) != 0)
+		throw ErrSeqArray("Fails to get the status of '%s'.", gds_fn);
+	_CacheGDSFN = gds_fn;
+	_CacheGDSSize = st.st_size;
+	_CacheGDSMTime = st.st_mtime;
+}
+
+
+bool CFileInfo::_LoadIndexFile(const string &fn, bool sel)
+{
+	FILE *f = fopen(fn.c_str(), "rb");
+	if (!f) return false;
+
+	CGenoIndex geno;
+	vector<C_Int32> pos, nallele;
+	vector<string> chr;
+	vector<C_UInt32> chr_len;
+	map<string, CIndex> var_idx;
+	CSelBits ssel, vsel;
+	bool valid = false;
+
+	try {
+		C_Int64 fsize = -1;
+		if (fseek(f, 0, SEEK_END) == 0)
+		{
+			fsize = ftell(f);
+			rewind(f);
+		}
+		if (fsize < 0)
+			throw ErrSeqArray(ERR_CACHE_READ);
+
+		TIndexCacheHeader H;
+		cache_read(f, &H, sizeof(H));
+		if ((memcmp(H.Magic, INDEX_CACHE_MAGIC, sizeof(H.Magic)) != 0) ||
+			(H.Version != INDEX_CACHE_VERSION) ||
+			(H.SampleNum != _SampleNum) || (H.VariantNum != _VariantNum) ||
+			(H.GDSSize != _CacheGDSSize) || (H.GDSMTime != _CacheGDSMTime))
+		{
+			throw ErrSeqArray(ERR_CACHE_READ);
+		}
+
+		for (C_UInt32 k=0; k < H.NumSection; k++)
+		{
+			TIndexCacheSection S;
+			cache_read(f, &S, sizeof(S));
+			if ((C_Int64)S.NameLen > cache_remaining(f, fsize))
+				throw ErrSeqArray(ERR_CACHE_READ);
+			string name(S.NameLen, 0);
+			cache_read(f, name.empty() ? NULL : &name[0], S.NameLen);
+
+			if (memcmp(S.Tag, "PATH", 4) == 0)
+			{
+				vector<char> buf;
+				cache_read_array(f, buf, S.Count, fsize);
+				if (string(buf.begin(), buf.end()) != _CacheGDSFN)
+					throw ErrSeqArray(ERR_CACHE_READ);
+			} else if (memcmp(S.Tag, "GENO", 4) == 0)
+			{
+				cache_read_array(f, geno.Values, S.Count, fsize);
+				cache_read_array(f, geno.Lengths, S.Count, fsize);
+				if (cache_total(geno.Lengths) != _VariantNum)
+					throw ErrSeqArray(ERR_CACHE_READ);
+				geno.InitRLE();
+			} else if (memcmp(S.Tag, "POS_", 4) == 0)
+			{
+				if (S.Count != _VariantNum)
+					throw ErrSeqArray(ERR_CACHE_READ);
+				cache_read_array(f, pos, S.Count, fsize);
+			} else if (memcmp(S.Tag, "NALE", 4) == 0)
+			{
+				if (S.Count != _VariantNum)
+					throw ErrSeqArray(ERR_CACHE_READ);
+				cache_read_array(f, nallele, S.Count, fsize);
+			} else if (memcmp(S.Tag, "CHRM", 4) == 0)
+			{
+				cache_read_array(f, chr_len, S.Count, fsize);
+				if (cache_total(chr_len) != _VariantNum)
+					throw ErrSeqArray(ERR_CACHE_READ);
+				vector<C_UInt32> str_len;
+				cache_read_array(f, str_len, S.Count, fsize);
+				C_Int64 n = 0;
+				for (size_t i=0; i < str_len.size(); i++) n += str_len[i];
+				vector<char> buf;
+				cache_read_array(f, buf, n, fsize);
+				const char *p = buf.empty() ? NULL : &buf[0];
+				chr.resize(S.Count);
+				for (size_t i=0; i < str_len.size(); i++)
+				{
+					chr[i].assign(p, str_len[i]);
+					p += str_len[i];
+				}
+			} else if (memcmp(S.Tag, "VIDX", 4) == 0)
+			{
+				CIndex &I = var_idx[name];
+				cache_read_array(f, I.Values, S.Count, fsize);
+				cache_read_array(f, I.Lengths, S.Count, fsize);
+				if (cache_total(I.Lengths) != _VariantNum)
+					throw ErrSeqArray(ERR_CACHE_READ);
+				I.InitRLE();
+			} else if ((memcmp(S.Tag, "SSEL", 4) == 0) ||
+				(memcmp(S.Tag, "VSEL", 4) == 0))
+			{
+				bool is_samp = (S.Tag[0] == 'S');
+				if (S.Count != (is_samp ? _SampleNum : _VariantNum))
+					throw ErrSeqArray(ERR_CACHE_READ);
+				vector<C_UInt64> bits;
+				cache_read_array(f, bits, (S.Count + 63) >> 6, fsize);
+				(is_samp ? ssel : vsel).SetBits(bits, S.Count);
+			} else
+				throw ErrSeqArray(ERR_CACHE_READ);
+		}
+		valid = true;
+	}
+	catch (ErrSeqArray &E) { }
+	catch (std::exception &E) { }
+	fclose(f);
+
+	if (!valid) return false;
+	if (sel && (ssel.Empty() || vsel.Empty())) return false;
+
+	// use the indexing objects which have not been created
+	CSeqLock lock(_Mutex);
+	if (_GenoIndex.Empty() && !geno.Empty())
+		_GenoIndex = geno;
+	if (_Position.empty() && !pos.empty())
+		_Position.swap(pos);
+	if (_NumAllele.empty() && !nallele.empty())
+		_NumAllele.swap(nallele);
+	if (_Chrom.Empty() && !chr.empty())
+	{
+		int start = 0;
+		for (size_t i=0; i < chr.size(); i++)
+		{
+			_Chrom.AddRun(chr[i], start, chr_len[i]);
+			start += chr_len[i];
+		}
+		_Chrom.Init();
+	}
+	map<string, CIndex>::iterator it;
+	for (it=var_idx.begin(); it != var_idx.end(); it++)
+	{
+		CIndex &I = _VarIndex[it->first];
+		if (I.Empty()) I = it->second;
+	}
+
+	// the selection of samples and variants
+	if (sel)
+	{
+		TSelection &s = Selection();
+		ssel.Unpack(&s.Sample[0]);
+		vsel.Unpack(&s.Variant[0]);
+		s.ClearSampleCount();
+		s.ClearVariantCount();
+	}
+	return true;
+}
+
+
+bool CFileInfo::_SaveIndexFile(const string &fn, bool sel)
+{
+	// write to a temporary file, and then rename it
+	char pid[64];
+	snprintf(pid, sizeof(pid), ".%d.tmp", (int)getpid());
+	string tmp_fn = fn + pid;
+	FILE *f = fopen(tmp_fn.c_str(), "wb");
+	if (!f) return false;  // e.g., the directory is read-only
+
+	bool succeed = false;
+	try {
+		CSeqLock lock(_Mutex);
+		TIndexCacheHeader H;
+		memset(&H, 0, sizeof(H));
+		memcpy(H.Magic, INDEX_CACHE_MAGIC, sizeof(H.Magic));
+		H.Version = INDEX_CACHE_VERSION;
+		H.SampleNum = _SampleNum;
+		H.VariantNum = _VariantNum;
+		H.NumSection = 1 + (_GenoIndex.Empty() ? 0 : 1) +
+			(_Position.empty() ? 0 : 1) + (_Chrom.Empty() ? 0 : 1) +
+			(_NumAllele.empty() ? 0 : 1) + (sel ? 2 : 0);
+		map<string, CIndex>::iterator it;
+		for (it=_VarIndex.begin(); it != _VarIndex.end(); it++)
+			if (!it->second.Empty()) H.NumSection ++;
+		H.GDSSize = _CacheGDSSize;
+		H.GDSMTime = _CacheGDSMTime;
+		cache_write(f, &H, sizeof(H));
+
+		cache_write_section(f, "PATH", "", _CacheGDSFN.size());
+		cache_write(f, _CacheGDSFN.c_str(), _CacheGDSFN.size());
+
+		if (!_GenoIndex.Empty())
+		{
+			cache_write_section(f, "GENO", "", _GenoIndex.Values.size());
+			cache_write_array(f, _GenoIndex.Values);
+			cache_write_array(f, _GenoIndex.Lengths);
+		}
+		if (!_Position.empty())
+		{
+			cache_write_section(f, "POS_", "", _Position.size());
+			cache_write_array(f, _Position);
+		}
+		if (!_NumAllele.empty())
+		{
+			cache_write_section(f, "NALE", "", _NumAllele.size());
+			cache_write_array(f, _NumAllele);
+		}
+		if (!_Chrom.Empty())
+		{
+			const vector<string> &chr = _Chrom.RunValues();
+			vector<C_UInt32> str_len(chr.size());
+			string buf;
+			for (size_t i=0; i < chr.size(); i++)
+			{
+				str_len[i] = chr[i].size();
+				buf.append(chr[i]);
+			}
+			cache_write_section(f, "CHRM", "", chr.size());
+			cache_write_array(f, _Chrom.RunLengths());
+			cache_write_array(f, str_len);
+			cache_write(f, buf.c_str(), buf.size());
+		}
+		for (it=_VarIndex.begin(); it != _VarIndex.end(); it++)
+		{
+			CIndex &I = it->second;
+			if (I.Empty()) continue;
+			cache_write_section(f, "VIDX", it->first, I.Values.size());
+			cache_write_array(f, I.Values);
+			cache_write_array(f, I.Lengths);
+		}
+		if (sel)
+		{
+			TSelection &s = Selection();
+			CSelBits bits;
+			bits.Pack(s.pSample(), _SampleNum);
+			cache_write_section(f, "SSEL", "", _SampleNum);
+			cache_write_array(f, bits.Bits());
+			bits.Pack(s.pVariant(), _VariantNum);
+			cache_write_section(f, "VSEL", "", _VariantNum);
+			cache_write_array(f, bits.Bits());
+		}
+		succeed = true;
+	}
+	catch (ErrSeqArray &E) { }
+
+	if (fclose(f) != 0) succeed = false;
+	if (succeed)
+	{
+	#ifdef _WIN32
+		remove(fn.c_str());
+	#endif
+		if (rename(tmp_fn.c_str(), fn.c_str()) != 0)
+			succeed = false;
+	}
+	if (!succeed)
+		remove(tmp_fn.c_str());
+	return succeed;
+}
+
+
+void CFileInfo::IndexCache(const char *gds_fn)
+{
+	if (!_Root)
+		throw ErrSeqArray(ERR_FILE_ROOT);
+	_SetGDSStat(gds_fn);
+	_CacheFN = string(gds_fn) + ".seqidx";
+	// indexing objects have been created before, and need to be saved
+	_CacheModified = !_GenoIndex.Empty() || !_Position.empty() ||
+		!_Chrom.Empty() || !_NumAllele.empty() || !_VarIndex.empty();
+	// an invalid or outdated cache file is ignored, and will be overwritten
+	if (!_LoadIndexFile(_CacheFN, false))
+		_CacheModified = true;
+}
+
+
+void CFileInfo::SaveIndexCache()
+{
+	if (_CacheFN.empty() || !_CacheModified) return;
+	if (_SaveIndexFile(_CacheFN, false))
+		_CacheModified = false;
+}
+
+
+void CFileInfo::SaveShared(const char *gds_fn, const char *fn)
+{
+	if (!_Root)
+		throw ErrSeqArray(ERR_FILE_ROOT);
+	_SetGDSStat(gds_fn);
+	// build the indexing objects
+	if (GetObj("genotype/@data", FALSE) != NULL)
+		GenoIndex();
+	Position();
+	Chromosome();
+	if (!_SaveIndexFile(fn, true))
+		throw ErrSeqArray("Fails to write the index file '%s'.", fn);
+}
+
+
+void CFileInfo::LoadShared(const char *gds_fn, const char *fn)
+{
+	if (!_Root)
+		throw ErrSeqArray(ERR_FILE_ROOT);
+	_SetGDSStat(gds_fn);
+	if (!_LoadIndexFile(fn, true))
+		throw ErrSeqArray("Invalid index file '%s'.", fn);
+	PublishSelection();
+}
+
+
+// ===========================================================
+// Selection
+// ===========================================================
+
+CSelBits::CSelBits()
+{
+	_Size = 0;
+}
+
+void CSelBits::Pack(const C_BOOL *p, size_t n)
+{
+	_Bits.resize((n + 63) >> 6);
+	_Size = n;
+	if (n > 0)
+		vec_i8_pack_nonzero(&_Bits[0], (const C_Int8*)p, n);
+}
+
+void CSelBits::Unpack(C_BOOL *p) const
+{
+	if (_Size > 0)
+		vec_i8_unpack_bits((C_Int8*)p, &_Bits[0], _Size);
+}
+
+size_t CSelBits::Count() const
+{
+	size_t ans = 0;
+	for (size_t i=0; i < _Bits.size(); i++)
+		ans += POPCNT_U64(_Bits[i]);
+	return ans;
+}
+
+void CSelBits::SetBits(const vector<C_UInt64> &bits, size_t n)
+{
+	if (bits.size() != ((n + 63) >> 6))
+		throw ErrSeqArray("Invalid length of bits in CSelBits.");
+	_Bits = bits;
+	_Size = n;
+}
+
+void CSelBits::Clear()
+{
+	vector<C_UInt64>().swap(_Bits);
+	_Size = 0;
+}
+
+
+void TSelection::Pack()
+{
+	if (!Sample.empty())
+	{
+		PackedSample.Pack(&Sample[0], Sample.size());
+		if (SampleSelCnt < 0) SampleSelCnt = PackedSample.Count();
+		vector<C_BOOL>().swap(Sample);
+	}
+	if (!Variant.empty())
+	{
+		PackedVariant.Pack(&Variant[0], Variant.size());
+		if (VariantSelCnt < 0) VariantSelCnt = PackedVariant.Count();
+		vector<C_BOOL>().swap(Variant);
+	}
+}
+
+void TSelection::Unpack()
+{
+	if (!PackedSample.Empty())
+	{
+		Sample.resize(PackedSample.Size());
+		PackedSample.Unpack(&Sample[0]);
+		PackedSample.Clear();
+	}
+	if (!PackedVariant.Empty())
+	{
+		Variant.resize(PackedVariant.Size());
+		PackedVariant.Unpack(&Variant[0]);
+		PackedVariant.Clear();
+	}
 }
 
 
@@ -624,6 +1374,8 @@ int CFileInfo::VariantSelNum()
 
 /// File info list
 std::map<int, CFileInfo> COREARRAY_DLL_LOCAL GDSFile_ID_Info;
+/// the mutex of GDSFile_ID_Info
+CSeqMutex COREARRAY_DLL_LOCAL GDSFile_ID_Mutex;
 
 /// get the associated CFileInfo
 COREARRAY_DLL_LOCAL CFileInfo &GetFileInfo(int file_id)
@@ -631,17 +1383,23 @@ COREARRAY_DLL_LOCAL CFileInfo &GetFileInfo(int file_id)
 	if (file_id < 0)
 		throw ErrSeqArray("Invalid gdsfile object.");
 
-	PdGDSFolder root = GDS_ID2FileRoot(file_id);
-	map<int, CFileInfo>::iterator p = GDSFile_ID_Info.find(file_id);
-	if (p == GDSFile_ID_Info.end())
+	map<int, CFileInfo>::iterator p;
 	{
-		GDSFile_ID_Info[file_id].ResetRoot(root);
+		CSeqLock lock(GDSFile_ID_Mutex);
+		PdGDSFolder root = GDS_ID2FileRoot(file_id);
 		p = GDSFile_ID_Info.find(file_id);
-	} else {
-		if (p->second.Root() != root)
-			p->second.ResetRoot(root);
+		if (p == GDSFile_ID_Info.end())
+		{
+			GDSFile_ID_Info[file_id].ResetRoot(root);
+			p = GDSFile_ID_Info.find(file_id);
+		} else {
+			if (p->second.Root() != root)
+				p->second.ResetRoot(root);
+		}
 	}
 
+	// each call from Julia follows the current filter of the main thread
+	p->second.SyncSelection();
 	return p->second;
 }
 
@@ -688,6 +1446,11 @@ bool CVarApply::Next()
 	return (Position < MarginalSize);
 }
 
+int CVarApply::NumEntry() const
+{
+	return -1;
+}
+
 C_BOOL *CVarApply::NeedTRUEs(size_t size)
 {
 	if (size <= sizeof(ArrayTRUEs))
@@ -896,20 +1659,26 @@ void CProgressStdOut::ShowProgress()
 // Define Functions
 // ===========================================================
 
-// the buffer of ArrayTRUEs
-static vector<C_BOOL> TrueBuffer;
+// the buffer of ArrayTRUEs for each thread
+static JSEQ_THREAD_LOCAL C_BOOL *TrueBuffer = NULL;
+static JSEQ_THREAD_LOCAL size_t TrueBufferSize = 0;
 
 COREARRAY_DLL_LOCAL C_BOOL *NeedArrayTRUEs(size_t len)
 {
 	if (len <= sizeof(ArrayTRUEs))
 		return ArrayTRUEs;
-	else if (len > TrueBuffer.size())
-		TrueBuffer.resize(len, TRUE);
-	return &TrueBuffer[0];
+	else if (len > TrueBufferSize)
+	{
+		C_BOOL *p = (C_BOOL*)realloc(TrueBuffer, len);
+		if (!p) throw ErrSeqArray("Insufficient memory.");
+		memset(p, TRUE, len);
+		TrueBuffer = p; TrueBufferSize = len;
+	}
+	return TrueBuffer;
 }
 
 
-static char pretty_num_buffer[32];
+static JSEQ_THREAD_LOCAL char pretty_num_buffer[32];
 
 /// Get pretty text for an integer with comma
 COREARRAY_DLL_LOCAL const char *PrettyInt(int val)
@@ -1017,6 +1786,30 @@ COREARRAY_DLL_LOCAL void GetAlleles(const char *alleles, vector<string> &out)
 }
 
 
+COREARRAY_DLL_LOCAL C_UInt64 GetVariantKey(int chr_code, C_Int32 pos,
+	const char *allele)
+{
+	// FNV-1a of upper-case alleles, folded to VARKEY_ALLELE_BITS
+	C_UInt32 h = 2166136261U;
+	for (; *allele; allele++)
+	{
+		h ^= (C_UInt8)toupper(*allele);
+		h *= 16777619U;
+	}
+	h = (h >> VARKEY_ALLELE_BITS) ^ (h & ((1U << VARKEY_ALLELE_BITS) - 1));
+	h &= (1U << VARKEY_ALLELE_BITS) - 1;
+
+	const int MaxCode = (1 << VARKEY_CHROM_BITS) - 1;
+	if (chr_code > MaxCode)
+	{
+		throw ErrSeqArray(
+			"Variant keys support at most %d distinct chromosomes.", MaxCode);
+	}
+	if (chr_code < 0) chr_code = 0;
+	return ((C_UInt64)chr_code << (64 - VARKEY_CHROM_BITS)) |
+		((C_UInt64)(pos & 0x7FFFFFFF) << VARKEY_ALLELE_BITS) | h;
+}
+
 /// get PdGDSObj from a SEXP object
 COREARRAY_DLL_LOCAL void GDS_PATH_PREFIX_CHECK(const char *path)
 {
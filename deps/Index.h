@@ -31,12 +31,21 @@
 #include <list>
 #include <map>
 #include <set>
+#include <algorithm>
 #include <ctime>
 
 #include <cctype>
 #include <cstring>
 #include "vectorization.h"
 
+#ifdef _WIN32
+#   include <windows.h>
+#else
+#   include <pthread.h>
+#   include <sched.h>
+#   include <time.h>
+#endif
+
 
 #ifndef TRUE
 #   define TRUE     1
@@ -45,6 +54,13 @@
 #   define FALSE    0
 #endif
 
+/// thread-local storage
+#ifdef _MSC_VER
+#   define JSEQ_THREAD_LOCAL    __declspec(thread)
+#else
+#   define JSEQ_THREAD_LOCAL    __thread
+#endif
+
 
 namespace JSeqArray
 {
@@ -64,6 +80,112 @@ const C_UInt8 NA_UINT8   = 0xFF;
 
 class ErrSeqArray;
 
+// ===========================================================
+// Mutex object
+// ===========================================================
+
+/// recursive mutex, a copy creates a new mutex
+class COREARRAY_DLL_LOCAL CSeqMutex
+{
+public:
+	CSeqMutex() { _Init(); }
+	CSeqMutex(const CSeqMutex &) { _Init(); }
+	~CSeqMutex()
+	{
+	#ifdef _WIN32
+		DeleteCriticalSection(&_Mutex);
+	#else
+		pthread_mutex_destroy(&_Mutex);
+	#endif
+	}
+
+	CSeqMutex &operator= (const CSeqMutex &) { return *this; }
+
+	inline void Lock()
+	{
+	#ifdef _WIN32
+		EnterCriticalSection(&_Mutex);
+	#else
+		pthread_mutex_lock(&_Mutex);
+	#endif
+	}
+	/// lock in a Julia thread, which keeps reaching GC safepoints while
+	/// waiting, since the owner may allocate Julia objects; it yields for
+	/// the first attempts, and then sleeps up to 1ms between attempts
+	inline void LockJL()
+	{
+	#ifdef _WIN32
+		for (int n=0; !TryEnterCriticalSection(&_Mutex); n++)
+		{
+			jl_gc_safepoint();
+			if (n < LOCK_SPIN) SwitchToThread(); else Sleep(1);
+		}
+	#else
+		for (int n=0; pthread_mutex_trylock(&_Mutex) != 0; n++)
+		{
+			jl_gc_safepoint();
+			if (n < LOCK_SPIN)
+				sched_yield();
+			else {
+				// back off from 1us to about 1ms
+				const int k = n - LOCK_SPIN;
+				struct timespec ts;
+				ts.tv_sec = 0;
+				ts.tv_nsec = 1000L << ((k < 10) ? k : 10);
+				nanosleep(&ts, NULL);
+			}
+		}
+	#endif
+	}
+	inline void Unlock()
+	{
+	#ifdef _WIN32
+		LeaveCriticalSection(&_Mutex);
+	#else
+		pthread_mutex_unlock(&_Mutex);
+	#endif
+	}
+
+private:
+	static const int LOCK_SPIN = 16;  ///< the number of yields before sleeping
+
+#ifdef _WIN32
+	CRITICAL_SECTION _Mutex;
+#else
+	pthread_mutex_t _Mutex;
+#endif
+
+	void _Init()
+	{
+	#ifdef _WIN32
+		InitializeCriticalSection(&_Mutex);
+	#else
+		pthread_mutexattr_t attr;
+		pthread_mutexattr_init(&attr);
+		pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+		pthread_mutex_init(&_Mutex, &attr);
+		pthread_mutexattr_destroy(&attr);
+	#endif
+	}
+};
+
+
+/// lock a mutex in the scope, 'julia_thread' should be false in a thread
+/// not created by Julia
+class COREARRAY_DLL_LOCAL CSeqLock
+{
+public:
+	CSeqLock(CSeqMutex &m, bool julia_thread=true): _M(m)
+	{
+		if (julia_thread) _M.LockJL(); else _M.Lock();
+	}
+	~CSeqLock() { _M.Unlock(); }
+private:
+	CSeqMutex &_M;
+};
+
+
+
 // ===========================================================
 // Run-length encoding (RLE) object
 // ===========================================================
@@ -76,7 +198,6 @@ public:
 	C_RLE()
 	{
 		TotalLength = 0;
-		Position = AccIndex = AccOffset = 0;
 	}
 
 	void Init()
@@ -85,10 +206,9 @@ public:
 		vector<C_UInt32>::iterator p;
 		for (p=Lengths.begin(); p != Lengths.end(); p++)
 			TotalLength += *p;
-		Position = AccIndex = AccOffset = 0;
 	}
 
-	void Add(TYPE &val, C_UInt32 len)
+	void Add(const TYPE &val, C_UInt32 len)
 	{
 		Values.push_back(val);
 		Lengths.push_back(len);
@@ -98,31 +218,16 @@ public:
 	{
 		Values.clear(); Lengths.clear();
 		TotalLength = 0;
-		Position = AccIndex = AccOffset = 0;
-	}
-
-	const TYPE &operator [](size_t pos)
-	{
-		if (pos >= TotalLength)
-			throw "Invalid position in C_RLE.";
-		if (pos < Position)
-			Position = AccIndex = AccOffset = 0;
-		for (; Position < pos; )
-		{
-			size_t L = Lengths[AccIndex];
-			size_t n = L - AccOffset;
-			if ((Position + n) <= pos)
-			{
-				AccIndex ++; AccOffset = 0;
-			} else {
-				n = pos - Position; AccOffset += n;
-			}
-			Position += n;
-		}
-		return Values[AccIndex];
 	}
 
 	inline bool Empty() const { return (TotalLength <= 0); }
+	/// total number, = sum(Lengths)
+	inline size_t TotalCount() const { return TotalLength; }
+
+	/// values of runs
+	inline const vector<TYPE> &RunValues() const { return Values; }
+	/// lengths of runs
+	inline const vector<C_UInt32> &RunLengths() const { return Lengths; }
 
 protected:
 	/// values according to Lengths, used in run-length encoding
@@ -131,20 +236,84 @@ protected:
 	vector<C_UInt32> Lengths;
 	/// total number, = sum(Lengths)
 	size_t TotalLength;
-	/// the position relative to the total length
-	size_t Position;
-	/// the index in Lengths according to Position
-	size_t AccIndex;
-	/// the offset according the value of Lengths[AccIndex]
-	size_t AccOffset;
 };
 
 
+// ===========================================================
+// Checkpoints for random access in run-length encoding
+// ===========================================================
+
+/// sparse checkpoints of accumulated lengths and sums in run-length encoding
+class COREARRAY_DLL_LOCAL CRLE_Checkpoint
+{
+public:
+	/// the number of runs between two neighboring checkpoints
+	static const size_t STEP = 32;
+
+	/// build checkpoints from the run-length encoding
+	template<typename TYPE>
+		void Init(const vector<TYPE> &Values, const vector<C_UInt32> &Lengths)
+	{
+		size_t n = (Lengths.size() + STEP - 1) / STEP;
+		CkStart.resize(n);
+		CkSum.resize(n);
+		size_t st = 0;
+		C_Int64 sum = 0;
+		for (size_t i=0; i < Lengths.size(); i++)
+		{
+			if (i % STEP == 0)
+			{
+				CkStart[i / STEP] = st;
+				CkSum[i / STEP] = sum;
+			}
+			st += Lengths[i];
+			sum += (C_Int64)Values[i] * Lengths[i];
+		}
+	}
+
+	/// find the run containing 'pos' by binary search, 'pos' should be valid
+	template<typename TYPE>
+		void Find(const vector<TYPE> &Values, const vector<C_UInt32> &Lengths,
+			size_t pos, size_t &OutIndex, size_t &OutStart, C_Int64 &OutSum) const
+	{
+		size_t k = upper_bound(CkStart.begin(), CkStart.end(), pos) -
+			CkStart.begin() - 1;
+		size_t i = k * STEP, st = CkStart[k];
+		C_Int64 sum = CkSum[k];
+		for (; st + Lengths[i] <= pos; i++)
+		{
+			st += Lengths[i];
+			sum += (C_Int64)Values[i] * Lengths[i];
+		}
+		OutIndex = i; OutStart = st; OutSum = sum;
+	}
+
+	/// clear the checkpoints
+	void Clear() { CkStart.clear(); CkSum.clear(); }
+
+protected:
+	vector<size_t> CkStart;  ///< the starting positions of every STEP runs
+	vector<C_Int64> CkSum;   ///< the accumulated sums at the checkpoints
+};
+
+
+
 // ===========================================================
 // Indexing object
 // ===========================================================
 
-/// Indexing object with run-length encoding
+/// the cursor of sequential access to an indexing object, owned by the reader
+struct COREARRAY_DLL_LOCAL TRunCursor
+{
+	size_t AccIndex;  ///< the index in Lengths according to the last position
+	size_t AccStart;  ///< the starting position of the run Lengths[AccIndex]
+	C_Int64 AccSum;   ///< the accumulated sum of values before AccStart
+
+	TRunCursor() { AccIndex = AccStart = 0; AccSum = 0; }
+};
+
+
+/// Indexing object with run-length encoding, immutable after initialization
 class COREARRAY_DLL_LOCAL CIndex
 {
 public:
@@ -160,31 +329,33 @@ public:
 	void Init(PdContainer Obj);
 	/// load data and represent as run-length encoding
 	void InitOne(int num);
+	/// initialize after Values and Lengths are assigned
+	void InitRLE();
 	/// return the accumulated sum of values and current value in Lengths and Values given by a position
-	void GetInfo(size_t pos, C_Int64 &Sum, int &Value);
+	void GetInfo(size_t pos, C_Int64 &Sum, int &Value, TRunCursor &Cur) const;
 	/// get lengths with selection
 	jl_array_t* GetLen_Sel(const C_BOOL sel[]);
 	/// get lengths and bool selection from a set of selected variants
 	jl_array_t* GetLen_Sel(const C_BOOL sel[], int &out_var_start, int &out_var_count,
 		vector<C_BOOL> &out_var_sel);
+	/// get bool selection and lengths (if out_len is not NULL) without allocation
+	void GetSel(const C_BOOL sel[], int &out_var_start, int &out_var_count,
+		vector<C_BOOL> &out_var_sel, int *out_len);
 	/// return true if empty
 	inline bool Empty() const { return (TotalLength <= 0); }
 
 protected:
 	/// total number, = sum(Lengths)
 	size_t TotalLength;
-	/// the position relative to the total length
-	size_t Position;
-	/// the accumulated sum of values in Lengths and Values according to Position
-	C_Int64 AccSum;
-	/// the index in Lengths according to Position
-	size_t AccIndex;
-	/// the offset according the value of Lengths[AccIndex]
-	size_t AccOffset;
+	/// checkpoints for random access
+	CRLE_Checkpoint Checkpoint;
+
+	inline void LocateRun(size_t pos, TRunCursor &Cur) const;
 };
 
 
-/// Indexing object with run-length encoding for genotype indexing
+/// Indexing object with run-length encoding for genotype indexing,
+/// immutable after initialization
 class COREARRAY_DLL_LOCAL CGenoIndex
 {
 public:
@@ -198,22 +369,20 @@ public:
 
 	/// load data and represent as run-length encoding
 	void Init(PdContainer Obj);
+	/// initialize after Values and Lengths are assigned
+	void InitRLE();
 	/// return the accumulated sum of values and current value in Lengths and Values given by a position
-	void GetInfo(size_t pos, C_Int64 &Sum, C_UInt8 &Value);
+	void GetInfo(size_t pos, C_Int64 &Sum, C_UInt8 &Value, TRunCursor &Cur) const;
 	/// return true if empty
 	inline bool Empty() const { return (TotalLength <= 0); }
 
 protected:
 	/// total number, = sum(Lengths)
 	size_t TotalLength;
-	/// the position relative to the total length
-	size_t Position;
-	/// the accumulated sum of values in Lengths and Values according to Position
-	C_Int64 AccSum;
-	/// the index in Lengths according to Position
-	size_t AccIndex;
-	/// the offset according the value of Lengths[AccIndex]
-	size_t AccOffset;
+	/// checkpoints for random access
+	CRLE_Checkpoint Checkpoint;
+
+	inline void LocateRun(size_t pos, TRunCursor &Cur) const;
 };
 
 
@@ -243,6 +412,27 @@ public:
 
 	/// represent chromosome codes as a RLE object in Map
 	void AddChrom(PdGDSFolder Root);
+	/// append a run of chromosome, followed by Init() after the last run
+	void AddRun(const string &chr, int start, int len);
+	/// finalize after calling AddRun()
+	void Init();
+
+	/// chromosome codes of runs
+	inline const vector<string> &RunValues() const
+		{ return PosToChr.RunValues(); }
+	/// lengths of runs
+	inline const vector<C_UInt32> &RunLengths() const
+		{ return PosToChr.RunLengths(); }
+
+	/// chromosome codes of runs, starting from 1
+	inline const vector<C_Int32> &RunCodes() const { return _RunCodes; }
+	/// the symbol table of chromosomes, the i-th string for the code i+1
+	inline const vector<string> &CodeTable() const { return _CodeTable; }
+	/// return the code of a chromosome, or 0 if not found
+	int Code(const string &chr) const;
+	/// get the chromosome codes of 'cnt' selected variants starting from
+	/// the variant 'st', 'sel' is the variant selection
+	void GetCodes(const C_BOOL *sel, size_t st, size_t cnt, C_Int32 *out) const;
 
 	/// the total length of a TRangeList object
 	size_t RangeTotalLength(const TRangeList &RngList);
@@ -250,7 +440,8 @@ public:
 	/// whether it is empty
 	inline bool Empty() const { return Map.empty(); }
 
-	inline const string &operator [](size_t pos) { return PosToChr[pos]; }
+	/// return the index of the run containing the variant 'pos'
+	size_t RunIndex(size_t pos) const;
 
 	/// map to TRangeList from chromosome coding
 	map<string, TRangeList> Map;
@@ -258,6 +449,14 @@ public:
 protected:
 	/// position to chromosome
 	C_RLE<string> PosToChr;
+	/// chromosome codes of runs
+	vector<C_Int32> _RunCodes;
+	/// the starting positions of runs
+	vector<size_t> _RunStarts;
+	/// the symbol table of chromosomes
+	vector<string> _CodeTable;
+	/// chromosome to code
+	map<string, int> _CodeMap;
 };
 
 
@@ -266,7 +465,8 @@ protected:
 // Genomic Range Sets
 // ===========================================================
 
-/// Genomic Range Set Object
+/// Genomic Range Set Object, a flat array of non-overlapping ranges sorted
+/// by position
 class COREARRAY_DLL_LOCAL CRangeSet
 {
 public:
@@ -275,21 +475,35 @@ public:
 	{
 		int Start;     ///< the starting position
 		int End;       ///< the ending (always, End >= Start)
+
+		inline bool operator< (const TRange &rhs) const
+			{ return (Start < rhs.Start) || ((Start == rhs.Start) && (End < rhs.End)); }
 	};
 
+	/// constructor
+	CRangeSet();
+
 	void Clear();
+	/// add a range, followed by Init() after the last range
 	void AddRange(int start, int end);
-	bool IsIncluded(int point);
+	/// sort and merge overlapping or adjacent ranges
+	void Init();
+	/// whether a point is in any range, O(log k)
+	bool IsIncluded(int point) const;
+	/// return the index of range containing a point, or -1 if not found
+	int Find(int point) const;
+	/// set 'sel' to TRUE (and 'id' to the index of range + 'id_base' if
+	/// 'id' is not NULL) for the positions in ranges, by merge-join if the
+	/// positions are sorted, otherwise by binary search for each position
+	void Select(const C_Int32 *pos, size_t n, bool sorted, C_BOOL *sel,
+		C_Int32 *id, int id_base) const;
+
+	/// the sorted ranges after Init()
+	inline const vector<TRange> &Ranges() const { return _List; }
 
 protected:
-	/// strict weak ordering for non-overlapping, == when overlapping
-	struct less_range
-	{
-    	bool operator()(const TRange &lhs, const TRange &rhs) const;
-	};
-
-	/// 
-	set<TRange, less_range> _RangeSet;
+	vector<TRange> _List;  ///< the list of ranges
+	bool _Merged;          ///< whether _List is sorted and merged
 };
 
 
@@ -300,25 +514,75 @@ protected:
 // SeqArray GDS file information
 // ===========================================================
 
+/// packed bit array of selection, one bit per sample or variant
+class COREARRAY_DLL_LOCAL CSelBits
+{
+public:
+	/// constructor
+	CSelBits();
+
+	/// pack a logical array
+	void Pack(const C_BOOL *p, size_t n);
+	/// unpack to a logical array with Size() elements
+	void Unpack(C_BOOL *p) const;
+	/// return the number of set bits
+	size_t Count() const;
+	/// assign packed bits with n elements
+	void SetBits(const vector<C_UInt64> &bits, size_t n);
+	/// release memory
+	void Clear();
+
+	/// get the i-th bit
+	inline bool Get(size_t i) const
+		{ return (_Bits[i >> 6] >> (i & 0x3F)) & 0x01; }
+	/// return the number of elements
+	inline size_t Size() const { return _Size; }
+	/// return true if no element
+	inline bool Empty() const { return _Size == 0; }
+	/// packed bits
+	inline const vector<C_UInt64> &Bits() const { return _Bits; }
+
+private:
+	vector<C_UInt64> _Bits;
+	size_t _Size;
+};
+
+
 /// selection object used in GDS file
 struct COREARRAY_DLL_LOCAL TSelection
 {
 	vector<C_BOOL> Sample;   ///< sample selection
 	vector<C_BOOL> Variant;  ///< variant selection
+	CSelBits PackedSample;   ///< packed sample selection when not in use
+	CSelBits PackedVariant;  ///< packed variant selection when not in use
+	int SampleSelCnt;   ///< the number of selected samples, -1 if unknown
+	int VariantSelCnt;  ///< the number of selected variants, -1 if unknown
+
+	TSelection() { SampleSelCnt = VariantSelCnt = -1; }
 
 	inline C_BOOL *pSample()
 		{ return Sample.empty() ? NULL : &Sample[0]; }
 	inline C_BOOL *pVariant()
 		{ return Variant.empty() ? NULL : &Variant[0]; }
+
+	/// invalidate the cached number of selected samples
+	inline void ClearSampleCount() { SampleSelCnt = -1; }
+	/// invalidate the cached number of selected variants
+	inline void ClearVariantCount() { VariantSelCnt = -1; }
+
+	/// pack the logical arrays to bits and release them
+	void Pack();
+	/// restore the logical arrays from bits
+	void Unpack();
 };
 
 
-/// GDS file object
+/// GDS file object, the indexing objects are created once under the lock,
+/// and each Julia thread has its own stack of selections; the other threads
+/// start from the selection published by the main thread
 class COREARRAY_DLL_LOCAL CFileInfo
 {
 public:
-	list<TSelection> SelList;  ///< a list of sample and variant selections
-
 	/// constructor
 	CFileInfo(PdGDSFolder root=NULL);
 	/// destructor
@@ -326,13 +590,27 @@ public:
 
 	/// reset the root of GDS file
 	void ResetRoot(PdGDSFolder root);
+	/// get the list of sample and variant selections of the current thread
+	list<TSelection> &SelList();
 	/// get selection
 	TSelection &Selection();
+	/// publish the current selection of the main thread to other threads,
+	/// called after the main thread changes its selection
+	void PublishSelection();
+	/// restart the selection of a non-main thread from the published one if
+	/// it has been changed and the thread has not pushed its own selection
+	void SyncSelection();
+	/// the mutex for lazy initialization and reading the GDS file
+	inline CSeqMutex &Mutex() { return _Mutex; }
 
 	/// return _Chrom which has been initialized
 	CChromIndex &Chromosome();
 	/// return _Position which has been initialized
 	vector<C_Int32> &Position();
+	/// whether positions are non-decreasing within each run of chromosome
+	bool PositionSorted();
+	/// return _NumAllele which has been initialized
+	vector<C_Int32> &NumAllele();
 
 	/// return _GenoIndex which has been initialized
 	CGenoIndex &GenoIndex();
@@ -345,6 +623,8 @@ public:
 
 	/// the root of gds file
 	inline PdGDSFolder Root() { return _Root; }
+	/// the number identifying the opened file, changed if the root is reset
+	inline C_Int64 Generation() const { return _Generation; }
 	/// the total number of samples
 	inline int SampleNum() const { return _SampleNum; }
 	/// the total number of variants
@@ -355,20 +635,60 @@ public:
 	int SampleSelNum();
 	int VariantSelNum();
 
+	/// use the index cache file associated with the GDS file, and load indexing objects from it if valid
+	void IndexCache(const char *gds_fn);
+	/// save indexing objects to the cache file if any of them is created after loading
+	void SaveIndexCache();
+	/// build indexing objects, and save them with the current selection to
+	/// a file which can be loaded by other processes
+	void SaveShared(const char *gds_fn, const char *fn);
+	/// load indexing objects and selection saved by SaveShared()
+	void LoadShared(const char *gds_fn, const char *fn);
+
+	/// the file name of sample-major genotypes, or "" if not used
+	inline const string &SampleCacheFN() const { return _SampCacheFN; }
+	/// use the file of sample-major genotypes, or "" for not using it
+	inline void SetSampleCacheFN(const string &fn) { _SampCacheFN = fn; }
+
 protected:
 	PdGDSFolder _Root;  ///< the root of GDS file
+	C_Int64 _Generation;  ///< the number identifying the opened file
 	int _SampleNum;     ///< the total number of samples
 	int _VariantNum;    ///< the total number of variants
 	int _Ploidy;        ///< ploidy
 
+	string _CacheFN;         ///< the file name of index cache, or "" if not used
+	string _CacheGDSFN;      ///< the GDS file name associated with the index cache
+	C_Int64 _CacheGDSSize;   ///< the size of GDS file
+	C_Int64 _CacheGDSMTime;  ///< the last modification time of GDS file
+	bool _CacheModified;     ///< whether any index is created after loading
+	string _SampCacheFN;     ///< the file name of sample-major genotypes
+
+	CSeqMutex _Mutex;    ///< the mutex of the file
+	map<int, list<TSelection> > _SelList;  ///< selections of each thread
+	TSelection _MainSel;     ///< the published selection of the main thread
+	int _MainSelVer;         ///< the version of _MainSel, 0 if not published
+	map<int, int> _SelVer;   ///< the version of _MainSel used by each thread
+
 	CChromIndex _Chrom;  ///< chromosome indexing
 	vector<C_Int32> _Position;  ///< position
+	int _PosSorted;  ///< whether positions are sorted, -1 for unknown
+	vector<C_Int32> _NumAllele;  ///< the number of alleles per variant
 	CGenoIndex _GenoIndex;  ///< the indexing object for genotypes
 	map<string, CIndex> _VarIndex;  ///< the indexing objects for INFO/FORMAT variables
+
+	/// set the GDS file name, size and modification time for validation
+	void _SetGDSStat(const char *gds_fn);
+	/// load indexing objects (and selection if sel = true) from a file
+	bool _LoadIndexFile(const string &fn, bool sel);
+	/// save indexing objects (and selection if sel = true) to a file
+	bool _SaveIndexFile(const string &fn, bool sel);
 };
 
 
 extern std::map<int, CFileInfo> COREARRAY_DLL_LOCAL GDSFile_ID_Info;
+/// the mutex of GDSFile_ID_Info
+extern CSeqMutex COREARRAY_DLL_LOCAL GDSFile_ID_Mutex;
 
 /// get the associated CFileInfo
 COREARRAY_DLL_LOCAL CFileInfo &GetFileInfo(int file_id);
@@ -423,6 +743,9 @@ public:
 	virtual jl_array_t* NeedArray() = 0;
 	/// read data to R object
 	virtual void ReadData(jl_array_t *val) = 0;
+	/// the number of entries read by the last 'ReadData()' if the length
+	/// varies by variant, or -1 if the array object is always filled
+	virtual int NumEntry() const;
 
 	/// variable type
 	inline TVarType VarType() const { return fVarType; }
@@ -525,6 +848,17 @@ COREARRAY_DLL_LOCAL int GetIndexOfAllele(const char *allele, const char *allele_
 /// Get strings split by comma
 COREARRAY_DLL_LOCAL void GetAlleles(const char *alleles, vector<string> &out);
 
+/// the number of bits of chromosome code in a variant key
+const int VARKEY_CHROM_BITS = 13;
+/// the number of bits of allele hash in a variant key
+const int VARKEY_ALLELE_BITS = 20;
+
+/// Get a 64-bit variant key: chromosome code (13 bits, > 0, an error if too large),
+/// position (31 bits) and the hash of case-insensitive alleles (20 bits),
+/// so that keys are ordered by chromosome code and position
+COREARRAY_DLL_LOCAL C_UInt64 GetVariantKey(int chr_code, C_Int32 pos,
+	const char *allele);
+
 
 /// get PdGDSObj from a SEXP object
 COREARRAY_DLL_LOCAL void GDS_PATH_PREFIX_CHECK(const char *path);
@@ -58,9 +58,42 @@ JL_DLLEXPORT void SEQ_File_Init(int file_id)
 JL_DLLEXPORT void SEQ_File_Done(int file_id)
 {
 	COREARRAY_TRY
+		CSeqLock lock(GDSFile_ID_Mutex);
 		map<int, CFileInfo>::iterator p = GDSFile_ID_Info.find(file_id);
 		if (p != GDSFile_ID_Info.end())
+		{
+			p->second.SaveIndexCache();
 			GDSFile_ID_Info.erase(p);
+		}
+	COREARRAY_CATCH
+}
+
+/// enable the index cache file of a SeqArray file
+JL_DLLEXPORT void SEQ_File_IndexCache(int file_id, const char *gds_fn)
+{
+	COREARRAY_TRY
+		CFileInfo &file = GetFileInfo(file_id);
+		file.IndexCache(gds_fn);
+	COREARRAY_CATCH
+}
+
+/// save the indexing objects and selection to a file shared with workers
+JL_DLLEXPORT void SEQ_File_SaveShared(int file_id, const char *gds_fn,
+	const char *fn)
+{
+	COREARRAY_TRY
+		CFileInfo &file = GetFileInfo(file_id);
+		file.SaveShared(gds_fn, fn);
+	COREARRAY_CATCH
+}
+
+/// load the indexing objects and selection from a file saved by the master
+JL_DLLEXPORT void SEQ_File_LoadShared(int file_id, const char *gds_fn,
+	const char *fn)
+{
+	COREARRAY_TRY
+		CFileInfo &file = GetFileInfo(file_id);
+		file.LoadShared(gds_fn, fn);
 	COREARRAY_CATCH
 }
 
@@ -104,13 +137,19 @@ JL_DLLEXPORT void SEQ_ProgressDone(void *ptr)
 JL_DLLEXPORT void SEQ_FilterPush(int file_id, C_BOOL new_flag)
 {
 	COREARRAY_TRY
+		CSeqLock lock(GDSFile_ID_Mutex);
 		map<int, CFileInfo>::iterator it = GDSFile_ID_Info.find(file_id);
 		if (it != GDSFile_ID_Info.end())
 		{
-			if (new_flag || it->second.SelList.empty())
-				it->second.SelList.push_back(TSelection());
+			list<TSelection> &sl = it->second.SelList();
+			if (new_flag || sl.empty())
+				sl.push_back(TSelection());
 			else
-				it->second.SelList.push_back(it->second.SelList.back());
+				sl.push_back(sl.back());
+			// the previous selection is not in use until popping up
+			if (sl.size() > 1)
+				(++sl.rbegin())->Pack();
+			it->second.PublishSelection();
 		} else
 			throw ErrSeqArray("The GDS file is closed or invalid.");
 	COREARRAY_CATCH
@@ -121,12 +160,15 @@ JL_DLLEXPORT void SEQ_FilterPush(int file_id, C_BOOL new_flag)
 JL_DLLEXPORT void SEQ_FilterPop(int file_id)
 {
 	COREARRAY_TRY
+		CSeqLock lock(GDSFile_ID_Mutex);
 		map<int, CFileInfo>::iterator it = GDSFile_ID_Info.find(file_id);
 		if (it != GDSFile_ID_Info.end())
 		{
-			if (it->second.SelList.size() <= 1)
+			list<TSelection> &sl = it->second.SelList();
+			if (sl.size() <= 1)
 				throw ErrSeqArray("No filter can be pop up.");
-			it->second.SelList.pop_back();
+			sl.pop_back();
+			it->second.PublishSelection();
 		} else
 			throw ErrSeqArray("The GDS file is closed or invalid.");
 	COREARRAY_CATCH
@@ -171,6 +213,8 @@ JL_DLLEXPORT void SEQ_SetSample(int file_id,  jl_array_t *samp_sel,
 			// reset the filter
 			memset(pArray, 1, Count);
 		}
+		Sel.ClearSampleCount();
+		File.PublishSelection();
 
 		int n = File.SampleSelNum();
 		if (verbose)
@@ -218,6 +262,8 @@ JL_DLLEXPORT void SEQ_SetVariant(int file_id,  jl_array_t *var_sel,
 			// reset the filter
 			memset(pArray, 1, Count);
 		}
+		Sel.ClearVariantCount();
+		File.PublishSelection();
 
 		int n = File.VariantSelNum();
 		if (verbose)
@@ -227,180 +273,202 @@ JL_DLLEXPORT void SEQ_SetVariant(int file_id,  jl_array_t *var_sel,
 }
 
 
-/*
 // ================================================================
 
-static bool is_numeric(const string &txt)
-{
-	char *endptr = (char*)(txt.c_str());
-	strtol(txt.c_str(), &endptr, 10);
-	return (endptr != txt.c_str()) && (*endptr == 0);
-}
-
-/// set a working space flag with selected chromosome(s)
-JL_DLLEXPORT PyObject* SEQ_SetChrom(PyObject* gdsfile, PyObject* include,
-	PyObject* is_num, PyObject* frombp, PyObject* tobp, PyObject* intersect, PyObject* verbose)
+/// replace or intersect the variant selection with the flags in 'array',
+/// return the number of selected variants
+static int SetVariantRegion(CFileInfo &File, const vector<C_BOOL> &array,
+	bool intersect, bool verbose)
 {
-	int nProtected = 0;
-	int *pFrom=NULL, *pTo=NULL;
-
-	int IsNum = Rf_asLogical(is_num);
-	int IsIntersect = Rf_asLogical(intersect);
-	if (IsIntersect == NA_INTEGER)
-		error("'intersect' should be either FALSE or TRUE.");
-
-	if (Rf_isNull(include))
+	vector<C_BOOL> &sel_array = File.Selection().Variant;
+	if (!sel_array.empty())
 	{
-		if (!Rf_isNull(frombp))
-			error("'from.bp' should be NULL.");
-		if (!Rf_isNull(tobp))
-			error("'to.bp' should be NULL.");
-	} else {
-		include = PROTECT(AS_CHARACTER(include));
-		nProtected ++;
-		if (!Rf_isNull(frombp) || !Rf_isNull(tobp))
+		C_BOOL *p = &sel_array[0];
+		const C_BOOL *s = &array[0];
+		if (intersect)
 		{
-			if (RLength(include) != RLength(frombp))
-				error("'from.bp' should have the same length as 'include'.");
-			if (RLength(include) != RLength(tobp))
-				error("'to.bp' should have the same length as 'include'.");
-			frombp = PROTECT(AS_INTEGER(frombp));
-			tobp = PROTECT(AS_INTEGER(tobp));
-			pFrom = INTEGER(frombp); pTo = INTEGER(tobp);
-			nProtected += 2;
-		}
+			for (size_t n=sel_array.size(); n > 0; n--)
+				(*p++) &= (*s++);
+		} else
+			memcpy(p, s, sel_array.size());
 	}
+	File.Selection().ClearVariantCount();
+	File.PublishSelection();
+
+	int n = File.VariantSelNum();
+	if (verbose)
+		jl_printf(JL_STDOUT, "Number of selected variants: %s\n", PrettyInt(n));
+	return n;
+}
 
+
+/// set a working space flag with selected regions, 'chrom', 'from' and 'to'
+/// have the same length, positions are found by binary search if sorted
+JL_DLLEXPORT void SEQ_SetChrom(int file_id, jl_array_t *chrom,
+	jl_array_t *from, jl_array_t *to, C_BOOL intersect, C_BOOL verbose)
+{
 	COREARRAY_TRY
 
-		CFileInfo &File = GetFileInfo(gdsfile);
+		CFileInfo &File = GetFileInfo(file_id);
 		TSelection &Sel = File.Selection();
+		CChromIndex &Chrom = File.Chromosome();
+		vector<C_Int32> &Pos = File.Position();
+		const C_Int32 *varPos = Pos.empty() ? NULL : &Pos[0];
+		const bool sorted = File.PositionSorted();
+
+		size_t n = jl_array_len(chrom);
+		if ((jl_array_len(from) != n) || (jl_array_len(to) != n))
+			throw ErrSeqArray("'from' and 'to' should have the same length as 'chrom'.");
+		jl_value_t **pChr = (jl_value_t**)jl_array_data(chrom);
+		const C_Int32 *pFrom = (const C_Int32*)jl_array_data(from);
+		const C_Int32 *pTo = (const C_Int32*)jl_array_data(to);
 
 		vector<C_BOOL> &sel_array = Sel.Variant;
-		vector<C_BOOL> tmp_array;
-		if (IsIntersect) tmp_array.resize(sel_array.size());
-
-		vector<C_BOOL> &array = IsIntersect ? tmp_array : sel_array;
-		memset(&array[0], FALSE, array.size());
+		vector<C_BOOL> array(sel_array.size(), FALSE);
 
-		if (Rf_isNull(include))
+		for (size_t idx=0; idx < n; idx++)
 		{
-			// include = NULL
-			if (IsNum == NA_INTEGER)
+			map<string, CChromIndex::TRangeList>::iterator it =
+				Chrom.Map.find(jl_string_ptr(pChr[idx]));
+			if (it == Chrom.Map.end()) continue;
+			const C_Int32 from_bp = pFrom[idx], to_bp = pTo[idx];
+			if (to_bp < from_bp) continue;
+
+			CChromIndex::TRangeList &rng = it->second;
+			vector<CChromIndex::TRange>::const_iterator p;
+			for (p=rng.begin(); p != rng.end(); p++)
 			{
-				memset(&array[0], TRUE, array.size());
-			} else {
-				CChromIndex &Chrom = File.Chromosome();
-				map<string, CChromIndex::TRangeList>::iterator it;
-				for (it=Chrom.Map.begin(); it != Chrom.Map.end(); it++)
+				const C_Int32 *st = varPos + p->Start;
+				const C_Int32 *ed = st + p->Length;
+				if (sorted)
 				{
-					bool flag = is_numeric(it->first);
-					if (((IsNum==TRUE) && flag) || ((IsNum==FALSE) && !flag))
-					{
-						CChromIndex::TRangeList &rng = it->second;
-						vector<CChromIndex::TRange>::iterator it;
-						for (it=rng.begin(); it != rng.end(); it++)
-						{
-							memset(&array[it->Start], TRUE, it->Length);
-						}
-					}
+					// O(log n) for each region
+					const C_Int32 *i1 = lower_bound(st, ed, from_bp);
+					const C_Int32 *i2 = upper_bound(i1, ed, to_bp);
+					if (i1 < i2)
+						memset(&array[i1 - varPos], TRUE, i2 - i1);
+				} else {
+					for (const C_Int32 *s=st; s < ed; s++)
+						if ((from_bp <= *s) && (*s <= to_bp))
+							array[s - varPos] = TRUE;
 				}
 			}
+		}
 
-		} else {
-			// include != NULL
-			vector<C_Int32> *varPos = NULL;
-			if (pFrom && pTo)
-				varPos = &File.Position();
+		SetVariantRegion(File, array, intersect, verbose);
 
-			CChromIndex &Chrom = File.Chromosome();
-			map<string, CRangeSet> RngSets;
+	COREARRAY_CATCH
+}
 
-			R_xlen_t n = XLENGTH(include);
-			for (R_xlen_t idx=0; idx < n; idx++)
-			{
-				string s = CHAR(STRING_ELT(include, idx));
 
-				if (IsNum == TRUE)
-				{
-					if (!is_numeric(s)) continue;
-				} else if (IsNum == FALSE)
-				{
-					if (is_numeric(s)) continue;
-				}
+/// set a working space flag with a set of regions, which are merged if
+/// overlapping; return [id, chrom, start, end] if 'region_id' with the index
+/// of merged region for each selected variant, otherwise nothing
+JL_DLLEXPORT jl_value_t* SEQ_SetRegionSet(int file_id, jl_array_t *chrom,
+	jl_array_t *start, jl_array_t *end, C_BOOL intersect, C_BOOL region_id,
+	C_BOOL verbose)
+{
+	jl_value_t *rv_ans = jl_nothing;
+	COREARRAY_TRY
 
-				map<string, CChromIndex::TRangeList>::iterator it =
-					Chrom.Map.find(s);
-				if (it != Chrom.Map.end())
-				{
-					if (varPos)
-					{
-						// if from.bp and to.bp
-						int from = pFrom[idx], to = pTo[idx];
-						if (from == NA_INTEGER) from = 0;
-						if (to == NA_INTEGER) to = 2147483647;
-						RngSets[s].AddRange(from, to);
-					} else {
-						// no from.bp and to.bp
-						CChromIndex::TRangeList &rng = it->second;
-						vector<CChromIndex::TRange>::iterator p;
-						for (p=rng.begin(); p != rng.end(); p++)
-						{
-							memset(&array[p->Start], TRUE, p->Length);
-						}
-					}
-				}
-			}
+		CFileInfo &File = GetFileInfo(file_id);
+		TSelection &Sel = File.Selection();
+		CChromIndex &Chrom = File.Chromosome();
+		vector<C_Int32> &Pos = File.Position();
+		const C_Int32 *varPos = Pos.empty() ? NULL : &Pos[0];
+		const bool sorted = File.PositionSorted();
+
+		size_t n = jl_array_len(chrom);
+		if ((jl_array_len(start) != n) || (jl_array_len(end) != n))
+			throw ErrSeqArray("'start' and 'end' should have the same length as 'chrom'.");
+		jl_value_t **pChr = (jl_value_t**)jl_array_data(chrom);
+		const C_Int32 *pStart = (const C_Int32*)jl_array_data(start);
+		const C_Int32 *pEnd = (const C_Int32*)jl_array_data(end);
+
+		// interval sets of chromosomes
+		map<string, CRangeSet> RngSets;
+		for (size_t i=0; i < n; i++)
+		{
+			if (pEnd[i] >= pStart[i])
+				RngSets[jl_string_ptr(pChr[i])].AddRange(pStart[i], pEnd[i]);
+		}
 
-			if (varPos)
+		vector<C_BOOL> &sel_array = Sel.Variant;
+		vector<C_BOOL> array(sel_array.size(), FALSE);
+		vector<C_Int32> id_array;
+		if (region_id) id_array.resize(sel_array.size(), 0);
+
+		// merge-join with the positions of each chromosome run
+		int id_base = 1;
+		map<string, CRangeSet>::iterator it;
+		for (it=RngSets.begin(); it != RngSets.end(); it++)
+		{
+			CRangeSet &RngSet = it->second;
+			RngSet.Init();
+			map<string, CChromIndex::TRangeList>::iterator p =
+				Chrom.Map.find(it->first);
+			if (p != Chrom.Map.end())
 			{
-				map<string, CRangeSet>::iterator it;
-				for (it=RngSets.begin(); it != RngSets.end(); it++)
+				CChromIndex::TRangeList &rng = p->second;
+				vector<CChromIndex::TRange>::const_iterator r;
+				for (r=rng.begin(); r != rng.end(); r++)
 				{
-					CChromIndex::TRangeList &rng = Chrom.Map[it->first];
-					CRangeSet &RngSet = it->second;
-					vector<CChromIndex::TRange>::const_iterator p;
-					for (p=rng.begin(); p != rng.end(); p++)
-					{
-						size_t i = p->Start;
-						size_t n = p->Length;
-						C_Int32 *s = &((*varPos)[0]) + i;
-						if (!IsIntersect)
-						{
-							for (; n > 0; n--, i++)
-								if (RngSet.IsIncluded(*s++)) array[i] = TRUE;
-						} else {
-							C_BOOL *b = &sel_array[i];
-							for (; n > 0; n--, i++, s++)
-							{
-								if (*b++)
-									if (RngSet.IsIncluded(*s)) array[i] = TRUE;
-							}
-						}
-					}
+					RngSet.Select(varPos + r->Start, r->Length, sorted,
+						&array[r->Start],
+						region_id ? &id_array[r->Start] : NULL, id_base);
 				}
 			}
+			id_base += RngSet.Ranges().size();
 		}
 
-		if (IsIntersect)
-		{
-			C_BOOL *p = &sel_array[0];
-			C_BOOL *s = &array[0];
-			for (size_t n=sel_array.size(); n > 0; n--)
-				(*p++) &= (*s++);
-		}
+		int nSel = SetVariantRegion(File, array, intersect, verbose);
 
-		if (Rf_asLogical(verbose) == TRUE)
+		if (region_id)
 		{
-			int n = GetNumOfTRUE(&sel_array[0], sel_array.size());
-			Rprintf("# of selected variants: %s\n", PrettyInt(n));
+			jl_array_t *Id=NULL, *RChr=NULL, *RStart=NULL, *REnd=NULL;
+			JL_GC_PUSH4(&Id, &RChr, &RStart, &REnd);
+			// the region index of selected variants
+			jl_value_t *atype = jl_apply_array_type(jl_int32_type, 1);
+			Id = jl_alloc_array_1d(atype, nSel);
+			C_Int32 *pId = (C_Int32*)jl_array_data(Id);
+			for (size_t i=0; i < sel_array.size(); i++)
+				if (sel_array[i]) *pId++ = id_array[i];
+			// merged regions
+			size_t nRng = id_base - 1;
+			RStart = jl_alloc_array_1d(atype, nRng);
+			REnd = jl_alloc_array_1d(atype, nRng);
+			RChr = jl_alloc_array_1d(jl_apply_array_type(jl_string_type, 1), nRng);
+			C_Int32 *ps = (C_Int32*)jl_array_data(RStart);
+			C_Int32 *pe = (C_Int32*)jl_array_data(REnd);
+			jl_value_t **pc = (jl_value_t**)jl_array_data(RChr);
+			for (it=RngSets.begin(); it != RngSets.end(); it++)
+			{
+				const vector<CRangeSet::TRange> &lst = it->second.Ranges();
+				if (lst.empty()) continue;
+				jl_value_t *chr = jl_pchar_to_string(it->first.c_str(),
+					it->first.size());
+				for (size_t i=0; i < lst.size(); i++)
+				{
+					*ps++ = lst[i].Start; *pe++ = lst[i].End;
+					*pc++ = chr; jl_gc_wb(RChr, chr);
+				}
+			}
+			// output
+			atype = jl_apply_array_type(jl_any_type, 1);
+			jl_array_t *rv = jl_alloc_array_1d(atype, 4);
+			jl_value_t **ptr = (jl_value_t**)jl_array_data(rv);
+			ptr[0] = (jl_value_t*)Id; jl_gc_wb(rv, Id);
+			ptr[1] = (jl_value_t*)RChr; jl_gc_wb(rv, RChr);
+			ptr[2] = (jl_value_t*)RStart; jl_gc_wb(rv, RStart);
+			ptr[3] = (jl_value_t*)REnd; jl_gc_wb(rv, REnd);
+			rv_ans = (jl_value_t*)rv;
+			JL_GC_POP();
 		}
 
-		UNPROTECT(nProtected);
-
 	COREARRAY_CATCH
+	return rv_ans;
 }
-*/
+
 
 // ================================================================
 
@@ -430,6 +498,65 @@ JL_DLLEXPORT jl_array_t* SEQ_GetFilter(int file_id, C_BOOL sample)
 }
 
 
+/// restrict the selected variants to [start, end), 0-based
+JL_DLLEXPORT void SEQ_SetVariantSpan(int file_id, C_Int64 start, C_Int64 end)
+{
+	COREARRAY_TRY
+
+		CFileInfo &File = GetFileInfo(file_id);
+		TSelection &Sel = File.Selection();
+		C_BOOL *pArray = Sel.pVariant();
+		C_Int64 Count = File.VariantNum();
+
+		if (start < 0) start = 0;
+		if (end > Count) end = Count;
+		if (start > end) start = end;
+		memset(pArray, 0, start);
+		memset(pArray + end, 0, Count - end);
+		Sel.ClearVariantCount();
+		File.PublishSelection();
+
+	COREARRAY_CATCH
+}
+
+
+/// split the selected variants into chunks of 'chunk' selected variants, and
+/// return the 0-based starting positions of chunks followed by the total
+/// number of variants
+JL_DLLEXPORT jl_array_t* SEQ_SplitVariant(int file_id, int chunk)
+{
+	jl_array_t *rv_ans = NULL;
+	COREARRAY_TRY
+
+		if (chunk < 1)
+			throw ErrSeqArray("'chunk' should be > 0.");
+		CFileInfo &File = GetFileInfo(file_id);
+		C_BOOL *pArray = File.Selection().pVariant();
+		size_t Count = File.VariantNum();
+
+		vector<C_Int64> st;
+		size_t cnt = 0;
+		for (size_t i=0; i < Count; i++)
+		{
+			if (!pArray[i]) continue;
+			if (st.empty() || (cnt >= (size_t)chunk))
+			{
+				st.push_back(i);
+				cnt = 0;
+			}
+			cnt ++;
+		}
+		st.push_back(Count);
+
+		jl_value_t *atype = jl_apply_array_type(jl_int64_type, 1);
+		rv_ans = jl_alloc_array_1d(atype, st.size());
+		memcpy(jl_array_data(rv_ans), &st[0], sizeof(C_Int64)*st.size());
+
+	COREARRAY_CATCH
+	return rv_ans;
+}
+
+
 // ================================================================
 
 /// get the total number of samples
@@ -0,0 +1,494 @@
+// ===========================================================
+//
+// Methods.cpp: statistical methods over genotypes
+//
+// Copyright (C) 2017    Xiuwen Zheng
+//
+// This file is part of JSeqArray.
+//
+// JSeqArray is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 3 as
+// published by the Free Software Foundation.
+//
+// JSeqArray is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with JSeqArray.
+// If not, see <http://www.gnu.org/licenses/>.
+
+#include "Index.h"
+#include "ReadByVariant.h"
+#include <math.h>
+#include <algorithm>
+
+#ifndef _WIN32
+#   include <pthread.h>
+#   define JSEQ_THREAD
+#endif
+
+
+using namespace JSeqArray;
+
+
+namespace JSeqArray
+{
+
+// ===========================================================
+// Genetic relationship matrix
+// ===========================================================
+
+/// Accumulate the genetic relationship matrix block by block, the dosages
+/// are standardized by allele frequencies, and the products of a block are
+/// computed in tiles of samples by multiple threads; the lower triangle is
+/// accumulated in the output matrix directly without a working copy
+class COREARRAY_DLL_LOCAL CGRM
+{
+public:
+	/// constructor, 'out' is a (nsamp, nsamp) matrix
+	CGRM(double *out, size_t nsamp, size_t bsize, int nthread)
+	{
+		NSamp = nsamp; BSize = bsize; NVar = 0;
+		NThread = (nthread > 0) ? nthread : 1;
+		Geno.resize(NSamp * BSize);
+		Mat = out;
+		memset(Mat, 0, sizeof(double) * NSamp * NSamp);
+	}
+
+	/// standardize the dosages of a variant, and add it to the block
+	void AddVariant(const C_UInt8 *d, int ploidy)
+	{
+		// allele frequency
+		size_t sum=0, n=0;
+		for (size_t i=0; i < NSamp; i++)
+			if (d[i] != NA_UINT8) { sum += d[i]; n++; }
+		double af = (n > 0) ? double(sum) / (n * ploidy) : 0;
+		double s = af * (1 - af);
+		// monomorphic or missing sites contribute zeros
+		s = (s > 0) ? 1 / sqrt(s) : 0;
+		double *p = &Geno[NVar];
+		for (size_t i=0; i < NSamp; i++, p+=BSize)
+			*p = (d[i] != NA_UINT8) ? (d[i] - ploidy * af) * s : 0;
+		if ((++NVar) >= BSize) Update();
+	}
+
+	/// accumulate the products of the block
+	void Update()
+	{
+		if (NVar <= 0) return;
+	#ifdef JSEQ_THREAD
+		if (NThread > 1)
+		{
+			vector<pthread_t> th(NThread-1);
+			vector<TParam> param(NThread);
+			for (int i=0; i < NThread; i++)
+				{ param[i].Obj = this; param[i].Index = i; }
+			int n = 0;
+			for (; n < NThread-1; n++)
+			{
+				if (pthread_create(&th[n], NULL, thread_proc, &param[n+1]) != 0)
+					break;
+			}
+			// the threads not created are run in the current thread
+			for (int i=n+1; i < NThread; i++) _Update(i);
+			_Update(0);
+			for (int i=0; i < n; i++) pthread_join(th[i], NULL);
+		} else
+	#endif
+			_Update(0);
+		NVar = 0;
+	}
+
+	/// scale the matrix by the average of diagonal, and fill the upper
+	/// triangle
+	void Finalize()
+	{
+		Update();
+		double tr = 0;
+		for (size_t i=0; i < NSamp; i++) tr += Mat[i*NSamp + i];
+		double scale = (tr > 0) ? NSamp / tr : 0;
+		for (size_t i=0; i < NSamp; i++)
+		{
+			for (size_t j=0; j <= i; j++)
+			{
+				double v = Mat[i*NSamp + j] * scale;
+				Mat[i*NSamp + j] = Mat[j*NSamp + i] = v;
+			}
+		}
+	}
+
+private:
+	static const size_t TILE = 32;    ///< the number of samples in a tile
+	static const size_t KTILE = 256;  ///< the number of variants in a tile
+
+	struct TParam
+	{
+		CGRM *Obj;
+		int Index;
+	};
+
+	size_t NSamp;  ///< the number of samples
+	size_t BSize;  ///< the maximum number of variants in a block
+	size_t NVar;   ///< the number of variants in the current block
+	int NThread;   ///< the number of threads
+	vector<double> Geno;  ///< standardized dosages, (variant, sample)
+	double *Mat;          ///< the output, the lower triangle is accumulated
+
+	/// update the rows of tiles assigned to the thread 'idx'
+	void _Update(int idx)
+	{
+		const size_t nt = (NSamp + TILE - 1) / TILE;
+		for (size_t ti=idx; ti < nt; ti += NThread)
+		{
+			const size_t i0 = ti * TILE;
+			const size_t i1 = (i0 + TILE < NSamp) ? i0 + TILE : NSamp;
+			for (size_t tj=0; tj <= ti; tj++)
+			{
+				const size_t j0 = tj * TILE;
+				const size_t j1 = (j0 + TILE < NSamp) ? j0 + TILE : NSamp;
+				for (size_t k0=0; k0 < NVar; k0 += KTILE)
+				{
+					const size_t nk = (k0 + KTILE < NVar) ? KTILE : NVar - k0;
+					for (size_t i=i0; i < i1; i++)
+					{
+						const double *x = &Geno[i*BSize + k0];
+						double *m = &Mat[i*NSamp];
+						const size_t je = (ti == tj) ? i + 1 : j1;
+						for (size_t j=j0; j < je; j++)
+							m[j] += vec_f64_dot(x, &Geno[j*BSize + k0], nk);
+					}
+				}
+			}
+		}
+	}
+
+#ifdef JSEQ_THREAD
+	static void *thread_proc(void *ptr)
+	{
+		TParam *p = (TParam*)ptr;
+		p->Obj->_Update(p->Index);
+		return NULL;
+	}
+#endif
+};
+
+
+
+// ===========================================================
+// Linkage disequilibrium
+// ===========================================================
+
+/// Compare variants with the preceding variants in a sliding window, the
+/// dosages are saved as bit planes with a mask of non-missing values, so
+/// that the sums over the samples non-missing in both variants are counted
+/// by popcount
+class COREARRAY_DLL_LOCAL CLDWindow
+{
+public:
+	static const int LD_R2 = 0;
+	static const int LD_R  = 1;
+	static const int LD_DPRIME = 2;
+
+	/// constructor
+	CLDWindow(size_t nsamp, int ploidy, size_t maxvar, int method)
+	{
+		NSamp = nsamp; Ploidy = ploidy; Method = method;
+		NPlane = 1;
+		while ((1 << NPlane) <= ploidy) NPlane ++;
+		NWord = (nsamp + 63) / 64;
+		Stride = NWord * (NPlane + 1);
+		MaxVar = (maxvar > 0) ? maxvar : 1;
+		Buf.resize(MaxVar * Stride);
+		Pos.resize(MaxVar); Idx.resize(MaxVar);
+		Head = Count = 0;
+	}
+
+	/// remove all variants, e.g., at the start of a chromosome
+	inline void Clear() { Head = Count = 0; }
+
+	/// remove the variants at positions before 'pos'
+	inline void Drop(C_Int32 pos)
+	{
+		while ((Count > 0) && (Pos[Head] < pos))
+			{ Head = (Head + 1) % MaxVar; Count --; }
+	}
+
+	/// compare the dosages 'd' with the variants in the window, save the
+	/// pairs with abs(statistic) >= threshold, and add 'd' to the window
+	void Add(const C_UInt8 *d, C_Int32 pos, C_Int32 idx, double threshold,
+		vector<C_Int32> &I, vector<C_Int32> &J, vector<double> &V)
+	{
+		// the slot of the new variant
+		if (Count >= MaxVar)
+			{ Head = (Head + 1) % MaxVar; Count --; }
+		size_t slot = (Head + Count) % MaxVar;
+		C_UInt64 *y = &Buf[slot * Stride];
+		_Pack(d, y);
+
+		for (size_t k=0; k < Count; k++)
+		{
+			size_t s = (Head + k) % MaxVar;
+			double v = _Stat(&Buf[s * Stride], y);
+			if (fabs(v) >= threshold)  // false if NaN
+			{
+				I.push_back(Idx[s]); J.push_back(idx); V.push_back(v);
+			}
+		}
+		Pos[slot] = pos; Idx[slot] = idx;
+		Count ++;
+	}
+
+private:
+	size_t NSamp, NWord, Stride, MaxVar;
+	int Ploidy, Method, NPlane;
+	vector<C_UInt64> Buf;   ///< (mask, plane 0, plane 1, ...) of each variant
+	vector<C_Int32> Pos;    ///< positions of variants in the window
+	vector<C_Int32> Idx;    ///< indices of variants in the window
+	size_t Head, Count;     ///< the ring buffer of variants
+
+	/// save dosages to a mask of non-missing values and bit planes
+	void _Pack(const C_UInt8 *d, C_UInt64 *p)
+	{
+		memset(p, 0, sizeof(C_UInt64) * Stride);
+		for (size_t i=0; i < NSamp; i++)
+		{
+			if (d[i] == NA_UINT8) continue;
+			const C_UInt64 bit = ((C_UInt64)1) << (i & 0x3F);
+			const size_t w = i >> 6;
+			p[w] |= bit;
+			for (int b=0; b < NPlane; b++)
+				if (d[i] & (1 << b)) p[(b+1)*NWord + w] |= bit;
+		}
+	}
+
+	/// the statistic between two variants
+	double _Stat(const C_UInt64 *x, const C_UInt64 *y)
+	{
+		// sums over the samples non-missing in both variants
+		C_Int64 n=0, sx=0, sy=0, sxx=0, syy=0, sxy=0;
+		const C_UInt64 *xp = x + NWord, *yp = y + NWord;
+		for (size_t w=0; w < NWord; w++)
+		{
+			const C_UInt64 m = x[w] & y[w];
+			if (!m) continue;
+			n += POPCNT_U64(m);
+			for (int b=0; b < NPlane; b++)
+			{
+				const C_UInt64 xb = xp[b*NWord + w] & m;
+				const C_UInt64 yb = yp[b*NWord + w] & m;
+				sx += (C_Int64)POPCNT_U64(xb) << b;
+				sy += (C_Int64)POPCNT_U64(yb) << b;
+				for (int c=0; c < NPlane; c++)
+				{
+					const C_UInt64 xc = xp[c*NWord + w];
+					const C_UInt64 yc = yp[c*NWord + w];
+					sxx += (C_Int64)POPCNT_U64(xb & xc) << (b + c);
+					syy += (C_Int64)POPCNT_U64(yb & yc) << (b + c);
+					sxy += (C_Int64)POPCNT_U64(xb & yc) << (b + c);
+				}
+			}
+		}
+		if (n <= 0) return NaN;
+
+		const double mx = double(sx) / n, my = double(sy) / n;
+		const double cov = double(sxy) / n - mx * my;
+		if (Method == LD_DPRIME)
+		{
+			// composite LD, D = cov / ploidy with allele frequencies
+			const double pa = mx / Ploidy, pb = my / Ploidy;
+			const double D = cov / Ploidy;
+			double Dmax = (D >= 0) ? std::min(pa*(1-pb), (1-pa)*pb) :
+				std::min(pa*pb, (1-pa)*(1-pb));
+			return (Dmax > 0) ? D / Dmax : NaN;
+		}
+		const double vx = double(sxx) / n - mx * mx;
+		const double vy = double(syy) / n - my * my;
+		const double r = cov / sqrt(vx * vy);
+		return (Method == LD_R) ? r : r * r;
+	}
+
+	static const double NaN;
+};
+
+const double CLDWindow::NaN = 0.0/0.0;
+
+}
+
+
+extern "C"
+{
+
+// ===========================================================
+// Statistical methods
+// ===========================================================
+
+/// Calculate the genetic relationship matrix from the dosages of reference
+/// allele, which are read and accumulated block by block
+COREARRAY_DLL_EXPORT jl_array_t* SEQ_GRM(int file_id, int bsize, int nthread,
+	C_BOOL verbose)
+{
+	jl_array_t *rv_ans = NULL;
+	COREARRAY_TRY
+
+		if (bsize < 1)
+			throw ErrSeqArray("'bsize' must be >= 1.");
+		if (nthread < 1)
+			throw ErrSeqArray("'nthread' must be >= 1.");
+
+		// File information
+		CFileInfo &File = GetFileInfo(file_id);
+		ssize_t nSample  = File.SampleSelNum();
+		ssize_t nVariant = File.VariantSelNum();
+
+		// output, no Julia object is allocated until returning
+		jl_value_t *atype = jl_apply_array_type(jl_float64_type, 2);
+		rv_ans = jl_alloc_array_2d(atype, nSample, nSample);
+
+		CGRM GRM((double*)jl_array_data(rv_ans), nSample, bsize, nthread);
+		if ((nSample > 0) && (nVariant > 0))
+		{
+			int NumBlock = nVariant / bsize;
+			if (nVariant % bsize) NumBlock ++;
+			CProgressStdOut progress(NumBlock, verbose);
+
+			// the file is locked for reading variants, but not for the math
+			CApply_Variant_Dosage *NodeVar;
+			{
+				CSeqLock lock(File.Mutex());
+				NodeVar = new CApply_Variant_Dosage(File);
+			}
+			try {
+				vector<C_UInt8> dosage(nSample);
+				int cnt = 0;
+				bool more;
+				do {
+					{
+						CSeqLock lock(File.Mutex());
+						NodeVar->ReadDosage(&dosage[0]);
+						more = NodeVar->Next();
+					}
+					GRM.AddVariant(&dosage[0], File.Ploidy());
+					if ((++cnt) >= bsize)
+						{ progress.Forward(); cnt = 0; }
+				} while (more);
+				if (cnt > 0) progress.Forward();
+			}
+			catch (...) {
+				delete NodeVar;
+				throw;
+			}
+			delete NodeVar;
+		}
+
+		GRM.Finalize();
+
+	COREARRAY_CATCH
+	return rv_ans;
+}
+
+
+/// Calculate linkage disequilibrium between variants in sliding windows
+/// which do not cross chromosomes, return the selected variant indices
+/// (starting from 1) and values of pairs with abs(value) >= threshold
+COREARRAY_DLL_EXPORT jl_array_t* SEQ_LD(int file_id, const char *method,
+	int window, int maxvar, double threshold, C_BOOL verbose)
+{
+	jl_array_t *rv_ans = NULL;
+	COREARRAY_TRY
+
+		int m;
+		if (strcmp(method, "r2") == 0)
+			m = CLDWindow::LD_R2;
+		else if (strcmp(method, "r") == 0)
+			m = CLDWindow::LD_R;
+		else if (strcmp(method, "dprime") == 0)
+			m = CLDWindow::LD_DPRIME;
+		else
+			throw ErrSeqArray("'method' should be 'r2', 'r' or 'dprime'.");
+		if (window < 0)
+			throw ErrSeqArray("'window' must be >= 0.");
+		if (maxvar < 1)
+			throw ErrSeqArray("'maxvar' must be >= 1.");
+
+		// File information
+		CFileInfo &File = GetFileInfo(file_id);
+		ssize_t nSample  = File.SampleSelNum();
+		ssize_t nVariant = File.VariantSelNum();
+
+		vector<C_Int32> I, J;
+		vector<double> V;
+		if ((nSample > 0) && (nVariant > 0))
+		{
+			const C_Int32 *pos = &File.Position()[0];
+			// runs of chromosomes
+			CChromIndex &Chrom = File.Chromosome();
+			const vector<C_UInt32> &RunLen = Chrom.RunLengths();
+			size_t RunIdx=0, RunEnd=RunLen.empty() ? 0 : RunLen[0];
+
+			CLDWindow LD(nSample, File.Ploidy(), maxvar, m);
+			// the file is locked for reading variants, but not for the math
+			CApply_Variant_Dosage *NodeVar;
+			{
+				CSeqLock lock(File.Mutex());
+				NodeVar = new CApply_Variant_Dosage(File);
+			}
+			try {
+				vector<C_UInt8> dosage(nSample);
+				CProgressStdOut progress(nVariant, verbose);
+				C_Int32 idx = 1;
+				bool more;
+				do {
+					const size_t i = NodeVar->Position;
+					if (i >= RunEnd)
+					{
+						// the next chromosome
+						while ((RunIdx+1 < RunLen.size()) && (i >= RunEnd))
+							RunEnd += RunLen[++RunIdx];
+						LD.Clear();
+					}
+					LD.Drop(pos[i] - window);
+					{
+						CSeqLock lock(File.Mutex());
+						NodeVar->ReadDosage(&dosage[0]);
+						more = NodeVar->Next();
+					}
+					LD.Add(&dosage[0], pos[i], idx++, threshold, I, J, V);
+					progress.Forward();
+				} while (more);
+			}
+			catch (...) {
+				delete NodeVar;
+				throw;
+			}
+			delete NodeVar;
+		}
+
+		// output
+		jl_array_t *aI=NULL, *aJ=NULL, *aV=NULL;
+		JL_GC_PUSH4(&rv_ans, &aI, &aJ, &aV);
+		jl_value_t *atype = jl_apply_array_type(jl_int32_type, 1);
+		aI = jl_alloc_array_1d(atype, I.size());
+		aJ = jl_alloc_array_1d(atype, J.size());
+		atype = jl_apply_array_type(jl_float64_type, 1);
+		aV = jl_alloc_array_1d(atype, V.size());
+		if (!V.empty())
+		{
+			memcpy(jl_array_data(aI), &I[0], sizeof(C_Int32)*I.size());
+			memcpy(jl_array_data(aJ), &J[0], sizeof(C_Int32)*J.size());
+			memcpy(jl_array_data(aV), &V[0], sizeof(double)*V.size());
+		}
+		atype = jl_apply_array_type(jl_any_type, 1);
+		rv_ans = jl_alloc_array_1d(atype, 3);
+		void **ptr = (void**)jl_array_data(rv_ans);
+		ptr[0] = aI; jl_gc_wb(rv_ans, aI);
+		ptr[1] = aJ; jl_gc_wb(rv_ans, aJ);
+		ptr[2] = aV; jl_gc_wb(rv_ans, aV);
+		JL_GC_POP();
+
+	COREARRAY_CATCH
+	return rv_ans;
+}
+
+} // extern "C"
@@ -0,0 +1,418 @@
+// ===========================================================
+//
+// ReadBySample.cpp: Read data sample by sample
+//
+// Copyright (C) 2017    Xiuwen Zheng
+//
+// This file is part of JSeqArray.
+//
+// JSeqArray is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 3 as
+// published by the Free Software Foundation.
+//
+// JSeqArray is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with JSeqArray.
+// If not, see <http://www.gnu.org/licenses/>.
+
+#include "ReadBySample.h"
+#include "ReadByVariant.h"
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#   include <process.h>
+#   define getpid    _getpid
+#   define fseek64   _fseeki64
+#else
+#   include <unistd.h>
+#   define fseek64   fseeko
+#endif
+
+
+namespace JSeqArray
+{
+
+// =====================================================================
+// Sample-major genotype file
+
+static const char SAMP_CACHE_MAGIC[8] = { 'J','S','E','Q','S','M','P', 0 };
+static const C_UInt32 SAMP_CACHE_VERSION = 2;
+
+/// the header of sample-major genotype file, followed by the blocks of
+/// variants, the side list of alleles > 1 and the starts of samples in it
+struct TSampCacheHeader
+{
+	char Magic[8];        ///< SAMP_CACHE_MAGIC
+	C_UInt32 Version;     ///< SAMP_CACHE_VERSION
+	C_Int32 SampleNum;    ///< the total number of samples
+	C_Int32 VariantNum;   ///< the total number of variants
+	C_Int32 Ploidy;       ///< ploidy
+	C_Int32 BlockSize;    ///< the number of variants in a block, a multiple of 4
+	C_Int32 Reserved;
+	C_Int64 ExtraNum;     ///< the number of entries in the side list
+	C_Int64 GDSSize;      ///< the size of GDS file
+	C_Int64 GDSMTime;     ///< the last modification time of GDS file
+};
+
+static const char *ERR_SAMP_CACHE_READ = "Invalid sample-major genotype file.";
+static const char *ERR_SAMP_CACHE_WRITE =
+	"Fails to write the sample-major genotype file.";
+
+/// the number of bytes of a sample in a block of 'cnt' variants
+static inline C_Int64 samp_row_bytes(const TSampCacheHeader &H, C_Int64 cnt)
+{
+	return (cnt * H.Ploidy + 3) / 4;
+}
+
+/// the file offset of the side list, after all blocks
+static C_Int64 samp_extra_offset(const TSampCacheHeader &H)
+{
+	const C_Int64 nb = H.VariantNum / H.BlockSize;
+	const C_Int64 rem = H.VariantNum % H.BlockSize;
+	return sizeof(H) + (nb * samp_row_bytes(H, H.BlockSize) +
+		samp_row_bytes(H, rem)) * H.SampleNum;
+}
+
+/// the total size of the file
+static inline C_Int64 samp_file_size(const TSampCacheHeader &H)
+{
+	return samp_extra_offset(H) + H.ExtraNum * sizeof(TSampCacheExtra) +
+		((C_Int64)H.SampleNum + 1) * sizeof(C_Int64);
+}
+
+/// read and validate the header
+static bool samp_read_header(FILE *f, CFileInfo &File, TSampCacheHeader &H)
+{
+	if (fread(&H, sizeof(H), 1, f) != 1) return false;
+	return (memcmp(H.Magic, SAMP_CACHE_MAGIC, sizeof(H.Magic)) == 0) &&
+		(H.Version == SAMP_CACHE_VERSION) &&
+		(H.SampleNum == File.SampleNum()) &&
+		(H.VariantNum == File.VariantNum()) &&
+		(H.Ploidy == File.Ploidy()) && (H.BlockSize > 0) &&
+		(H.BlockSize % 4 == 0) && (H.ExtraNum >= 0);
+}
+
+
+CApply_Sample_Geno::CApply_Sample_Geno(CFileInfo &File): CVarApply()
+{
+	fVarType = ctGenotype;
+	const string &fn = File.SampleCacheFN();
+	if (fn.empty())
+		throw ErrSeqArray("No sample-major genotype file.");
+	fFile = fopen(fn.c_str(), "rb");
+	if (!fFile)
+		throw ErrSeqArray("Fails to open '%s'.", fn.c_str());
+	TSampCacheHeader H;
+	bool ok = samp_read_header(fFile, File, H);
+	if (ok)
+	{
+		// the starts of samples in the side list
+		Ploidy = H.Ploidy;
+		SampNum = H.SampleNum;
+		VarNum = H.VariantNum;
+		BlockSize = H.BlockSize;
+		ExtraOffset = samp_extra_offset(H);
+		ExtraStart.resize(SampNum + 1);
+		ok = (fseek64(fFile, ExtraOffset + H.ExtraNum*sizeof(TSampCacheExtra),
+			SEEK_SET) == 0) && (fread(&ExtraStart[0], sizeof(C_Int64),
+			ExtraStart.size(), fFile) == ExtraStart.size());
+	}
+	if (!ok)
+	{
+		fclose(fFile);
+		throw ErrSeqArray(ERR_SAMP_CACHE_READ);
+	}
+
+	// initialize
+	TSelection &Sel = File.Selection();
+	MarginalSize = File.SampleNum();
+	MarginalSelect = Sel.pSample();
+	VarSel = Sel.pVariant();
+	VarSelNum = File.VariantSelNum();
+	VarNode = NULL;
+	VarStart = 0; VarEnd = File.VariantNum();
+	while ((VarStart < VarEnd) && !VarSel[VarStart]) VarStart ++;
+	while ((VarEnd > VarStart) && !VarSel[VarEnd-1]) VarEnd --;
+	Reset();
+}
+
+CApply_Sample_Geno::~CApply_Sample_Geno()
+{
+	if (fFile) fclose(fFile);
+}
+
+jl_array_t* CApply_Sample_Geno::NeedArray()
+{
+	// (ploidy, variant)
+	if (!VarNode)
+	{
+		jl_value_t *atype = jl_apply_array_type(jl_uint8_type, 2);
+		VarNode = jl_alloc_array_2d(atype, Ploidy, VarSelNum);
+	}
+	return VarNode;
+}
+
+void CApply_Sample_Geno::ReadData(jl_array_t *val)
+{
+	ReadGenoData((C_UInt8*)jl_array_data(val));
+}
+
+void CApply_Sample_Geno::ReadGenoData(C_UInt8 *Base)
+{
+	if (VarStart >= VarEnd) return;
+
+	// the alleles > 1 of the sample
+	const C_Int64 nExtra = ExtraStart[Position+1] - ExtraStart[Position];
+	Extra.resize(nExtra);
+	if (nExtra > 0)
+	{
+		if (fseek64(fFile, ExtraOffset + ExtraStart[Position] *
+				sizeof(TSampCacheExtra), SEEK_SET) != 0)
+			throw ErrSeqArray(ERR_SAMP_CACHE_READ);
+		if (fread(&Extra[0], sizeof(TSampCacheExtra), nExtra, fFile) !=
+				(size_t)nExtra)
+			throw ErrSeqArray(ERR_SAMP_CACHE_READ);
+	}
+	const TSampCacheExtra *pe = Extra.empty() ? NULL : &Extra[0];
+	const TSampCacheExtra *pe_end = pe + nExtra;
+
+	// the bytes of a full block of all samples
+	const C_Int64 BlockBytes = (C_Int64)BlockSize * Ploidy / 4 * SampNum;
+	for (ssize_t v0=VarStart - VarStart % BlockSize; v0 < VarEnd;
+		v0 += BlockSize)
+	{
+		const ssize_t cnt = (v0 + BlockSize <= VarNum) ? BlockSize : VarNum - v0;
+		const C_Int64 row = ((C_Int64)cnt * Ploidy + 3) / 4;
+		// the bytes covering the selected variants in the block
+		const ssize_t i0 = (v0 < VarStart) ? VarStart : v0;
+		const ssize_t i1 = (v0 + cnt < VarEnd) ? v0 + cnt : VarEnd;
+		const C_Int64 b0 = ((C_Int64)(i0 - v0) * Ploidy) >> 2;
+		const C_Int64 b1 = ((C_Int64)(i1 - v0) * Ploidy + 3) >> 2;
+		Buffer.resize(b1 - b0);
+		if (fseek64(fFile, sizeof(TSampCacheHeader) + v0/BlockSize*BlockBytes +
+				Position*row + b0, SEEK_SET) != 0)
+			throw ErrSeqArray(ERR_SAMP_CACHE_READ);
+		if (fread(&Buffer[0], 1, Buffer.size(), fFile) != Buffer.size())
+			throw ErrSeqArray(ERR_SAMP_CACHE_READ);
+
+		const C_UInt8 *s = &Buffer[0] - b0;
+		for (ssize_t i=i0; i < i1; i++)
+		{
+			if (!VarSel[i]) continue;
+			C_Int64 e = (C_Int64)(i - v0) * Ploidy;
+			C_Int64 ge = (C_Int64)i * Ploidy;
+			for (int m=Ploidy; m > 0; m--, e++, ge++)
+			{
+				C_UInt8 g = (s[e >> 2] >> ((e & 0x03) << 1)) & 0x03;
+				if (g == 2)
+				{
+					// look up the side list in the order of entries
+					while ((pe < pe_end) && (pe->Entry < ge)) pe++;
+					if ((pe >= pe_end) || (pe->Entry != ge))
+						throw ErrSeqArray(ERR_SAMP_CACHE_READ);
+					g = pe->Allele;
+				} else if (g == 3)
+					g = NA_UINT8;
+				*Base++ = g;
+			}
+		}
+	}
+}
+
+
+bool CApply_Sample_Geno::Valid(CFileInfo &File, const char *gds_fn,
+	const char *fn)
+{
+	struct stat st;
+	if (stat(gds_fn, &st) != 0) return false;
+	FILE *f = fopen(fn, "rb");
+	if (!f) return false;
+	TSampCacheHeader H;
+	bool rv = samp_read_header(f, File, H) && (H.GDSSize == st.st_size) &&
+		(H.GDSMTime == st.st_mtime);
+	if (rv)
+	{
+		// check the file size
+		rv = (fseek64(f, 0, SEEK_END) == 0);
+		if (rv)
+		{
+		#ifdef _WIN32
+			C_Int64 sz = _ftelli64(f);
+		#else
+			C_Int64 sz = ftello(f);
+		#endif
+			rv = (sz == samp_file_size(H));
+		}
+	}
+	fclose(f);
+	return rv;
+}
+
+
+void CApply_Sample_Geno::Build(CFileInfo &File, const char *gds_fn,
+	const char *fn, bool verbose)
+{
+	struct stat st;
+	if (stat(gds_fn, &st) != 0)
+		throw ErrSeqArray("Fails to get the status of '%s'.", gds_fn);
+
+	TSampCacheHeader H;
+	memset(&H, 0, sizeof(H));
+	memcpy(H.Magic, SAMP_CACHE_MAGIC, sizeof(H.Magic));
+	H.Version = SAMP_CACHE_VERSION;
+	H.SampleNum = File.SampleNum();
+	H.VariantNum = File.VariantNum();
+	H.Ploidy = File.Ploidy();
+	H.GDSSize = st.st_size;
+	H.GDSMTime = st.st_mtime;
+	const ssize_t nSamp = H.SampleNum, nAllele = ssize_t(H.SampleNum) * H.Ploidy;
+	// the number of variants in a block, a multiple of 4 to align 2-bit codes
+	// to bytes, a block of all samples uses about 256MB
+	C_Int64 bsize = (nAllele > 0) ? (C_Int64(1) << 30) / nAllele : 4;
+	C_Int64 bmax = (C_Int64(H.VariantNum) + 3) & ~C_Int64(3);
+	if (bsize > bmax) bsize = bmax;
+	bsize = (bsize < 4) ? 4 : (bsize & ~C_Int64(3));
+	H.BlockSize = bsize;
+
+	// write to a temporary file, and then rename it
+	char pid[64];
+	snprintf(pid, sizeof(pid), ".%d.tmp", (int)getpid());
+	string tmp_fn = string(fn) + pid;
+	FILE *f = fopen(tmp_fn.c_str(), "wb");
+	if (!f)
+		throw ErrSeqArray("Fails to create '%s'.", tmp_fn.c_str());
+
+	// decode all samples and variants
+	list<TSelection> &sl = File.SelList();
+	sl.push_back(TSelection());
+	try {
+		// the header is rewritten with the size of side list
+		if (fwrite(&H, sizeof(H), 1, f) != 1)
+			throw ErrSeqArray(ERR_SAMP_CACHE_WRITE);
+
+		vector<TSampCacheExtra> extra;
+		if ((H.SampleNum > 0) && (H.VariantNum > 0))
+		{
+			vector<C_UInt8> geno(nAllele);
+			vector<C_UInt8> block(samp_row_bytes(H, bsize) * nSamp);
+
+			CApply_Variant_Geno NodeVar(File);
+			const ssize_t NumBlock = (H.VariantNum + bsize - 1) / bsize;
+			CProgressStdOut progress(NumBlock, verbose);
+			for (ssize_t v0=0; v0 < H.VariantNum; v0 += bsize)
+			{
+				const ssize_t cnt = (v0 + bsize <= H.VariantNum) ? bsize :
+					H.VariantNum - v0;
+				const size_t row = samp_row_bytes(H, cnt);
+				memset(&block[0], 0, row * nSamp);
+				// transpose to the rows of samples in 2-bit codes
+				for (ssize_t k=0; k < cnt; k++)
+				{
+					NodeVar.ReadGenoData(&geno[0]);
+					NodeVar.Next();
+					const C_UInt8 *g = &geno[0];
+					for (ssize_t i=0; i < nSamp; i++)
+					{
+						C_UInt8 *r = &block[i * row];
+						C_Int64 e = (C_Int64)k * H.Ploidy;
+						for (int m=0; m < H.Ploidy; m++, e++, g++)
+						{
+							C_UInt8 a = *g;
+							if (a == NA_UINT8)
+								a = 3;
+							else if (a > 1)
+							{
+								TSampCacheExtra v;
+								v.Entry = (C_Int64)(v0 + k) * H.Ploidy + m;
+								v.Sample = i; v.Allele = a;
+								extra.push_back(v);
+								a = 2;
+							}
+							r[e >> 2] |= a << ((e & 0x03) << 1);
+						}
+					}
+				}
+				// one sequential write per block
+				if (fwrite(&block[0], 1, row*nSamp, f) != row*nSamp)
+					throw ErrSeqArray(ERR_SAMP_CACHE_WRITE);
+				progress.Forward();
+			}
+		}
+
+		// the side list sorted by sample, and the starts of samples
+		sort(extra.begin(), extra.end());
+		vector<C_Int64> start(nSamp + 1, 0);
+		for (size_t i=0; i < extra.size(); i++)
+			start[extra[i].Sample + 1] ++;
+		for (ssize_t i=0; i < nSamp; i++)
+			start[i + 1] += start[i];
+		if (!extra.empty())
+		{
+			if (fwrite(&extra[0], sizeof(TSampCacheExtra), extra.size(), f) !=
+					extra.size())
+				throw ErrSeqArray(ERR_SAMP_CACHE_WRITE);
+		}
+		if (fwrite(&start[0], sizeof(C_Int64), start.size(), f) != start.size())
+			throw ErrSeqArray(ERR_SAMP_CACHE_WRITE);
+		H.ExtraNum = extra.size();
+		if ((fseek64(f, 0, SEEK_SET) != 0) || (fwrite(&H, sizeof(H), 1, f) != 1))
+			throw ErrSeqArray(ERR_SAMP_CACHE_WRITE);
+	}
+	catch (...) {
+		sl.pop_back();
+		fclose(f);
+		remove(tmp_fn.c_str());
+		throw;
+	}
+	sl.pop_back();
+
+	bool succeed = (fclose(f) == 0);
+	if (succeed)
+	{
+	#ifdef _WIN32
+		remove(fn);
+	#endif
+		succeed = (rename(tmp_fn.c_str(), fn) == 0);
+	}
+	if (!succeed)
+	{
+		remove(tmp_fn.c_str());
+		throw ErrSeqArray(ERR_SAMP_CACHE_WRITE);
+	}
+}
+
+}
+
+
+extern "C"
+{
+
+using namespace JSeqArray;
+
+// ===========================================================
+// Sample-major genotype file
+// ===========================================================
+
+/// use or create the sample-major genotype file "gds_fn.seqsamp", and
+/// return whether it is used
+COREARRAY_DLL_EXPORT C_BOOL SEQ_File_SampleCache(int file_id,
+	const char *gds_fn, C_BOOL build, C_BOOL verbose)
+{
+	C_BOOL rv = FALSE;
+	COREARRAY_TRY
+		CFileInfo &File = GetFileInfo(file_id);
+		CSeqLock lock(File.Mutex());
+		string fn = string(gds_fn) + ".seqsamp";
+		if (build && !CApply_Sample_Geno::Valid(File, gds_fn, fn.c_str()))
+			CApply_Sample_Geno::Build(File, gds_fn, fn.c_str(), verbose);
+		rv = CApply_Sample_Geno::Valid(File, gds_fn, fn.c_str());
+		File.SetSampleCacheFN(rv ? fn : string());
+	COREARRAY_CATCH
+	return rv;
+}
+
+} // extern "C"
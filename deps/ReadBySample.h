@@ -0,0 +1,104 @@
+// ===========================================================
+//
+// ReadBySample.h: Read data sample by sample
+//
+// Copyright (C) 2017    Xiuwen Zheng
+//
+// This file is part of JSeqArray.
+//
+// JSeqArray is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 3 as
+// published by the Free Software Foundation.
+//
+// JSeqArray is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with JSeqArray.
+// If not, see <http://www.gnu.org/licenses/>.
+
+#include "Index.h"
+#include <cstdio>
+
+
+namespace JSeqArray
+{
+
+using namespace Vectorization;
+
+
+// =====================================================================
+
+/// an allele index > 1 in the sample-major genotype file, which is coded as
+/// 2 in the rows of 2-bit codes and saved in a side list sorted by sample
+struct COREARRAY_DLL_LOCAL TSampCacheExtra
+{
+	C_Int64 Entry;   ///< variant * ploidy + the index in the ploidy
+	C_Int32 Sample;  ///< the sample index
+	C_Int32 Allele;  ///< the allele index
+
+	inline bool operator< (const TSampCacheExtra &v) const
+	{
+		return (Sample < v.Sample) ||
+			((Sample == v.Sample) && (Entry < v.Entry));
+	}
+};
+
+
+/// Object for reading genotypes sample by sample from the sample-major
+/// genotype file "filename.seqsamp", which stores blocks of variants one by
+/// one, and the 2-bit codes of a sample are contiguous in a block
+class COREARRAY_DLL_LOCAL CApply_Sample_Geno: public CVarApply
+{
+public:
+	/// the ratio of total to selected samples for using the sample-major file
+	static const int SELECT_RATIO = 8;
+
+	/// constructor with the sample-major file of File
+	CApply_Sample_Geno(CFileInfo &File);
+	~CApply_Sample_Geno();
+
+	/// return a (ploidy, selected variant) array reused for 'ReadData()'
+	virtual jl_array_t *NeedArray();
+	/// read genotypes of the current sample to the array
+	virtual void ReadData(jl_array_t *val);
+
+	/// read genotypes of the current sample at selected variants, (ploidy, variant)
+	void ReadGenoData(C_UInt8 *Base);
+
+	/// create the sample-major file 'fn' from all samples and variants
+	static void Build(CFileInfo &File, const char *gds_fn, const char *fn,
+		bool verbose);
+	/// return true if 'fn' is a valid sample-major file of the GDS file
+	static bool Valid(CFileInfo &File, const char *gds_fn, const char *fn);
+
+protected:
+	FILE *fFile;         ///< the sample-major file
+	int Ploidy;          ///< ploidy
+	ssize_t SampNum;     ///< the total number of samples
+	ssize_t VarNum;      ///< the total number of variants
+	ssize_t BlockSize;   ///< the number of variants in a block
+	C_Int64 ExtraOffset;        ///< the file offset of the side list
+	vector<C_Int64> ExtraStart; ///< the first entry of each sample in the side list
+	vector<TSampCacheExtra> Extra;  ///< the side list of the current sample
+	C_BOOL *VarSel;      ///< the variant selection
+	ssize_t VarSelNum;   ///< the number of selected variants
+	ssize_t VarStart;    ///< the first selected variant
+	ssize_t VarEnd;      ///< the last selected variant + 1
+	vector<C_UInt8> Buffer;  ///< the bytes of a block row
+	jl_array_t *VarNode;     ///< array object
+};
+
+}
+
+
+extern "C"
+{
+
+/// use or create the sample-major genotype file "gds_fn.seqsamp"
+COREARRAY_DLL_EXPORT C_BOOL SEQ_File_SampleCache(int file_id,
+	const char *gds_fn, C_BOOL build, C_BOOL verbose);
+
+} // extern "C"
@@ -29,6 +29,38 @@ using namespace Vectorization;
 
 static const char *ERR_DIM = "Invalid dimension of '%s'.";
 static const char *ERR_DIM_EX = "Invalid dimension of '%s': %s.";
+static const char *ERR_NUMERIC = "'%s' should be a numeric variable.";
+
+
+// the Julia array type of numeric data, or NULL if not supported
+static jl_value_t *NumericArrayType(C_SVType sv, int ndim)
+{
+	jl_datatype_t *t = NULL;
+	switch (sv)
+	{
+		case svInt8:    t = jl_int8_type;    break;
+		case svUInt8:   t = jl_uint8_type;   break;
+		case svInt16:   t = jl_int16_type;   break;
+		case svUInt16:  t = jl_uint16_type;  break;
+		case svInt32:   t = jl_int32_type;   break;
+		case svUInt32:  t = jl_uint32_type;  break;
+		case svInt64:   t = jl_int64_type;   break;
+		case svUInt64:  t = jl_uint64_type;  break;
+		case svFloat32: t = jl_float32_type; break;
+		case svFloat64: t = jl_float64_type; break;
+		default: return NULL;
+	}
+	return jl_apply_array_type(t, ndim);
+}
+
+// the maximum of values, or 0 if empty
+static int MaxValue(const vector<int> &val)
+{
+	int rv = 0;
+	for (vector<int>::const_iterator it=val.begin(); it != val.end(); it++)
+		if (*it > rv) rv = *it;
+	return rv;
+}
 
 
 // =====================================================================
@@ -69,34 +101,41 @@ jl_array_t* CApply_Variant_Basic::NeedArray(int &nProtected)
 }
 
 
-// ====
+*/
+
+
+// =====================================================================
+// Object for reading positions variant by variant
 
 CApply_Variant_Pos::CApply_Variant_Pos(CFileInfo &File):
 	CApply_Variant(File)
 {
 	fVarType = ctBasic;
 	Node = File.GetObj("position", TRUE);
-	PtrPos = &File.Position()[0];
-	VarNode = NULL;
+	vector<C_Int32> &pos = File.Position();
+	PtrPos = pos.empty() ? NULL : &pos[0];
 	Reset();
 }
 
-void CApply_Variant_Pos::ReadData(jl_array_t* val)
+jl_array_t* CApply_Variant_Pos::NeedArray()
 {
-	INTEGER(val)[0] = PtrPos[Position];
-}
-
-jl_array_t* CApply_Variant_Pos::NeedArray(int &nProtected)
-{
-	if (VarNode == NULL)
+	if (!VarNode)
 	{
-		VarNode = PROTECT(NEW_INTEGER(1));
-		nProtected ++;
+		jl_value_t *atype = jl_apply_array_type(jl_int32_type, 1);
+		VarNode = jl_alloc_array_1d(atype, 1);
 	}
 	return VarNode;
 }
 
-// ====
+void CApply_Variant_Pos::ReadData(jl_array_t *val)
+{
+	C_Int32 *p = (C_Int32*)jl_array_data(val);
+	*p = PtrPos[Position];
+}
+
+
+// =====================================================================
+// Object for reading chromosomes variant by variant
 
 CApply_Variant_Chrom::CApply_Variant_Chrom(CFileInfo &File):
 	CApply_Variant(File)
@@ -104,28 +143,34 @@ CApply_Variant_Chrom::CApply_Variant_Chrom(CFileInfo &File):
 	fVarType = ctBasic;
 	Node = File.GetObj("chromosome", TRUE);
 	ChromIndex = &File.Chromosome();
-	VarNode = NULL;
+	LastCode = 0;
 	Reset();
 }
 
-void CApply_Variant_Chrom::ReadData(jl_array_t* val)
+jl_array_t* CApply_Variant_Chrom::NeedArray()
 {
-	const string &s1 = (*ChromIndex)[Position];
-	const char *s2 = CHAR(STRING_ELT(val, 0));
-	if (s1 != s2)
-		SET_STRING_ELT(val, 0, mkChar(s1.c_str()));
+	if (!VarNode)
+	{
+		jl_value_t *atype = jl_apply_array_type(jl_string_type, 1);
+		VarNode = jl_alloc_array_1d(atype, 1);
+		LastCode = 0;
+	}
+	return VarNode;
 }
 
-jl_array_t* CApply_Variant_Chrom::NeedArray(int &nProtected)
+void CApply_Variant_Chrom::ReadData(jl_array_t *val)
 {
-	if (VarNode == NULL)
+	// a new string object only if the chromosome code changes
+	int code = ChromIndex->RunCodes()[ChromIndex->RunIndex(Position)];
+	if (code != LastCode)
 	{
-		VarNode = PROTECT(mkString(""));
-		nProtected ++;
+		const string &s = ChromIndex->CodeTable()[code - 1];
+		jl_value_t *v = jl_cstr_to_string(s.c_str());
+		void **p = (void**)jl_array_data(val);
+		p[0] = v; jl_gc_wb(val, v);
+		LastCode = code;
 	}
-	return VarNode;
 }
-*/
 
 
 // =====================================================================
@@ -135,6 +180,7 @@ CApply_Variant_Geno::CApply_Variant_Geno(): CApply_Variant()
 {
 	fVarType = ctGenotype;
 	SiteCount = CellCount = 0; SampNum = 0; Ploidy = 0;
+	UseSparse = false;
 	VarIntGeno = VarNode = NULL;
 }
 
@@ -143,6 +189,7 @@ CApply_Variant_Geno::CApply_Variant_Geno(CFileInfo &File):
 {
 	fVarType = ctGenotype;
 	SiteCount = CellCount = 0; SampNum = 0; Ploidy = 0;
+	UseSparse = false;
 	VarIntGeno = VarNode = NULL;
 	Init(File);
 }
@@ -191,38 +238,84 @@ void CApply_Variant_Geno::Init(CFileInfo &File)
 		}
 	}
 
+	// runs of selected entries, used if a few samples are selected
+	SparseRun.clear();
+	for (ssize_t i=0; i < SiteCount; )
+	{
+		if (Selection[i])
+		{
+			ssize_t st = i;
+			while ((i < SiteCount) && Selection[i]) i ++;
+			SparseRun.push_back(st);
+			SparseRun.push_back(i - st);
+		} else
+			i ++;
+	}
+	UseSparse = ((ssize_t)SparseRun.size()/2*SPARSE_RATIO <= SiteCount);
+	if (!UseSparse)
+		vector<C_Int32>().swap(SparseRun);
+
 	ExtPtr.reset(SiteCount);
 	VarIntGeno = VarNode = NULL;
 	Reset();
 }
 
-int CApply_Variant_Geno::_ReadGenoData(int *Base)
+void CApply_Variant_Geno::_ReadPlane(CdIterator &it, C_Int64 Start,
+	void *Buf, C_SVType SV)
+{
+	if (UseSparse)
+	{
+		// seek to each selected run instead of scanning all entries
+		const size_t size = (SV == svInt32) ? sizeof(C_Int32) : sizeof(C_UInt8);
+		C_UInt8 *p = (C_UInt8*)Buf;
+		const C_Int32 *r = SparseRun.empty() ? NULL : &SparseRun[0];
+		for (size_t n=SparseRun.size()/2; n > 0; n--, r+=2)
+		{
+			GDS_Iter_Position(Node, &it, Start + r[0]);
+			GDS_Iter_RData(&it, p, r[1], SV);
+			p += r[1] * size;
+		}
+	} else {
+		GDS_Iter_Position(Node, &it, Start);
+		GDS_Iter_RDataEx(&it, Buf, SiteCount, SV, &Selection[0]);
+	}
+}
+
+int CApply_Variant_Geno::_ReadGenoData(int *Base, bool NA_Replace)
 {
 	C_UInt8 NumIndexRaw;
 	C_Int64 Index;
-	GenoIndex->GetInfo(Position, Index, NumIndexRaw);
+	GenoIndex->GetInfo(Position, Index, NumIndexRaw, GenoCursor);
 
 	if (NumIndexRaw >= 1)
 	{
 		CdIterator it;
-		GDS_Iter_Position(Node, &it, Index*SiteCount);
-		GDS_Iter_RDataEx(&it, Base, SiteCount, svInt32, &Selection[0]);
+		C_Int64 st = Index*SiteCount;
+		_ReadPlane(it, st, Base, svInt32);
 
 		const int bit_mask = 0x03;
 		int missing = bit_mask;
 		for (C_UInt8 i=1; i < NumIndexRaw; i++)
 		{
-			GDS_Iter_RDataEx(&it, ExtPtr.get(), SiteCount, svUInt8, &Selection[0]);
+			st += SiteCount;
+			_ReadPlane(it, st, ExtPtr.get(), svUInt8);
 
 			C_UInt8 shift = i * 2;
 			C_UInt8 *s = (C_UInt8*)ExtPtr.get();
-			int *p = Base;
-			for (ssize_t n=CellCount; n > 0; n--)
-				*p++ |= int(*s++) << shift;
-
 			missing = (missing << 2) | bit_mask;
+
+			// merge the last bit plane and replace missing values in one pass
+			if (NA_Replace && (i == NumIndexRaw-1))
+			{
+				vec_i32_shl_or_u8_replace(Base, s, CellCount, shift, missing,
+					NA_INTEGER);
+				return missing;
+			} else
+				vec_i32_shl_or_u8(Base, s, CellCount, shift);
 		}
 
+		if (NA_Replace)
+			vec_i32_replace(Base, CellCount, missing, NA_INTEGER);
 		return missing;
 	} else {
 		memset(Base, 0, sizeof(int)*CellCount);
@@ -230,17 +323,17 @@ int CApply_Variant_Geno::_ReadGenoData(int *Base)
 	}
 }
 
-C_UInt8 CApply_Variant_Geno::_ReadGenoData(C_UInt8 *Base)
+C_UInt8 CApply_Variant_Geno::_ReadGenoData(C_UInt8 *Base, bool NA_Replace)
 {
 	C_UInt8 NumIndexRaw;
 	C_Int64 Index;
-	GenoIndex->GetInfo(Position, Index, NumIndexRaw);
+	GenoIndex->GetInfo(Position, Index, NumIndexRaw, GenoCursor);
 
 	if (NumIndexRaw >= 1)
 	{
 		CdIterator it;
-		GDS_Iter_Position(Node, &it, Index*SiteCount);
-		GDS_Iter_RDataEx(&it, Base, SiteCount, svUInt8, &Selection[0]);
+		C_Int64 st = Index*SiteCount;
+		_ReadPlane(it, st, Base, svUInt8);
 
 		const C_UInt8 bit_mask = 0x03;
 		C_UInt8 missing = bit_mask;
@@ -248,17 +341,25 @@ C_UInt8 CApply_Variant_Geno::_ReadGenoData(C_UInt8 *Base)
 
 		for (C_UInt8 i=1; i < NumIndexRaw; i++)
 		{
-			GDS_Iter_RDataEx(&it, ExtPtr.get(), SiteCount, svUInt8, &Selection[0]);
+			st += SiteCount;
+			_ReadPlane(it, st, ExtPtr.get(), svUInt8);
 
 			C_UInt8 shift = i * 2;
 			C_UInt8 *s = (C_UInt8*)ExtPtr.get();
-			C_UInt8 *p = Base;
-			for (ssize_t n=CellCount; n > 0; n--)
-				*p++ |= (*s++) << shift;
-
 			missing = (missing << 2) | bit_mask;
+
+			// merge the last bit plane and replace missing values in one pass
+			if (NA_Replace && (i == NumIndexRaw-1))
+			{
+				vec_u8_shl_or_replace(Base, s, CellCount, shift, missing,
+					NA_UINT8);
+				return missing;
+			} else
+				vec_u8_shl_or(Base, s, CellCount, shift);
 		}
 
+		if (NA_Replace)
+			vec_i8_replace((C_Int8*)Base, CellCount, missing, NA_UINT8);
 		return missing;
 	} else {
 		memset(Base, 0, CellCount);
@@ -268,43 +369,59 @@ C_UInt8 CApply_Variant_Geno::_ReadGenoData(C_UInt8 *Base)
 
 void CApply_Variant_Geno::ReadGenoData(int *Base)
 {
-	int missing = _ReadGenoData(Base);
-	vec_i32_replace(Base, CellCount, missing, NA_INTEGER);
+	_ReadGenoData(Base, true);
 }
 
 void CApply_Variant_Geno::ReadGenoData(C_UInt8 *Base)
 {
-	C_UInt8 missing = _ReadGenoData(Base);
-	vec_i8_replace((C_Int8*)Base, CellCount, missing, NA_UINT8);
+	_ReadGenoData(Base, true);
 }
 
-jl_array_t* CApply_Variant_Geno::NeedArray()
+void CApply_Variant_Geno::ReadGenoPacked(C_UInt8 *Base)
 {
-/*	C_UInt8 NumIndexRaw;
+	C_UInt8 NumIndexRaw;
 	C_Int64 Index;
-	GenoIndex->GetInfo(Position, Index, NumIndexRaw);
-	if (NumIndexRaw > 4)
+	GenoIndex->GetInfo(Position, Index, NumIndexRaw, GenoCursor);
+
+	if (NumIndexRaw == 1)
 	{
-		if (!VarIntGeno)
-			VarIntGeno = numpy_new_uint8_mat(SampNum, Ploidy);
-		return VarIntGeno;
-	} else {
-		if (!VarNode)
-			VarNode = numpy_new_int32_mat(SampNum, Ploidy);
-		return VarNode;
+		// the first bit plane has the 2-bit codes with 3 for missing values
+		C_UInt8 *s = (C_UInt8*)ExtPtr.get();
+		CdIterator it;
+		_ReadPlane(it, Index*SiteCount, s, svUInt8);
+		vec_u8_pack_2bits(Base, s, CellCount);
+	} else if (NumIndexRaw > 1)
+	{
+		// 2 for the second or higher alternative alleles, 3 for missing
+		if (!PackPtr.get()) PackPtr.reset(SiteCount);
+		C_UInt8 *s = (C_UInt8*)PackPtr.get();
+		C_UInt8 missing = _ReadGenoData(s, false);
+		for (ssize_t i=0; i < CellCount; i++)
+		{
+			if (s[i] == missing)
+				s[i] = 3;
+			else if (s[i] > 2)
+				s[i] = 2;
+		}
+		vec_u8_pack_2bits(Base, s, CellCount);
+	} else
+		memset(Base, 0, PackedSize());
+}
+
+jl_array_t* CApply_Variant_Geno::NeedArray()
+{
+	// (ploidy, sample)
+	if (!VarNode)
+	{
+		jl_value_t *atype = jl_apply_array_type(jl_uint8_type, 2);
+		VarNode = jl_alloc_array_2d(atype, Ploidy, SampNum);
 	}
-*/
-	return NULL;
+	return VarNode;
 }
 
 void CApply_Variant_Geno::ReadData(jl_array_t *val)
 {
-/*	void *ptr = numpy_getptr(val);
-	if (numpy_is_uint8(val))
-		ReadGenoData((C_UInt8*)val);
-	else
-		ReadGenoData((int*)ptr);
-*/
+	ReadGenoData((C_UInt8*)jl_array_data(val));
 }
 
 
@@ -321,103 +438,208 @@ CApply_Variant_Dosage::CApply_Variant_Dosage(CFileInfo &File):
 
 jl_array_t* CApply_Variant_Dosage::NeedArray()
 {
-/*
-	if (!VarNode) VarNode = numpy_new_uint8(SampNum);
+	if (!VarNode)
+	{
+		jl_value_t *atype = jl_apply_array_type(jl_uint8_type, 1);
+		VarNode = jl_alloc_array_1d(atype, SampNum);
+	}
 	return VarNode;
-*/
-	return NULL;
 }
 
 void CApply_Variant_Dosage::ReadData(jl_array_t *val)
 {
-/*
-	void *ptr = numpy_getptr(val);
-	if (numpy_is_uint8(val))
-		ReadDosage((C_UInt8*)val);
-	else
-		ReadDosage((int*)ptr);
-*/
+	ReadDosage((C_UInt8*)jl_array_data(val));
 }
 
-void CApply_Variant_Dosage::ReadDosage(int *Base)
+C_UInt8 *CApply_Variant_Dosage::_ReadAlleleState(C_UInt8 &missing)
 {
-	int *p = (int *)ExtPtr2.get();
-	int missing = _ReadGenoData(p);
+	C_UInt8 NumIndexRaw;
+	C_Int64 Index;
+	GenoIndex->GetInfo(Position, Index, NumIndexRaw, GenoCursor);
+	C_UInt8 *p = (C_UInt8 *)ExtPtr2.get();
+
+	if (NumIndexRaw == 1)
+	{
+		// the first bit plane, 3 for missing values
+		CdIterator it;
+		_ReadPlane(it, Index*SiteCount, p, svUInt8);
+		missing = 3;
+	} else if (NumIndexRaw > 1)
+	{
+		// a reference allele has zeros in all planes, and a missing value
+		// has 3 in all planes, i.e., OR = 0 and AND = 3 respectively
+		CdIterator it;
+		C_Int64 st = Index*SiteCount;
+		C_UInt8 *s = (C_UInt8*)ExtPtr.get();
+		memset(p, 0x0C, CellCount);
+		for (C_UInt8 i=0; i < NumIndexRaw; i++, st+=SiteCount)
+		{
+			_ReadPlane(it, st, s, svUInt8);
+			vec_u8_fold_planes(p, s, CellCount);
+		}
+		missing = 0x0F;
+	} else {
+		missing = 0x0F;
+		memset(p, missing, CellCount);
+	}
+	return p;
+}
 
+void CApply_Variant_Dosage::_CountDosage(const C_UInt8 *p, C_UInt8 missing,
+	C_UInt8 *Base)
+{
 	// count the number of reference allele
 	if (Ploidy == 2) // diploid
 	{
-		vec_i32_cnt_dosage2(p, Base, SampNum, 0, missing, NA_INTEGER);
+		vec_i8_cnt_dosage2((const int8_t *)p, (int8_t *)Base, SampNum, 0,
+			missing, NA_UINT8);
 	} else {
 		for (int n=SampNum; n > 0; n--)
 		{
-			int cnt = 0;
+			C_UInt8 cnt = 0;
 			for (int m=Ploidy; m > 0; m--, p++)
 			{
 				if (*p == 0)
 				{
-					if (cnt != NA_INTEGER)
+					if (cnt != NA_UINT8)
 						cnt ++;
 				} else if (*p == missing)
-					cnt = NA_INTEGER;
+					cnt = NA_UINT8;
 			}
 			*Base ++ = cnt;
 		}
 	}
 }
 
+void CApply_Variant_Dosage::ReadDosage(int *Base)
+{
+	C_UInt8 missing;
+	C_UInt8 *p = _ReadAlleleState(missing);
+	// ExtPtr2 has sizeof(int)*CellCount bytes, the dosages follow the states
+	C_UInt8 *d = p + CellCount;
+	_CountDosage(p, missing, d);
+	for (ssize_t n=SampNum; n > 0; n--, d++)
+		*Base ++ = (*d != NA_UINT8) ? *d : NA_INTEGER;
+}
+
 void CApply_Variant_Dosage::ReadDosage(C_UInt8 *Base)
 {
+	C_UInt8 missing;
+	C_UInt8 *p = _ReadAlleleState(missing);
+	_CountDosage(p, missing, Base);
+}
+
+void CApply_Variant_Dosage::ReadDosageAlt(C_UInt8 *Base)
+{
+	ReadDosage(Base);
+	// the alleles are either reference or alternative if not missing
+	const C_UInt8 ploidy = Ploidy;
+	for (ssize_t n=SampNum; n > 0; n--, Base++)
+		if (*Base != NA_UINT8) *Base = ploidy - *Base;
+}
+
+void CApply_Variant_Dosage::ReadDosageAllele(C_UInt8 *Base, int NumAllele)
+{
+	if (NumAllele <= 1) return;
+	const ssize_t nAlt = NumAllele - 1;
+	memset(Base, 0, SampNum*nAlt);
 	C_UInt8 *p = (C_UInt8 *)ExtPtr2.get();
-	C_UInt8 missing = _ReadGenoData(p);
+	C_UInt8 missing = _ReadGenoData(p, false);
 
-	// count the number of reference allele
+	// count each alternative allele in one pass over genotypes
+	for (ssize_t i=0; i < SampNum; i++)
+	{
+		bool miss = false;
+		for (int m=Ploidy; m > 0; m--, p++)
+		{
+			if (*p == missing)
+				miss = true;
+			else if ((*p >= 1) && (*p <= nAlt))
+				Base[(*p - 1)*SampNum + i] ++;
+		}
+		if (miss)
+		{
+			for (ssize_t j=0; j < nAlt; j++)
+				Base[j*SampNum + i] = NA_UINT8;
+		}
+	}
+}
+
+void CApply_Variant_Dosage::CountAllele(size_t &nRef, size_t &nMiss)
+{
+	C_UInt8 missing;
+	C_UInt8 *p = _ReadAlleleState(missing);
+	vec_i8_count2((const char*)p, CellCount, 0, missing, &nRef, &nMiss);
+}
+
+void CApply_Variant_Dosage::AddSampleCount(C_Int32 *nRef, C_Int32 *nMiss)
+{
+	C_UInt8 missing;
+	C_UInt8 *p = _ReadAlleleState(missing);
 	if (Ploidy == 2) // diploid
 	{
-		vec_i8_cnt_dosage2((int8_t *)p, (int8_t *)Base, SampNum, 0,
-			missing, NA_UINT8);
+		for (ssize_t i=0; i < SampNum; i++, p+=2)
+		{
+			nRef[i] += (p[0] == 0) + (p[1] == 0);
+			nMiss[i] += (p[0] == missing) + (p[1] == missing);
+		}
 	} else {
-		C_UInt8 *p = (C_UInt8 *)ExtPtr.get();
-		for (int n=SampNum; n > 0; n--)
+		for (ssize_t i=0; i < SampNum; i++)
 		{
-			C_UInt8 cnt = 0;
 			for (int m=Ploidy; m > 0; m--, p++)
 			{
-				if (*p == 0)
-				{
-					if (cnt != NA_UINT8)
-						cnt ++;
-				} else if (*p == missing)
-					cnt = NA_UINT8;
+				nRef[i] += (*p == 0);
+				nMiss[i] += (*p == missing);
 			}
-			*Base ++ = cnt;
+		}
+	}
+}
+
+void CApply_Variant_Dosage::CountGenotype(C_Int32 *Count)
+{
+	C_UInt8 missing;
+	C_UInt8 *p = _ReadAlleleState(missing);
+	// ExtPtr2 has sizeof(int)*CellCount bytes, the dosages follow the states
+	C_UInt8 *d = p + CellCount;
+	_CountDosage(p, missing, d);
+
+	memset(Count, 0, sizeof(C_Int32)*(Ploidy + 2));
+	if (Ploidy == 2) // diploid
+	{
+		size_t n0, n1, n2;
+		vec_i8_count3((const char*)d, SampNum, 0, 1, 2, &n0, &n1, &n2);
+		Count[0] = n0; Count[1] = n1; Count[2] = n2;
+		Count[3] = SampNum - n0 - n1 - n2;
+	} else {
+		for (ssize_t i=0; i < SampNum; i++, d++)
+		{
+			if (*d != NA_UINT8)
+				Count[*d] ++;
+			else
+				Count[Ploidy + 1] ++;
 		}
 	}
 }
 
 
-/*
 // =====================================================================
 // Object for reading phasing information variant by variant
 
-CApply_Variant_Phase::CApply_Variant_Phase():
-	CApply_Variant()
+CApply_Variant_Phase::CApply_Variant_Phase(): CApply_Variant()
 {
 	fVarType = ctPhase;
-	SiteCount = CellCount = 0;
+	SiteCount = CellCount = 0; NumPhase = 0;
 	SampNum = 0; Ploidy = 0;
-	UseRaw = FALSE;
-	VarPhase = NULL;
 }
 
-CApply_Variant_Phase::CApply_Variant_Phase(CFileInfo &File, bool use_raw):
+CApply_Variant_Phase::CApply_Variant_Phase(CFileInfo &File):
 	CApply_Variant()
 {
 	fVarType = ctPhase;
-	Init(File, use_raw);
+	Init(File);
 }
 
-void CApply_Variant_Phase::Init(CFileInfo &File, bool use_raw)
+void CApply_Variant_Phase::Init(CFileInfo &File)
 {
 	static const char *VAR_NAME = "phase/data";
 
@@ -439,8 +661,8 @@ void CApply_Variant_Phase::Init(CFileInfo &File, bool use_raw)
 	SiteCount = ssize_t(DLen[1]) * DLen[2];
 	SampNum = File.SampleSelNum();
 	CellCount = SampNum * DLen[2];
+	NumPhase = DLen[2];
 	Ploidy = File.Ploidy();
-	UseRaw = use_raw;
 
 	// initialize selection
 	Selection.resize(SiteCount);
@@ -457,36 +679,35 @@ void CApply_Variant_Phase::Init(CFileInfo &File, bool use_raw)
 		}
 	}
 
-	VarPhase = NULL;
 	Reset();
 }
 
-void CApply_Variant_Phase::ReadData(jl_array_t* val)
+jl_array_t* CApply_Variant_Phase::NeedArray()
 {
-	CdIterator it;
-	GDS_Iter_Position(Node, &it, ssize_t(Position)*SiteCount);
-	if (UseRaw)
-		GDS_Iter_RDataEx(&it, RAW(val), SiteCount, svInt8, &Selection[0]);
-	else
-		GDS_Iter_RDataEx(&it, INTEGER(val), SiteCount, svInt32, &Selection[0]);
+	// (sample) or (ploidy-1, sample)
+	if (!VarNode)
+	{
+		if (NumPhase > 1)
+		{
+			jl_value_t *atype = jl_apply_array_type(jl_uint8_type, 2);
+			VarNode = jl_alloc_array_2d(atype, NumPhase, SampNum);
+		} else {
+			jl_value_t *atype = jl_apply_array_type(jl_uint8_type, 1);
+			VarNode = jl_alloc_array_1d(atype, SampNum);
+		}
+	}
+	return VarNode;
 }
 
-jl_array_t* CApply_Variant_Phase::NeedArray(int &nProtected)
+void CApply_Variant_Phase::ReadData(jl_array_t *val)
 {
-	if (VarPhase == NULL)
+	if (CellCount > 0)
 	{
-		VarPhase = UseRaw ? NEW_RAW(CellCount) : NEW_INTEGER(CellCount);
-		PROTECT(VarPhase);
-		nProtected ++;
-		if (Ploidy > 2)
-		{
-			jl_array_t* dim = NEW_INTEGER(2);
-			int *p = INTEGER(dim);
-			p[0] = Ploidy-1; p[1] = SampNum;
-			SET_DIM(VarPhase, dim);
-		}
+		CdIterator it;
+		GDS_Iter_Position(Node, &it, C_Int64(Position)*SiteCount);
+		GDS_Iter_RDataEx(&it, jl_array_data(val), SiteCount, svUInt8,
+			&Selection[0]);
 	}
-	return VarPhase;
 }
 
 
@@ -502,70 +723,54 @@ CApply_Variant_Info::CApply_Variant_Info(CFileInfo &File,
 	Node = File.GetObj(var_name, TRUE);
 
 	// check
-	int DimCnt = GDS_Array_DimCnt(Node);
+	DimCnt = GDS_Array_DimCnt(Node);
 	if ((DimCnt != 1) && (DimCnt != 2))
 		throw ErrSeqArray(ERR_DIM, var_name);
+	SVType = GDS_Array_GetSVType(Node);
+	if (!NumericArrayType(SVType, 1))
+		throw ErrSeqArray(ERR_NUMERIC, var_name);
 
 	// initialize
 	C_Int32 DLen[2];
 	GDS_Array_GetDim(Node, DLen, 2);
 	BaseNum = (DimCnt == 2) ? DLen[1] : 1;
 	VarIndex = &File.VarIndex(GDS_PATH_PREFIX(var_name, '@'));
-	SVType = GDS_Array_GetSVType(Node);
+	MaxNumEntry = MaxValue(VarIndex->Values);
+	LastNumEntry = 0;
 
 	Reset();
 }
 
-void CApply_Variant_Info::ReadData(jl_array_t* val)
+jl_array_t* CApply_Variant_Info::NeedArray()
 {
-	C_Int64 IndexRaw;
-	int NumIndexRaw;
-	VarIndex->GetInfo(Position, IndexRaw, NumIndexRaw);
-
-	if (NumIndexRaw > 0)
+	// (entry) or (base, entry) with the maximum number of entries
+	if (!VarNode)
 	{
-		C_Int32 st[2]  = { (C_Int32)IndexRaw, 0 };
-		C_Int32 cnt[2] = { NumIndexRaw, BaseNum };
-
-		if (COREARRAY_SV_INTEGER(SVType))
-		{
-			GDS_Array_ReadData(Node, st, cnt, INTEGER(val), svInt32);
-		} else if (COREARRAY_SV_FLOAT(SVType))
+		if (DimCnt == 2)
 		{
-			GDS_Array_ReadData(Node, st, cnt, REAL(val), svFloat64);
-		} else if (COREARRAY_SV_STRING(SVType))
-		{
-			vector<string> buffer(XLENGTH(val));
-			GDS_Array_ReadData(Node, st, cnt, &buffer[0], svStrUTF8);
-			for (size_t i=0; i < buffer.size(); i++)
-				SET_STRING_ELT(val, i, mkChar(buffer[i].c_str()));
+			VarNode = jl_alloc_array_2d(NumericArrayType(SVType, 2),
+				BaseNum, MaxNumEntry);
+		} else {
+			VarNode = jl_alloc_array_1d(NumericArrayType(SVType, 1),
+				MaxNumEntry);
 		}
 	}
+	return VarNode;
 }
 
-jl_array_t* CApply_Variant_Info::NeedArray(int &nProtected)
+void CApply_Variant_Info::ReadData(jl_array_t *val)
 {
 	C_Int64 IndexRaw;
 	int NumIndexRaw;
-	VarIndex->GetInfo(Position, IndexRaw, NumIndexRaw);
-	if (NumIndexRaw <= 0) return R_NilValue;
+	VarIndex->GetInfo(Position, IndexRaw, NumIndexRaw, IndexCursor);
+	LastNumEntry = NumIndexRaw;
 
-	map<int, jl_array_t*>::iterator it = VarList.find(NumIndexRaw);
-	if (it == VarList.end())
+	if (NumIndexRaw > 0)
 	{
-		jl_array_t* ans = RObject_GDS(Node, BaseNum*NumIndexRaw, nProtected, true);
-		if (BaseNum > 1)
-		{
-			jl_array_t* dim = NEW_INTEGER(2);
-			int *p = INTEGER(dim);
-			p[0] = BaseNum; p[1] = NumIndexRaw;
-			SET_DIM(ans, dim);
-		}
-
-		VarList.insert(pair<int, jl_array_t*>(NumIndexRaw, ans));
-		return ans;
-	} else
-		return it->second;
+		C_Int32 st[2]  = { (C_Int32)IndexRaw, 0 };
+		C_Int32 cnt[2] = { NumIndexRaw, BaseNum };
+		GDS_Array_ReadData(Node, st, cnt, jl_array_data(val), SVType);
+	}
 }
 
 
@@ -576,6 +781,7 @@ jl_array_t* CApply_Variant_Info::NeedArray(int &nProtected)
 CApply_Variant_Format::CApply_Variant_Format(): CApply_Variant()
 {
 	fVarType = ctFormat;
+	MaxNumEntry = LastNumEntry = 0;
 }
 
 CApply_Variant_Format::CApply_Variant_Format(CFileInfo &File,
@@ -604,80 +810,55 @@ void CApply_Variant_Format::Init(CFileInfo &File, const char *var_name)
 	GDS_Array_GetDim(Node, DLen, 2);
 	if (DLen[1] != File.SampleNum())
 		throw ErrSeqArray(ERR_DIM, var_name);
+	SVType = GDS_Array_GetSVType(Node);
+	if (!NumericArrayType(SVType, 2))
+		throw ErrSeqArray(ERR_NUMERIC, var_name);
 
 	// initialize
-	SVType = GDS_Array_GetSVType(Node);
 	MarginalSize = File.VariantNum();
 	MarginalSelect = File.Selection().pVariant();
 	VarIndex = &File.VarIndex(GDS_PATH_PREFIX(var_name, '@'));
 	SampNum = File.SampleSelNum();
 	_TotalSampNum = File.SampleNum();
+	MaxNumEntry = MaxValue(VarIndex->Values);
+	LastNumEntry = 0;
 
-	// initialize selection
+	// initialize selection, a copy of the sample selection
+	C_BOOL *s = File.Selection().pSample();
+	SampSel.assign(s, s + _TotalSampNum);
 	SelPtr[0] = NULL;
-	SelPtr[1] = File.Selection().pSample();
+	SelPtr[1] = SampSel.empty() ? NULL : &SampSel[0];
 
 	Reset();
 }
 
-void CApply_Variant_Format::ReadData(jl_array_t* val)
+jl_array_t* CApply_Variant_Format::NeedArray()
 {
-	C_Int64 IndexRaw;
-	int NumIndexRaw;
-	VarIndex->GetInfo(Position, IndexRaw, NumIndexRaw);
-
-	if (NumIndexRaw > 0)
+	// (sample, entry) with the maximum number of entries
+	if (!VarNode)
 	{
-		C_Int32 st[2]  = { (C_Int32)IndexRaw, 0 };
-		C_Int32 cnt[2] = { NumIndexRaw, (C_Int32)_TotalSampNum };
-		SelPtr[0] = NeedTRUEs(NumIndexRaw);
-
-		if (COREARRAY_SV_INTEGER(SVType))
-		{
-			GDS_Array_ReadDataEx(Node, st, cnt, SelPtr, INTEGER(val), svInt32);
-		} else if (COREARRAY_SV_FLOAT(SVType))
-		{
-			GDS_Array_ReadDataEx(Node, st, cnt, SelPtr, REAL(val), svFloat64);
-		} else if (COREARRAY_SV_STRING(SVType))
-		{
-			vector<string> buffer(XLENGTH(val));
-			GDS_Array_ReadDataEx(Node, st, cnt, SelPtr, &buffer[0], svStrUTF8);
-			for (size_t i=0; i < buffer.size(); i++)
-				SET_STRING_ELT(val, i, mkChar(buffer[i].c_str()));
-		}
+		VarNode = jl_alloc_array_2d(NumericArrayType(SVType, 2),
+			SampNum, MaxNumEntry);
 	}
+	return VarNode;
 }
 
-jl_array_t* CApply_Variant_Format::NeedArray(int &nProtected)
+void CApply_Variant_Format::ReadData(jl_array_t *val)
 {
 	C_Int64 IndexRaw;
 	int NumIndexRaw;
-	VarIndex->GetInfo(Position, IndexRaw, NumIndexRaw);
-	if (NumIndexRaw <= 0) return R_NilValue;
+	VarIndex->GetInfo(Position, IndexRaw, NumIndexRaw, IndexCursor);
+	LastNumEntry = NumIndexRaw;
 
-	map<int, jl_array_t*>::iterator it = VarList.find(NumIndexRaw);
-	if (it == VarList.end())
+	if ((NumIndexRaw > 0) && (SampNum > 0))
 	{
-		jl_array_t* ans = RObject_GDS(Node, SampNum*NumIndexRaw, nProtected, false);
-		jl_array_t* dim = NEW_INTEGER(2);
-		int *p = INTEGER(dim);
-		p[0] = SampNum; p[1] = NumIndexRaw;
-		SET_DIM(ans, dim);
-
-		jl_array_t* name_list = PROTECT(NEW_LIST(2));
-		jl_array_t* tmp = PROTECT(NEW_CHARACTER(2));
-		SET_STRING_ELT(tmp, 0, mkChar("sample"));
-		SET_STRING_ELT(tmp, 1, mkChar("index"));
-		SET_NAMES(name_list, tmp);
-		SET_DIMNAMES(ans, name_list);
-		UNPROTECT(2);
-
-		VarList.insert(pair<int, jl_array_t*>(NumIndexRaw, ans));
-		return ans;
-	} else
-		return it->second;
+		C_Int32 st[2]  = { (C_Int32)IndexRaw, 0 };
+		C_Int32 cnt[2] = { NumIndexRaw, (C_Int32)_TotalSampNum };
+		SelPtr[0] = NeedTRUEs(NumIndexRaw);
+		GDS_Array_ReadDataEx(Node, st, cnt, SelPtr, jl_array_data(val),
+			SVType);
+	}
 }
-*/
 
 
 // =====================================================================
@@ -686,355 +867,199 @@ jl_array_t* CApply_Variant_Format::NeedArray(int &nProtected)
 CApply_Variant_NumAllele::CApply_Variant_NumAllele(CFileInfo &File):
 	CApply_Variant(File)
 {
-	strbuf.reserve(128);
 	fVarType = ctBasic;
 	Node = File.GetObj("allele", TRUE);
+	vector<C_Int32> &num = File.NumAllele();
+	PtrNum = num.empty() ? NULL : &num[0];
 	Reset();
 }
 
 jl_array_t* CApply_Variant_NumAllele::NeedArray()
 {
-/*
-	if (!VarNode) VarNode = numpy_new_int32(1);
+	if (!VarNode)
+	{
+		jl_value_t *atype = jl_apply_array_type(jl_int32_type, 1);
+		VarNode = jl_alloc_array_1d(atype, 1);
+	}
 	return VarNode;
-*/
-	return NULL;
 }
 
 void CApply_Variant_NumAllele::ReadData(jl_array_t *val)
 {
-/*
-	int *p = (int*)numpy_getptr(val);
+	C_Int32 *p = (C_Int32*)jl_array_data(val);
 	*p = GetNumAllele();
-*/
 }
 
-int CApply_Variant_NumAllele::GetNumAllele()
-{
-	C_Int32 st = Position, one = 1;
-	GDS_Array_ReadData(Node, &st, &one, &strbuf, svStrUTF8);
-	return GetNumOfAllele(strbuf.c_str());
-}
 
-}
 
+// =====================================================================
+// Object for iterating over the selected variants
 
-extern "C"
+CVarIter::CVarIter(int file_id, const vector<string> &name_list)
 {
+	FileID = file_id;
+	CFileInfo &File = GetFileInfo(file_id);
+	FileGen = File.Generation();
+	CSeqLock lock(File.Mutex());
 
-/*
-using namespace JSeqArray;
+	for (size_t i=0; i < name_list.size(); i++)
+	{
+		// the path of GDS variable
+		string s = name_list[i];
 
-// ===========================================================
-// Apply functions over margins on a working space
-// ===========================================================
+		if (s == "genotype")
+		{
+			NodeList.push_back(new CApply_Variant_Geno(File));
+		} else if (s == "phase")
+		{
+			NodeList.push_back(new CApply_Variant_Phase(File));
+		} else if ((s == "#dosage") || (s == "$dosage"))
+		{
+			NodeList.push_back(new CApply_Variant_Dosage(File));
+		} else if (s == "position")
+		{
+			NodeList.push_back(new CApply_Variant_Pos(File));
+		} else if (s == "chromosome")
+		{
+			NodeList.push_back(new CApply_Variant_Chrom(File));
+		} else if ((s == "#num_allele") || (s == "$num_allele"))
+		{
+			NodeList.push_back(new CApply_Variant_NumAllele(File));
+		} else if (strncmp(s.c_str(), "annotation/info/", 16) == 0)
+		{
+			GDS_PATH_PREFIX_CHECK(s.c_str());
+			NodeList.push_back(new CApply_Variant_Info(File, s.c_str()));
+		} else if (strncmp(s.c_str(), "annotation/format/", 18) == 0)
+		{
+			GDS_PATH_PREFIX_CHECK(s.c_str());
+			s.append("/data");
+			NodeList.push_back(new CApply_Variant_Format(File, s.c_str()));
+		} else {
+			throw ErrSeqArray(
+				"'%s' is not supported variant by variant, and the standard format:\n"
+				"    genotype, phase, #dosage, position, chromosome, #num_allele,\n"
+				"    annotation/info/VARIABLE_NAME, annotation/format/VARIABLE_NAME",
+				s.c_str());
+		}
+	}
 
-COREARRAY_DLL_LOCAL const char *Txt_Apply_AsIs[] =
+	// the indices of selected variants, the selection could be changed
+	// during iteration
+	const C_BOOL *sel = File.Selection().pVariant();
+	const int n = File.VariantNum();
+	VarIdx.reserve(File.VariantSelNum());
+	for (int i=0; i < n; i++)
+		if (sel[i]) VarIdx.push_back(i);
+}
+
+jl_array_t *CVarIter::NeedArray(size_t i)
 {
-	"none", "list", "integer", "double", "character", "logical",
-	"raw", NULL
-};
+	if (i >= NodeList.size())
+		throw ErrSeqArray("Invalid index of variables.");
+	return NodeList[i]->NeedArray();
+}
 
-COREARRAY_DLL_LOCAL const char *Txt_Apply_VarIdx[] =
+void CVarIter::Read(size_t idx, C_Int32 *num)
 {
-	"none", "relative", "absolute", NULL
-};
+	if (idx >= VarIdx.size())
+		throw ErrSeqArray("Invalid index of selected variants.");
+
+	// the readers refer to the indexing objects and GDS nodes of the file
+	CFileInfo &File = GetFileInfo(FileID);
+	if (File.Generation() != FileGen)
+		throw ErrSeqArray("The GDS file of the iterator has been closed.");
+	CSeqLock lock(File.Mutex());
+	const C_Int32 pos = VarIdx[idx];
+	for (size_t i=0; i < NodeList.size(); i++)
+	{
+		CVarApply *p = NodeList[i];
+		p->Position = pos;
+		p->ReadData(p->NeedArray());
+		num[i] = p->NumEntry();
+	}
+}
 
+}
 
 
-/// Apply functions over margins on a working space
-COREARRAY_DLL_EXPORT jl_array_t* SEQ_Apply_Variant(jl_array_t* gdsfile, jl_array_t* var_name,
-	jl_array_t* FUN, jl_array_t* as_is, jl_array_t* var_index, jl_array_t* param, jl_array_t* rho)
+extern "C"
 {
-	jl_array_t* pam_use_raw = RGetListElement(param, "useraw");
-	if (!Rf_isLogical(pam_use_raw))
-		error("'.useraw' must be TRUE, FALSE or NA.");
-	int use_raw_flag = Rf_asLogical(pam_use_raw);
 
-	int prog_flag = Rf_asLogical(RGetListElement(param, "progress"));
-	if (prog_flag == NA_LOGICAL)
-		error("'.progress' must be TRUE or FALSE.");
+using namespace JSeqArray;
 
-	int dup_flag = Rf_asLogical(RGetListElement(param, "list_dup"));
-	if (dup_flag == NA_LOGICAL)
-		error("'.list_dup' must be TRUE or FALSE.");
+// ===========================================================
+// Apply functions variant by variant
+// ===========================================================
 
+/// create an object iterating over the selected variants, 'name' is a
+/// String or Vector{String}
+COREARRAY_DLL_EXPORT void *SEQ_Apply_Variant_Init(int file_id, jl_value_t *name)
+{
+	void *rv = NULL;
 	COREARRAY_TRY
 
-		// the selection
-		CFileInfo &File = GetFileInfo(gdsfile);
-
-		// the number of calling PROTECT
-		int nProtected = 0;
-
-		// the number of selected variants
-		int nVariant = File.VariantSelNum();
-		if (nVariant <= 0)
-			throw ErrSeqArray("There is no selected variant.");
-
-
-		// ===========================================================
-		// initialize the GDS Node list
-
-		CVarApplyList NodeList;
-
-		// for-loop
-		for (int i=0; i < Rf_length(var_name); i++)
+		// get a list of variable name
+		vector<string> name_list;
+		if (jl_is_string(name))
 		{
-			// the path of GDS variable
-			string s = CHAR(STRING_ELT(var_name, i));
-
-			if (s=="variant.id" || s=="allele" || s=="annotation/id" ||
-				s=="annotation/qual" || s=="annotation/filter")
-			{
-				NodeList.push_back(
-					new CApply_Variant_Basic(File, s.c_str()));
-			} else if (s == "position")
-			{
-				NodeList.push_back(new CApply_Variant_Pos(File));
-			} else if (s == "chromosome")
-			{
-				NodeList.push_back(new CApply_Variant_Chrom(File));
-			} else if (s == "genotype")
-			{
-				NodeList.push_back(
-					new CApply_Variant_Geno(File, use_raw_flag));
-			} else if (s == "phase")
-			{
-				NodeList.push_back(
-					new CApply_Variant_Phase(File, use_raw_flag!=FALSE));
-			} else if (strncmp(s.c_str(), "annotation/info/", 16) == 0)
-			{
-				NodeList.push_back(
-					new CApply_Variant_Info(File, s.c_str()));
-			} else if (strncmp(s.c_str(), "annotation/format/", 18) == 0)
-			{
-				s.append("/data");
-				NodeList.push_back(
-					new CApply_Variant_Format(File, s.c_str()));
-			} else if (s == "$dosage")
-			{
-				NodeList.push_back(
-					new CApply_Variant_Dosage(File, use_raw_flag));
-			} else if (s == "$num_allele")
-			{
-				NodeList.push_back(new CApply_Variant_NumAllele(File));
-			} else {
-				throw ErrSeqArray(
-					"'%s' is not a standard variable name, and the standard format:\n"
-					"    variant.id, position, chromosome, allele, annotation/id, annotation/qual, annotation/filter\n"
-					"    annotation/info/VARIABLE_NAME', annotation/format/VARIABLE_NAME",
-					s.c_str());
-			}
-		}
-
-
-		// ===========================================================
-		// as.is
-
-		Rconnection OutputConn = NULL;
-		PdGDSObj OutputGDS = NULL;
-		int DatType;
-		if (Rf_inherits(as_is, "connection"))
-		{
-			OutputConn = R_GetConnection(as_is);
-			DatType = 7;
-		} else if (Rf_inherits(as_is, "gdsn.class"))
-		{
-			OutputGDS = GDS_R_SEXP2Obj(as_is, FALSE);
-			DatType = 8;
+			// String
+			name_list.push_back(jl_string_ptr(name));
 		} else {
-			DatType = MatchText(CHAR(STRING_ELT(as_is, 0)), Txt_Apply_AsIs);
-			if (DatType < 0)
-				throw ErrSeqArray("'as.is' is not valid!");
+			// Vector{String}
+			size_t n = jl_array_len(name);
+			jl_value_t **p= (jl_value_t**)jl_array_data(name);
+			name_list.resize(n);
+			for (size_t i=0; i < n; i++)
+				name_list[i] = jl_string_ptr(*p++);
 		}
+		if (name_list.empty())
+			throw ErrSeqArray("'name' should be specified.");
 
-		C_Int8 *R_rv_ptr = NULL;
-		switch (DatType)
-		{
-		case 1:
-			rv_ans = PROTECT(NEW_LIST(nVariant)); nProtected ++;
-			break;
-		case 2:
-			rv_ans = PROTECT(NEW_INTEGER(nVariant)); nProtected ++;
-			R_rv_ptr = (C_Int8 *)INTEGER(rv_ans);
-			break;
-		case 3:
-			rv_ans = PROTECT(NEW_NUMERIC(nVariant)); nProtected ++;
-			R_rv_ptr = (C_Int8 *)REAL(rv_ans);
-			break;
-		case 4:
-			rv_ans = PROTECT(NEW_CHARACTER(nVariant)); nProtected ++;
-			break;
-		case 5:
-			rv_ans = PROTECT(NEW_LOGICAL(nVariant)); nProtected ++;
-			R_rv_ptr = (C_Int8 *)LOGICAL(rv_ans);
-			break;
-		case 6:
-			rv_ans = PROTECT(NEW_RAW(nVariant)); nProtected ++;
-			R_rv_ptr = (C_Int8 *)RAW(rv_ans);
-			break;
-		}
+		rv = new CVarIter(file_id, name_list);
 
-		// ===========================================================
-		// rho
-		if (!isEnvironment(rho))
-			throw ErrSeqArray("'rho' should be an environment");
-
-
-		// ===========================================================
-		// initialize calling
-
-		jl_array_t* R_call_param = R_NilValue;
-		if (NodeList.size() > 1)
-		{
-			PROTECT(R_call_param = NEW_LIST(NodeList.size()));
-			nProtected ++;
-			// set name to R_call_param
-			SET_NAMES(R_call_param, GET_NAMES(var_name));
-		}
-
-		// ===============================================================
-		// var.index
-		int VarIdx = MatchText(CHAR(STRING_ELT(var_index, 0)), Txt_Apply_VarIdx);
-		if (VarIdx < 0)
-			throw ErrSeqArray("'var.index' is not valid!");
-
-		jl_array_t* R_fcall;
-		jl_array_t* R_Index = NULL;
-		if (VarIdx > 0)
-		{
-			PROTECT(R_Index = NEW_INTEGER(1));
-			nProtected ++;
-			PROTECT(R_fcall = LCONS(FUN, LCONS(R_Index,
-				LCONS(R_call_param, LCONS(R_DotsSymbol, R_NilValue)))));
-			nProtected ++;
-		} else {
-			PROTECT(R_fcall = LCONS(FUN,
-				LCONS(R_call_param, LCONS(R_DotsSymbol, R_NilValue))));
-			nProtected ++;
-		}
-
-		map<jl_array_t*, jl_array_t*> R_fcall_map;
-		R_fcall_map[R_call_param] = R_fcall;
-
-
-		// ===========================================================
-		// for-loop calling
-
-		CProgressStdOut progress(nVariant, prog_flag);
-
-		int ans_index = 0;
-		do {
-			switch (VarIdx)
-			{
-			case 1:  // relative
-				INTEGER(R_Index)[0] = ans_index + 1; break;
-			case 2:  // absolute
-				INTEGER(R_Index)[0] = NodeList[0]->Position + 1; break;
-			}
-
-			if (NodeList.size() <= 1)
-			{
-				R_call_param = NodeList[0]->NeedArray(nProtected);
-				map<jl_array_t*, jl_array_t*>::iterator it = R_fcall_map.find(R_call_param);
-				if (it == R_fcall_map.end())
-				{
-					if (VarIdx > 0)
-					{
-						PROTECT(R_fcall = LCONS(FUN, LCONS(R_Index,
-							LCONS(R_call_param, LCONS(R_DotsSymbol, R_NilValue)))));
-					} else {
-						PROTECT(R_fcall = LCONS(FUN,
-							LCONS(R_call_param, LCONS(R_DotsSymbol, R_NilValue))));
-					}
-					nProtected ++;
-					R_fcall_map[R_call_param] = R_fcall;
-				} else
-					R_fcall = it->second;
-
-				NodeList[0]->ReadData(R_call_param);
-
-			} else {
-				CVarApply **p = &NodeList[0];
-				size_t n = NodeList.size();
-				for (size_t i=0; i < n; i++, p++)
-				{
-					jl_array_t* tmp = (*p)->NeedArray(nProtected);
-					(*p)->ReadData(tmp);
-					SET_ELEMENT(R_call_param, i, tmp);
-				}
-			}
+	COREARRAY_CATCH
+	return rv;
+}
 
-			// call R function
-			jl_array_t* val = eval(R_fcall, rho);
 
-			// store data
-			switch (DatType)
-			{
-			case 1:  // list
-				if (dup_flag) val = duplicate(val);
-				SET_ELEMENT(rv_ans, ans_index, val);
-				break;
-			case 2:  // integer
-				*((int*)R_rv_ptr) = Rf_asInteger(val);
-				R_rv_ptr += sizeof(int);
-				break;
-			case 3:  // double
-				*((double*)R_rv_ptr) = Rf_asReal(val);
-				R_rv_ptr += sizeof(double);
-				break;
-			case 4:  // character
-				SET_STRING_ELT(rv_ans, ans_index, Rf_asChar(val));
-				break;
-			case 5:  // logical
-				*((int*)R_rv_ptr) = Rf_asLogical(val);
-				R_rv_ptr += sizeof(int);
-				break;
-			case 6:  // raw
-				*R_rv_ptr = Rf_asInteger(val);
-				R_rv_ptr ++;
-				break;
-			case 7:  // connection
-				if (OutputConn->text)
-				{
-					if (Rf_isList(val))
-					{
-						throw ErrSeqArray("the user-defined function should return a character vector.");
-					} else if (!Rf_isString(val))
-					{
-						val = AS_CHARACTER(val);
-					}
-					size_t n = XLENGTH(val);
-					for (size_t i=0; i < n; i++)
-					{
-						ConnPutText(OutputConn, "%s\n", CHAR(STRING_ELT(val, i)));
-					}
-				} else {
-					if (TYPEOF(val) != RAWSXP)
-						throw ErrSeqArray("the user-defined function should return a RAW vector.");
-					size_t n = XLENGTH(val);
-					size_t m = R_WriteConnection(OutputConn, RAW(val), n);
-					if (n != m)
-						throw ErrSeqArray("error in writing to a connection.");
-				}
-				break;
-			case 8:  // gdsn.class
-				RAppendGDS(OutputGDS, val);
-				break;
-			}
-			ans_index ++;
+/// return the array object of the i-th variable (starting from 0), which is
+/// reused in iteration and should be kept by the caller
+COREARRAY_DLL_EXPORT jl_array_t *SEQ_Apply_Variant_Buffer(void *ptr, int i)
+{
+	jl_array_t *rv_ans = NULL;
+	COREARRAY_TRY
+		if (!ptr)
+			throw ErrSeqArray("The iterator has been released.");
+		rv_ans = ((CVarIter*)ptr)->NeedArray(i);
+	COREARRAY_CATCH
+	return rv_ans;
+}
 
-			progress.Forward();
 
-		// check the end
-		} while (NodeList.CallNext());
+/// read the idx-th selected variant (starting from 0) to the array objects,
+/// 'num' is an Int32 vector for the numbers of entries
+COREARRAY_DLL_EXPORT void SEQ_Apply_Variant_Read(void *ptr, C_Int64 idx,
+	jl_array_t *num)
+{
+	COREARRAY_TRY
+		if (!ptr)
+			throw ErrSeqArray("The iterator has been released.");
+		CVarIter *obj = (CVarIter*)ptr;
+		if (jl_array_len(num) != obj->NumVar())
+			throw ErrSeqArray("Invalid length of 'num'.");
+		obj->Read(idx, (C_Int32*)jl_array_data(num));
+	COREARRAY_CATCH
+}
 
-		// finally
-		UNPROTECT(nProtected);
 
-	COREARRAY_CATCH
+/// release the object of iteration
+COREARRAY_DLL_EXPORT void SEQ_Apply_Variant_Done(void *ptr)
+{
+	if (ptr)
+	{
+		CVarIter *obj = (CVarIter*)ptr;
+		delete obj;
+	}
 }
-*/
 
 } // extern "C"
@@ -47,13 +47,12 @@ public:
 class COREARRAY_DLL_LOCAL CApply_Variant_Pos: public CApply_Variant
 {
 protected:
-	int *PtrPos;
-	jl_array_t *VarNode;  ///< R object
+	const C_Int32 *PtrPos;  ///< the cached positions
 public:
 	/// constructor
 	CApply_Variant_Pos(CFileInfo &File);
+	virtual jl_array_t *NeedArray();
 	virtual void ReadData(jl_array_t *val);
-	virtual jl_array_t *NeedArray(int &nProtected);
 };
 
 
@@ -61,13 +60,13 @@ public:
 class COREARRAY_DLL_LOCAL CApply_Variant_Chrom: public CApply_Variant
 {
 protected:
-	CChromIndex *ChromIndex;
-	jl_array_t *VarNode;  ///< R object
+	const CChromIndex *ChromIndex;
+	int LastCode;  ///< the chromosome code in the array object, 0 for none
 public:
 	/// constructor
 	CApply_Variant_Chrom(CFileInfo &File);
+	virtual jl_array_t *NeedArray();
 	virtual void ReadData(jl_array_t *val);
-	virtual jl_array_t *NeedArray(int &nProtected);
 };
 
 
@@ -78,16 +77,28 @@ class COREARRAY_DLL_LOCAL CApply_Variant_Geno: public CApply_Variant
 {
 protected:
 	CGenoIndex *GenoIndex;  ///< indexing genotypes
+	TRunCursor GenoCursor;  ///< the cursor of GenoIndex
 	ssize_t SiteCount;  ///< the total number of entries at a site
 	ssize_t CellCount;  ///< the selected number of entries at a site
 	vector<C_BOOL> Selection;  ///< the buffer of selection
+	vector<C_Int32> SparseRun; ///< (start, length) of selected entries at a site
+	bool UseSparse;            ///< whether gather the selected runs only
 	VEC_AUTO_PTR ExtPtr;       ///< a pointer to the additional buffer
+	VEC_AUTO_PTR PackPtr;      ///< a buffer of multi-allelic genotypes to be packed
 	jl_array_t *VarIntGeno;      ///< genotype R integer object
 
-	inline int _ReadGenoData(int *Base);
-	inline C_UInt8 _ReadGenoData(C_UInt8 *Base);
+	/// read the selected entries of a bit plane starting from 'Start'
+	inline void _ReadPlane(CdIterator &it, C_Int64 Start, void *Buf,
+		C_SVType SV);
+	/// read genotypes, and replace missing values if NA_Replace = true
+	inline int _ReadGenoData(int *Base, bool NA_Replace);
+	/// read genotypes, and replace missing values if NA_Replace = true
+	inline C_UInt8 _ReadGenoData(C_UInt8 *Base, bool NA_Replace);
 
 public:
+	/// the ratio of entries to selected runs for gathering the runs only
+	static const int SPARSE_RATIO = 64;
+
 	ssize_t SampNum;  ///< the number of selected samples
 	int Ploidy;       ///< ploidy
 
@@ -105,6 +116,10 @@ public:
 	void ReadGenoData(int *Base);
 	/// read genotypes in unsigned 8-bit intetger
 	void ReadGenoData(C_UInt8 *Base);
+	/// read genotypes in 2-bit codes, 4 codes per byte
+	void ReadGenoPacked(C_UInt8 *Base);
+	/// the number of bytes of packed genotypes at a site
+	inline ssize_t PackedSize() const { return (CellCount + 3) / 4; }
 };
 
 
@@ -115,6 +130,13 @@ class COREARRAY_DLL_LOCAL CApply_Variant_Dosage: public CApply_Variant_Geno
 {
 protected:
 	VEC_AUTO_PTR ExtPtr2;  ///< a pointer to the additional buffer for dosages
+
+	/// read bit planes to the states of alleles in ExtPtr2 without merging
+	/// genotypes, 0 for reference allele, 'missing' for missing value
+	inline C_UInt8 *_ReadAlleleState(C_UInt8 &missing);
+	/// count the reference alleles from the states of alleles
+	inline void _CountDosage(const C_UInt8 *p, C_UInt8 missing, C_UInt8 *Base);
+
 public:
 	/// constructor
 	CApply_Variant_Dosage(CFileInfo &File);
@@ -126,6 +148,20 @@ public:
 	void ReadDosage(int *Base);
 	/// read dosages in unsigned 8-bit intetger
 	void ReadDosage(C_UInt8 *Base);
+	/// read dosages of all alternative alleles in unsigned 8-bit intetger
+	void ReadDosageAlt(C_UInt8 *Base);
+	/// read dosages of each alternative allele, 'Base' is a (sample, allele)
+	/// matrix with 'NumAllele'-1 columns
+	void ReadDosageAllele(C_UInt8 *Base, int NumAllele);
+
+	/// count reference alleles and missing values at a site
+	void CountAllele(size_t &nRef, size_t &nMiss);
+	/// add the numbers of reference alleles and missing values at a site to
+	/// the counters of samples
+	void AddSampleCount(C_Int32 *nRef, C_Int32 *nMiss);
+	/// count samples with 0, 1, ..., ploidy reference alleles, and missing
+	/// values at a site, 'Count' has ploidy+2 entries
+	void CountGenotype(C_Int32 *Count);
 };
 
 
@@ -137,9 +173,8 @@ class COREARRAY_DLL_LOCAL CApply_Variant_Phase: public CApply_Variant
 protected:
 	ssize_t SiteCount;  ///< the total number of entries at a site
 	ssize_t CellCount;  ///< the selected number of entries at a site
-	bool UseRaw;  ///< whether use RAW type
+	int NumPhase;       ///< the number of entries of a sample
 	vector<C_BOOL> Selection;  ///< the buffer of selection
-	jl_array_t *VarPhase;  ///< genotype R object
 
 public:
 	ssize_t SampNum;  ///< the number of selected samples
@@ -147,12 +182,12 @@ public:
 
 	/// constructor
 	CApply_Variant_Phase();
-	CApply_Variant_Phase(CFileInfo &File, bool use_raw);
+	CApply_Variant_Phase(CFileInfo &File);
 
-	void Init(CFileInfo &File, bool use_raw);
+	void Init(CFileInfo &File);
 
+	virtual jl_array_t *NeedArray();
 	virtual void ReadData(jl_array_t *val);
-	virtual jl_array_t *NeedArray(int &nProtected);
 };
 
 
@@ -163,16 +198,20 @@ class COREARRAY_DLL_LOCAL CApply_Variant_Info: public CApply_Variant
 {
 protected:
 	CIndex *VarIndex;  ///< indexing the format variable
+	TRunCursor IndexCursor;  ///< the cursor of VarIndex
 	C_SVType SVType;        ///< data type for GDS reading
+	int DimCnt;             ///< the number of dimensions
 	C_Int32 BaseNum;        ///< if 2-dim, the size of the first dimension
-	map<int, jl_array_t*> VarList;  ///< a list of jl_array_t variables
+	int MaxNumEntry;        ///< the maximum number of entries per variant
+	int LastNumEntry;       ///< the number of entries in the last reading
 
 public:
 	/// constructor
 	CApply_Variant_Info(CFileInfo &File, const char *var_name);
 
+	virtual jl_array_t *NeedArray();
 	virtual void ReadData(jl_array_t *val);
-	virtual jl_array_t *NeedArray(int &nProtected);
+	virtual int NumEntry() const { return LastNumEntry; }
 };
 
 
@@ -183,11 +222,14 @@ class COREARRAY_DLL_LOCAL CApply_Variant_Format: public CApply_Variant
 {
 protected:
 	CIndex *VarIndex;  ///< indexing the format variable
+	TRunCursor IndexCursor;  ///< the cursor of VarIndex
 	ssize_t _TotalSampNum;  ///< the total number of samples
 
 	C_SVType SVType;        ///< data type for GDS reading
 	C_BOOL *SelPtr[2];      ///< pointers to selection
-	map<int, jl_array_t*> VarList;  ///< a list of jl_array_t variables
+	vector<C_BOOL> SampSel; ///< the sample selection
+	int MaxNumEntry;        ///< the maximum number of entries per variant
+	int LastNumEntry;       ///< the number of entries in the last reading
 
 public:
 	ssize_t SampNum;  ///< the number of selected samples
@@ -198,8 +240,9 @@ public:
 
 	void Init(CFileInfo &File, const char *var_name);
 
+	virtual jl_array_t *NeedArray();
 	virtual void ReadData(jl_array_t *val);
-	virtual jl_array_t *NeedArray(int &nProtected);
+	virtual int NumEntry() const { return LastNumEntry; }
 };
 
 
@@ -209,14 +252,44 @@ public:
 class COREARRAY_DLL_LOCAL CApply_Variant_NumAllele: public CApply_Variant
 {
 private:
-	string strbuf;
+	const C_Int32 *PtrNum;  ///< the cached numbers of alleles
 public:
 	/// constructor
 	CApply_Variant_NumAllele(CFileInfo &File);
 
 	virtual jl_array_t *NeedArray();
 	virtual void ReadData(jl_array_t *val);
-	int GetNumAllele();
+	inline int GetNumAllele() const { return PtrNum[Position]; }
+};
+
+
+// =====================================================================
+
+/// Object for iterating over the selected variants, the data of a variant
+/// are read to the arrays allocated once by 'NeedArray()'; the object is
+/// invalid after the file is closed, even if the file ID is reused
+class COREARRAY_DLL_LOCAL CVarIter
+{
+public:
+	/// constructor with a list of variable names
+	CVarIter(int file_id, const vector<string> &name_list);
+
+	/// the number of selected variants
+	inline size_t Count() const { return VarIdx.size(); }
+	/// the number of variables
+	inline size_t NumVar() const { return NodeList.size(); }
+
+	/// return the array object of the i-th variable, reused in 'Read()'
+	jl_array_t *NeedArray(size_t i);
+	/// read the idx-th selected variant to the array objects, and save the
+	/// numbers of entries to 'num' (-1 if the array is always filled)
+	void Read(size_t idx, C_Int32 *num);
+
+protected:
+	int FileID;              ///< the file ID
+	C_Int64 FileGen;         ///< the generation of the file when created
+	CVarApplyList NodeList;  ///< the list of variables
+	vector<C_Int32> VarIdx;  ///< the indices of selected variants
 };
 
 }
@@ -225,8 +298,14 @@ public:
 extern "C"
 {
 
-/// Apply functions over margins on a working space
-COREARRAY_DLL_EXPORT jl_array_t *SEQ_Apply_Variant(jl_array_t *gdsfile, jl_array_t *var_name,
-	jl_array_t *FUN, jl_array_t *as_is, jl_array_t *var_index, jl_array_t *param, jl_array_t *rho);
+/// create an object iterating over the selected variants
+COREARRAY_DLL_EXPORT void *SEQ_Apply_Variant_Init(int file_id, jl_value_t *name);
+/// return the array object of the i-th variable, reused in iteration
+COREARRAY_DLL_EXPORT jl_array_t *SEQ_Apply_Variant_Buffer(void *ptr, int i);
+/// read the idx-th selected variant to the array objects
+COREARRAY_DLL_EXPORT void SEQ_Apply_Variant_Read(void *ptr, C_Int64 idx,
+	jl_array_t *num);
+/// release the object of iteration
+COREARRAY_DLL_EXPORT void SEQ_Apply_Variant_Done(void *ptr);
 
 } // extern "C"
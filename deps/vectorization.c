@@ -220,6 +220,125 @@ const int8_t *vec_i8_cnt_nonzero_ptr(const int8_t *p, size_t n, size_t *out_n)
 }
 
 
+/// pack non-zeros to bits, the i-th bit of out is set if p[i] is non-zero
+void vec_i8_pack_nonzero(uint64_t *out, const int8_t *p, size_t n)
+{
+#ifdef COREARRAY_SIMD_SSE2
+
+#   ifdef COREARRAY_SIMD_AVX2
+
+	const __m256i ZERO2 = _mm256_setzero_si256();
+	for (; n >= 64; n-=64, p+=64)
+	{
+		__m256i v1 = _mm256_cmpeq_epi8(
+			_mm256_loadu_si256((__m256i const*)p), ZERO2);
+		__m256i v2 = _mm256_cmpeq_epi8(
+			_mm256_loadu_si256((__m256i const*)(p+32)), ZERO2);
+		uint64_t b = (uint32_t)_mm256_movemask_epi8(v1) |
+			((uint64_t)(uint32_t)_mm256_movemask_epi8(v2) << 32);
+		*out++ = ~b;
+	}
+
+#   endif
+
+	const __m128i ZERO = _mm_setzero_si128();
+	for (; n >= 64; n-=64, p+=64)
+	{
+		uint64_t b1 = _mm_movemask_epi8(_mm_cmpeq_epi8(
+			_mm_loadu_si128((__m128i const*)p), ZERO));
+		uint64_t b2 = _mm_movemask_epi8(_mm_cmpeq_epi8(
+			_mm_loadu_si128((__m128i const*)(p+16)), ZERO));
+		uint64_t b3 = _mm_movemask_epi8(_mm_cmpeq_epi8(
+			_mm_loadu_si128((__m128i const*)(p+32)), ZERO));
+		uint64_t b4 = _mm_movemask_epi8(_mm_cmpeq_epi8(
+			_mm_loadu_si128((__m128i const*)(p+48)), ZERO));
+		*out++ = ~(b1 | (b2 << 16) | (b3 << 32) | (b4 << 48));
+	}
+
+#endif
+
+	// tail
+	for (; n >= 64; n-=64)
+	{
+		uint64_t b = 0;
+		for (int i=0; i < 64; i++)
+			if (*p++) b |= ((uint64_t)1) << i;
+		*out++ = b;
+	}
+	if (n > 0)
+	{
+		uint64_t b = 0;
+		for (size_t i=0; i < n; i++)
+			if (*p++) b |= ((uint64_t)1) << i;
+		*out = b;
+	}
+}
+
+
+/// unpack bits to bytes, p[i] is set to 1 if the i-th bit of s is set
+void vec_i8_unpack_bits(int8_t *p, const uint64_t *s, size_t n)
+{
+	for (; n >= 64; n-=64)
+	{
+		uint64_t b = *s++;
+		for (int i=0; i < 64; i++, b >>= 1)
+			*p++ = b & 0x01;
+	}
+	if (n > 0)
+	{
+		uint64_t b = *s;
+		for (; n > 0; n--, b >>= 1)
+			*p++ = b & 0x01;
+	}
+}
+
+
+/// pack 2-bit values to bytes, 4 values per byte from the lowest bits,
+/// only the lowest 2 bits of p[i] are used
+void vec_u8_pack_2bits(uint8_t *out, const uint8_t *p, size_t n)
+{
+#ifdef COREARRAY_SIMD_SSE2
+
+	const __m128i MASK2 = _mm_set1_epi8(0x03);
+	const __m128i MASK8 = _mm_set1_epi32(0xFF);
+	for (; n >= 64; n-=64, p+=64, out+=16)
+	{
+		// b0 | b1<<2 | b2<<4 | b3<<6 in the lowest byte of each 32-bit word
+		__m128i v1 = _mm_and_si128(_mm_loadu_si128((__m128i const*)p), MASK2);
+		__m128i v2 = _mm_and_si128(_mm_loadu_si128((__m128i const*)(p+16)), MASK2);
+		__m128i v3 = _mm_and_si128(_mm_loadu_si128((__m128i const*)(p+32)), MASK2);
+		__m128i v4 = _mm_and_si128(_mm_loadu_si128((__m128i const*)(p+48)), MASK2);
+		v1 = _mm_or_si128(v1, _mm_srli_epi32(v1, 6));
+		v2 = _mm_or_si128(v2, _mm_srli_epi32(v2, 6));
+		v3 = _mm_or_si128(v3, _mm_srli_epi32(v3, 6));
+		v4 = _mm_or_si128(v4, _mm_srli_epi32(v4, 6));
+		v1 = _mm_and_si128(_mm_or_si128(v1, _mm_srli_epi32(v1, 12)), MASK8);
+		v2 = _mm_and_si128(_mm_or_si128(v2, _mm_srli_epi32(v2, 12)), MASK8);
+		v3 = _mm_and_si128(_mm_or_si128(v3, _mm_srli_epi32(v3, 12)), MASK8);
+		v4 = _mm_and_si128(_mm_or_si128(v4, _mm_srli_epi32(v4, 12)), MASK8);
+		// gather the lowest bytes
+		_mm_storeu_si128((__m128i*)out, _mm_packus_epi16(
+			_mm_packs_epi32(v1, v2), _mm_packs_epi32(v3, v4)));
+	}
+
+#endif
+
+	// tail
+	for (; n >= 4; n-=4, p+=4)
+	{
+		*out++ = (p[0] & 0x03) | ((p[1] & 0x03) << 2) |
+			((p[2] & 0x03) << 4) | ((p[3] & 0x03) << 6);
+	}
+	if (n > 0)
+	{
+		uint8_t b = 0;
+		for (size_t i=0; i < n; i++)
+			b |= (p[i] & 0x03) << (i*2);
+		*out = b;
+	}
+}
+
+
 
 // ===========================================================
 // functions for int8
@@ -789,6 +908,165 @@ void vec_u8_shr_b2(uint8_t *p, size_t n)
 }
 
 
+/// p[i] |= s[i] << shift, assuming s[i] < 4
+void vec_u8_shl_or(uint8_t *p, const uint8_t *s, size_t n, uint8_t shift)
+{
+#ifdef COREARRAY_SIMD_SSE2
+
+	// header 1, 16-byte aligned
+	size_t h = (16 - ((size_t)p & 0x0F)) & 0x0F;
+	for (; (n > 0) && (h > 0); n--, h--)
+		*p++ |= (*s++) << shift;
+
+	// body, SSE2
+	const __m128i sh = _mm_cvtsi32_si128(shift);
+	const __m128i mask = _mm_set1_epi8((uint8_t)(0xFF << shift));
+
+#   ifdef COREARRAY_SIMD_AVX2
+
+	// header 2, 32-byte aligned
+	if ((n >= 16) && ((size_t)p & 0x10))
+	{
+		__m128i v = _mm_and_si128(_mm_sll_epi16(MM_LOADU_128(s), sh), mask);
+		__m128i w = _mm_load_si128((__m128i const*)p);
+		_mm_store_si128((__m128i *)p, _mm_or_si128(w, v));
+		n -= 16; p += 16; s += 16;
+	}
+
+	// body, AVX2
+	const __m256i mask2 = _mm256_set1_epi8((uint8_t)(0xFF << shift));
+
+	for (; n >= 32; n-=32, p+=32, s+=32)
+	{
+		__m256i v = _mm256_and_si256(_mm256_sll_epi16(MM_LOADU_256(s), sh), mask2);
+		__m256i w = _mm256_load_si256((__m256i const*)p);
+		_mm256_store_si256((__m256i *)p, _mm256_or_si256(w, v));
+	}
+
+#   endif
+
+	for (; n >= 16; n-=16, p+=16, s+=16)
+	{
+		__m128i v = _mm_and_si128(_mm_sll_epi16(MM_LOADU_128(s), sh), mask);
+		__m128i w = _mm_load_si128((__m128i const*)p);
+		_mm_store_si128((__m128i *)p, _mm_or_si128(w, v));
+	}
+
+#endif
+
+	// tail
+	for (; n > 0; n--) *p++ |= (*s++) << shift;
+}
+
+
+/// p[i] |= s[i] << shift, and then replace 'val' by 'substitute', assuming s[i] < 4
+void vec_u8_shl_or_replace(uint8_t *p, const uint8_t *s, size_t n,
+	uint8_t shift, uint8_t val, uint8_t substitute)
+{
+#ifdef COREARRAY_SIMD_SSE2
+
+	// header 1, 16-byte aligned
+	size_t h = (16 - ((size_t)p & 0x0F)) & 0x0F;
+	for (; (n > 0) && (h > 0); n--, h--, p++)
+	{
+		uint8_t v = *p | ((*s++) << shift);
+		*p = (v == val) ? substitute : v;
+	}
+
+	// body, SSE2
+	const __m128i sh   = _mm_cvtsi32_si128(shift);
+	const __m128i mask = _mm_set1_epi8((uint8_t)(0xFF << shift));
+	const __m128i val16 = _mm_set1_epi8(val);
+	const __m128i sub16 = _mm_set1_epi8(substitute);
+
+#   ifdef COREARRAY_SIMD_AVX2
+
+	// header 2, 32-byte aligned
+	if ((n >= 16) && ((size_t)p & 0x10))
+	{
+		__m128i v = _mm_and_si128(_mm_sll_epi16(MM_LOADU_128(s), sh), mask);
+		v = _mm_or_si128(_mm_load_si128((__m128i const*)p), v);
+		__m128i c = _mm_cmpeq_epi8(v, val16);
+		_mm_store_si128((__m128i *)p, MM_BLEND_128(sub16, v, c));
+		n -= 16; p += 16; s += 16;
+	}
+
+	// body, AVX2
+	const __m256i mask2 = _mm256_set1_epi8((uint8_t)(0xFF << shift));
+	const __m256i val32 = _mm256_set1_epi8(val);
+	const __m256i sub32 = _mm256_set1_epi8(substitute);
+
+	for (; n >= 32; n-=32, p+=32, s+=32)
+	{
+		__m256i v = _mm256_and_si256(_mm256_sll_epi16(MM_LOADU_256(s), sh), mask2);
+		v = _mm256_or_si256(_mm256_load_si256((__m256i const*)p), v);
+		__m256i c = _mm256_cmpeq_epi8(v, val32);
+		_mm256_store_si256((__m256i *)p, MM_BLEND_256(sub32, v, c));
+	}
+
+#   endif
+
+	for (; n >= 16; n-=16, p+=16, s+=16)
+	{
+		__m128i v = _mm_and_si128(_mm_sll_epi16(MM_LOADU_128(s), sh), mask);
+		v = _mm_or_si128(_mm_load_si128((__m128i const*)p), v);
+		__m128i c = _mm_cmpeq_epi8(v, val16);
+		_mm_store_si128((__m128i *)p, MM_BLEND_128(sub16, v, c));
+	}
+
+#endif
+
+	// tail
+	for (; n > 0; n--, p++)
+	{
+		uint8_t v = *p | ((*s++) << shift);
+		*p = (v == val) ? substitute : v;
+	}
+}
+
+
+/// p[i] = (p[i] | s[i]) & (0x03 | (s[i] << 2)), folding a bit plane of
+/// genotypes to the states of OR (bits 0-1) and AND (bits 2-3) of planes
+void vec_u8_fold_planes(uint8_t *p, const uint8_t *s, size_t n)
+{
+#ifdef COREARRAY_SIMD_SSE2
+
+	const __m128i mask2 = _mm_set1_epi8(0x03);
+
+#   ifdef COREARRAY_SIMD_AVX2
+
+	const __m256i mask3 = _mm256_set1_epi8(0x03);
+	for (; n >= 32; n-=32, p+=32, s+=32)
+	{
+		__m256i v = _mm256_and_si256(MM_LOADU_256(s), mask3);
+		__m256i w = _mm256_loadu_si256((__m256i const*)p);
+		w = _mm256_and_si256(_mm256_or_si256(w, v),
+			_mm256_or_si256(mask3, _mm256_slli_epi16(v, 2)));
+		_mm256_storeu_si256((__m256i *)p, w);
+	}
+
+#   endif
+
+	for (; n >= 16; n-=16, p+=16, s+=16)
+	{
+		__m128i v = _mm_and_si128(MM_LOADU_128(s), mask2);
+		__m128i w = _mm_loadu_si128((__m128i const*)p);
+		w = _mm_and_si128(_mm_or_si128(w, v),
+			_mm_or_si128(mask2, _mm_slli_epi16(v, 2)));
+		_mm_storeu_si128((__m128i *)p, w);
+	}
+
+#endif
+
+	// tail
+	for (; n > 0; n--, p++)
+	{
+		uint8_t v = (*s++) & 0x03;
+		*p = (*p | v) & (0x03 | (v << 2));
+	}
+}
+
+
 
 // ===========================================================
 // functions for int16
@@ -1346,6 +1624,190 @@ void vec_i32_shr_b2(int32_t *p, size_t n)
 }
 
 
+/// p[i] |= s[i] << shift, assuming p is 4-byte aligned
+void vec_i32_shl_or_u8(int32_t *p, const uint8_t *s, size_t n, uint8_t shift)
+{
+#ifdef COREARRAY_SIMD_SSE2
+
+	// header 1, 16-byte aligned
+	size_t h = ((16 - ((size_t)p & 0x0F)) & 0x0F) >> 2;
+	for (; (n > 0) && (h > 0); n--, h--)
+		*p++ |= (int32_t)(*s++) << shift;
+
+	// body, SSE2
+	const __m128i sh = _mm_cvtsi32_si128(shift);
+	const __m128i zero = _mm_setzero_si128();
+
+#   ifdef COREARRAY_SIMD_AVX2
+
+	// header 2, 32-byte aligned
+	if ((n >= 4) && ((size_t)p & 0x10))
+	{
+		__m128i v = _mm_cvtsi32_si128(*((const int32_t*)s));
+		v = _mm_unpacklo_epi16(_mm_unpacklo_epi8(v, zero), zero);
+		__m128i w = _mm_load_si128((__m128i const*)p);
+		_mm_store_si128((__m128i *)p, _mm_or_si128(w, _mm_sll_epi32(v, sh)));
+		n -= 4; p += 4; s += 4;
+	}
+
+	// body, AVX2
+	for (; n >= 8; n-=8, p+=8, s+=8)
+	{
+		__m256i v = _mm256_cvtepu8_epi32(_mm_loadl_epi64((__m128i const*)s));
+		__m256i w = _mm256_load_si256((__m256i const*)p);
+		_mm256_store_si256((__m256i *)p, _mm256_or_si256(w, _mm256_sll_epi32(v, sh)));
+	}
+
+#   endif
+
+	for (; n >= 16; n-=16, s+=16)
+	{
+		__m128i b  = MM_LOADU_128(s);
+		__m128i lo = _mm_unpacklo_epi8(b, zero);
+		__m128i hi = _mm_unpackhi_epi8(b, zero);
+		__m128i v, w;
+
+		v = _mm_sll_epi32(_mm_unpacklo_epi16(lo, zero), sh);
+		w = _mm_load_si128((__m128i const*)p);
+		_mm_store_si128((__m128i *)p, _mm_or_si128(w, v));
+		p += 4;
+
+		v = _mm_sll_epi32(_mm_unpackhi_epi16(lo, zero), sh);
+		w = _mm_load_si128((__m128i const*)p);
+		_mm_store_si128((__m128i *)p, _mm_or_si128(w, v));
+		p += 4;
+
+		v = _mm_sll_epi32(_mm_unpacklo_epi16(hi, zero), sh);
+		w = _mm_load_si128((__m128i const*)p);
+		_mm_store_si128((__m128i *)p, _mm_or_si128(w, v));
+		p += 4;
+
+		v = _mm_sll_epi32(_mm_unpackhi_epi16(hi, zero), sh);
+		w = _mm_load_si128((__m128i const*)p);
+		_mm_store_si128((__m128i *)p, _mm_or_si128(w, v));
+		p += 4;
+	}
+
+#endif
+
+	// tail
+	for (; n > 0; n--) *p++ |= (int32_t)(*s++) << shift;
+}
+
+
+/// p[i] |= s[i] << shift, and then replace 'val' by 'substitute', assuming p is 4-byte aligned
+void vec_i32_shl_or_u8_replace(int32_t *p, const uint8_t *s, size_t n,
+	uint8_t shift, int32_t val, int32_t substitute)
+{
+#ifdef COREARRAY_SIMD_SSE2
+
+	// header 1, 16-byte aligned
+	size_t h = ((16 - ((size_t)p & 0x0F)) & 0x0F) >> 2;
+	for (; (n > 0) && (h > 0); n--, h--, p++)
+	{
+		int32_t v = *p | ((int32_t)(*s++) << shift);
+		*p = (v == val) ? substitute : v;
+	}
+
+	// body, SSE2
+	const __m128i sh = _mm_cvtsi32_si128(shift);
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i val4 = _mm_set1_epi32(val);
+	const __m128i sub4 = _mm_set1_epi32(substitute);
+
+#   ifdef COREARRAY_SIMD_AVX2
+
+	// header 2, 32-byte aligned
+	if ((n >= 4) && ((size_t)p & 0x10))
+	{
+		__m128i v = _mm_cvtsi32_si128(*((const int32_t*)s));
+		v = _mm_unpacklo_epi16(_mm_unpacklo_epi8(v, zero), zero);
+		v = _mm_or_si128(_mm_load_si128((__m128i const*)p), _mm_sll_epi32(v, sh));
+		__m128i c = _mm_cmpeq_epi32(v, val4);
+		_mm_store_si128((__m128i *)p, MM_BLEND_128(sub4, v, c));
+		n -= 4; p += 4; s += 4;
+	}
+
+	// body, AVX2
+	const __m256i val8 = _mm256_set1_epi32(val);
+	const __m256i sub8 = _mm256_set1_epi32(substitute);
+
+	for (; n >= 8; n-=8, p+=8, s+=8)
+	{
+		__m256i v = _mm256_cvtepu8_epi32(_mm_loadl_epi64((__m128i const*)s));
+		v = _mm256_or_si256(_mm256_load_si256((__m256i const*)p),
+			_mm256_sll_epi32(v, sh));
+		__m256i c = _mm256_cmpeq_epi32(v, val8);
+		_mm256_store_si256((__m256i *)p, MM_BLEND_256(sub8, v, c));
+	}
+
+#   endif
+
+	for (; n >= 4; n-=4, p+=4, s+=4)
+	{
+		__m128i v = _mm_cvtsi32_si128(*((const int32_t*)s));
+		v = _mm_unpacklo_epi16(_mm_unpacklo_epi8(v, zero), zero);
+		v = _mm_or_si128(_mm_load_si128((__m128i const*)p), _mm_sll_epi32(v, sh));
+		__m128i c = _mm_cmpeq_epi32(v, val4);
+		_mm_store_si128((__m128i *)p, MM_BLEND_128(sub4, v, c));
+	}
+
+#endif
+
+	// tail
+	for (; n > 0; n--, p++)
+	{
+		int32_t v = *p | ((int32_t)(*s++) << shift);
+		*p = (v == val) ? substitute : v;
+	}
+}
+
+
+
+// ===========================================================
+// functions for float64
+// ===========================================================
+
+double vec_f64_dot(const double *x, const double *y, size_t n)
+{
+	double sum = 0;
+
+#ifdef COREARRAY_SIMD_SSE2
+
+#   ifdef COREARRAY_SIMD_AVX
+
+	__m256d s1 = _mm256_setzero_pd(), s2 = _mm256_setzero_pd();
+	for (; n >= 8; n-=8, x+=8, y+=8)
+	{
+		s1 = _mm256_add_pd(s1, _mm256_mul_pd(_mm256_loadu_pd(x),
+			_mm256_loadu_pd(y)));
+		s2 = _mm256_add_pd(s2, _mm256_mul_pd(_mm256_loadu_pd(x+4),
+			_mm256_loadu_pd(y+4)));
+	}
+	s1 = _mm256_add_pd(s1, s2);
+	__m128d v = _mm_add_pd(_mm256_castpd256_pd128(s1),
+		_mm256_extractf128_pd(s1, 1));
+	sum = _mm_cvtsd_f64(_mm_add_sd(v, _mm_unpackhi_pd(v, v)));
+
+#   endif
+
+	__m128d t1 = _mm_setzero_pd(), t2 = _mm_setzero_pd();
+	for (; n >= 4; n-=4, x+=4, y+=4)
+	{
+		t1 = _mm_add_pd(t1, _mm_mul_pd(_mm_loadu_pd(x), _mm_loadu_pd(y)));
+		t2 = _mm_add_pd(t2, _mm_mul_pd(_mm_loadu_pd(x+2), _mm_loadu_pd(y+2)));
+	}
+	t1 = _mm_add_pd(t1, t2);
+	sum += _mm_cvtsd_f64(_mm_add_sd(t1, _mm_unpackhi_pd(t1, t1)));
+
+#endif
+
+	// tail
+	for (; n > 0; n--) sum += (*x++) * (*y++);
+	return sum;
+}
+
+
 
 // ===========================================================
 // functions for char
@@ -1413,3 +1875,59 @@ tail:
 
 	return p;
 }
+
+
+const char *vec_char_find_comma(const char *p, size_t n)
+{
+#ifdef COREARRAY_SIMD_SSE2
+
+	// header 1, 16-byte aligned
+	size_t h = (16 - ((size_t)p & 0x0F)) & 0x0F;
+	for (; (n > 0) && (h > 0); n--, h--, p++)
+		if (*p == ',') return p;
+
+	// body, SSE2
+	const __m128i mask1 = _mm_set1_epi8(',');
+
+#   ifdef COREARRAY_SIMD_AVX2
+
+	// header 2, 32-byte aligned
+	if ((n >= 16) && ((size_t)p & 0x10))
+	{
+		__m128i v = _mm_load_si128((__m128i const*)p);
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(v, mask1)))
+			goto tail;
+		n -= 16; p += 16;
+	}
+
+	// body, AVX2
+	const __m256i mask2 = _mm256_set1_epi8(',');
+
+	for (; n >= 32; n-=32, p+=32)
+	{
+		__m256i v = _mm256_load_si256((__m256i const*)p);
+		if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, mask2)))
+			goto tail;
+	}
+
+#endif
+
+	for (; n >= 16; n-=16, p+=16)
+	{
+		__m128i v = _mm_load_si128((__m128i const*)p);
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(v, mask1)))
+			break;
+	}
+
+#ifdef COREARRAY_SIMD_AVX2
+tail:
+#endif
+
+#endif
+
+	// tail
+	for (; n > 0; n--, p++)
+		if (*p == ',') break;
+
+	return p;
+}
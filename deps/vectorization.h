@@ -290,6 +290,18 @@ COREARRAY_DLL_DEFAULT size_t vec_i8_cnt_nonzero(const int8_t *p, size_t n);
 COREARRAY_DLL_DEFAULT const int8_t *vec_i8_cnt_nonzero_ptr(const int8_t *p,
 	size_t n, size_t *out_n);
 
+/// pack non-zeros to bits, the i-th bit of out is set if p[i] is non-zero
+COREARRAY_DLL_DEFAULT void vec_i8_pack_nonzero(uint64_t *out, const int8_t *p,
+	size_t n);
+
+/// unpack bits to bytes, p[i] is set to 1 if the i-th bit of s is set
+COREARRAY_DLL_DEFAULT void vec_i8_unpack_bits(int8_t *p, const uint64_t *s,
+	size_t n);
+
+/// pack 2-bit values to bytes, 4 values per byte from the lowest bits
+COREARRAY_DLL_DEFAULT void vec_u8_pack_2bits(uint8_t *out, const uint8_t *p,
+	size_t n);
+
 
 
 // ===========================================================
@@ -329,6 +341,19 @@ COREARRAY_DLL_DEFAULT void vec_i8_cnt_dosage2(const int8_t *p,
 /// shifting *p right by 2 bits, assuming p is 2-byte aligned
 COREARRAY_DLL_DEFAULT void vec_u8_shr_b2(uint8_t *p, size_t n);
 
+/// p[i] |= s[i] << shift, used in merging bit planes of genotypes
+COREARRAY_DLL_DEFAULT void vec_u8_shl_or(uint8_t *p, const uint8_t *s,
+	size_t n, uint8_t shift);
+
+/// p[i] |= s[i] << shift, and replace 'val' in p[i] by 'substitute'
+COREARRAY_DLL_DEFAULT void vec_u8_shl_or_replace(uint8_t *p, const uint8_t *s,
+	size_t n, uint8_t shift, uint8_t val, uint8_t substitute);
+
+/// p[i] = (p[i] | s[i]) & (0x03 | (s[i] << 2)), folding bit planes of
+/// genotypes to OR (bits 0-1) and AND (bits 2-3) without merging them
+COREARRAY_DLL_DEFAULT void vec_u8_fold_planes(uint8_t *p, const uint8_t *s,
+	size_t n);
+
 
 
 // ===========================================================
@@ -371,12 +396,24 @@ COREARRAY_DLL_DEFAULT void vec_i32_cnt_dosage2(const int32_t *p,
 /// shifting *p right by 2 bits, assuming p is 4-byte aligned
 COREARRAY_DLL_DEFAULT void vec_i32_shr_b2(int32_t *p, size_t n);
 
+/// p[i] |= s[i] << shift, assuming p is 4-byte aligned
+COREARRAY_DLL_DEFAULT void vec_i32_shl_or_u8(int32_t *p, const uint8_t *s,
+	size_t n, uint8_t shift);
+
+/// p[i] |= s[i] << shift, and replace 'val' in p[i] by 'substitute', assuming p is 4-byte aligned
+COREARRAY_DLL_DEFAULT void vec_i32_shl_or_u8_replace(int32_t *p,
+	const uint8_t *s, size_t n, uint8_t shift, int32_t val, int32_t substitute);
+
 
 
 // ===========================================================
 // functions for float64
 // ===========================================================
 
+/// return the dot product of x and y
+COREARRAY_DLL_DEFAULT double vec_f64_dot(const double *x, const double *y,
+	size_t n);
+
 
 
 // ===========================================================
@@ -385,6 +422,9 @@ COREARRAY_DLL_DEFAULT void vec_i32_shr_b2(int32_t *p, size_t n);
 
 COREARRAY_DLL_DEFAULT const char *vec_char_find_CRLF(const char *p, size_t n);
 
+/// return the pointer to the first comma, or p+n if not found
+COREARRAY_DLL_DEFAULT const char *vec_char_find_comma(const char *p, size_t n);
+
 
 
 #ifdef __cplusplus
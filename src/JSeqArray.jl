@@ -22,13 +22,16 @@ module JSeqArray
 
 using jugds
 
-import Base: joinpath, show, print_with_color, println
+import Base: joinpath, show, print_with_color, println, start, next, done,
+	length, close
 import jugds: type_gdsfile, open_gds, close_gds, show
 
-export TSeqGDSFile, TVarData,
+export TSeqGDSFile, TVarData, TAlleleData,
 	seqExample, seqOpen, seqClose, seqFilterSet, seqFilterSet2, seqFilterSplit,
 	seqFilterReset, seqFilterPush, seqFilterPop, seqFilterGet, seqGetData,
-	seqApply, seqParallel, seqAttr
+	seqGetData!, seqApply, seqParallel, seqAttr, seqGRM, seqLD,
+	seqSampleCache, seqFilterChrom, seqFilterBED, seqVariantKey,
+	seqMatchVariant, TVarIter, seqIterate
 
 
 
@@ -72,6 +75,24 @@ immutable TVarData
 	data::Any
 end
 
+# Type for alleles in a contiguous buffer, the variant i has the alleles
+# index[i]:index[i+1]-1, and the allele j is data[offset[j]:offset[j+1]-1]
+immutable TAlleleData
+	index::Vector{Int32}
+	offset::Vector{Int32}
+	data::Vector{UInt8}
+end
+
+# Type for iterating over variants, the data of a variant are read to the
+# arrays in buffer which are allocated once
+type TVarIter
+	ptr::Ptr{Void}        # the native iterator
+	single::Bool          # whether a single variable
+	buffer::Vector{Any}   # the arrays reused in iteration
+	num::Vector{Int32}    # the numbers of entries, -1 for the whole array
+	count::Int            # the number of selected variants
+end
+
 
 
 ####  Internal functions  ####
@@ -88,6 +109,17 @@ function gds_seldim(file::TSeqGDSFile)
 		file.gds.id)
 end
 
+# convert Vector{Any} from the native library according to the variable name
+function to_vardata(name::String, v::Vector{Any})
+	if name in ("#ref", "\$ref", "#alt", "\$alt", "\$allele_offsets")
+		return TAlleleData(v[1], v[2], v[3])
+	elseif length(v) == 2
+		return TVarData(v[1], v[2])
+	else
+		error("Invalid data returned for '$name'.")
+	end
+end
+
 # split total count
 function split_count(total_count::Int64, count::Int)
 	scale = total_count / count
@@ -163,12 +195,14 @@ end
 
 # Open a SeqArray file
 """
-	seqOpen(filename, readonly, allow_dup)
+	seqOpen(filename, readonly, allow_dup; index_cache, sample_cache)
 Opens a SeqArray GDS file.
 # Arguments
 * `filename::String`: the file name of a SeqArray file
 * `readonly::Bool=true`: if true, the file is opened read-only; otherwise, it is allowed to write data to the file
 * `allow_dup::Bool=false`: if true, it is allowed to open a GDS file with read-only mode when it has been opened in the same session
+* `index_cache::Bool=false`: if true, the indexing objects (genotype index, positions, chromosomes and variable indices) are loaded from the sidecar file "filename.seqidx" when it matches the GDS file, and they are saved to the sidecar file when the GDS file is closed
+* `sample_cache::Bool=false`: if true, the sample-major genotype file "filename.seqsamp" created by `seqSampleCache` is used when it matches the GDS file
 # Examples
 ```julia
 julia> f = seqOpen(seqExample(:kg))
@@ -178,10 +212,19 @@ julia> f
 julia> seqClose(f)
 ```
 """
-function seqOpen(filename::String, readonly::Bool=true, allow_dup::Bool=false)
+function seqOpen(filename::String, readonly::Bool=true, allow_dup::Bool=false;
+		index_cache::Bool=false, sample_cache::Bool=false)
 	ff = open_gds(filename, readonly, allow_dup)
 	# TODO: check file structure
 	ccall((:SEQ_File_Init, LibSeqArray), Void, (Cint,), ff.id)
+	if index_cache
+		ccall((:SEQ_File_IndexCache, LibSeqArray), Void, (Cint,Cstring),
+			ff.id, filename)
+	end
+	if sample_cache
+		ccall((:SEQ_File_SampleCache, LibSeqArray), Bool,
+			(Cint,Cstring,Bool,Bool), ff.id, filename, false, false)
+	end
 	return TSeqGDSFile(ff, nothing)
 end
 
@@ -203,6 +246,34 @@ end
 
 
 
+# Create the sample-major genotype file
+"""
+	seqSampleCache(file; verbose)
+Creates the sample-major genotype file "filename.seqsamp" if it does not match the GDS file, and uses it when reading genotypes of a few samples.
+# Arguments
+* `file::TSeqGDSFile`: a SeqArray julia object
+* `verbose::Bool=true`: if true, show progress information
+# Details
+The variants are stored block by block, and the genotypes of each sample are contiguous in 2-bit codes within a block, with a side list for the allele indices > 1, so `seqGetData(file, "genotype")` reads only the rows of selected samples when at most 1/8 of samples are selected. Returns true if the file is used.
+# Examples
+```julia
+julia> f = seqOpen(seqExample(:kg));
+
+julia> seqSampleCache(f, verbose=false)
+
+julia> seqFilterSet(f, sample_id=seqGetData(f, "sample.id")[1:4], verbose=false)
+
+julia> g = seqGetData(f, "genotype");
+
+julia> seqClose(f)
+```
+"""
+function seqSampleCache(file::TSeqGDSFile; verbose::Bool=true)
+	return ccall((:SEQ_File_SampleCache, LibSeqArray), Bool,
+		(Cint,Cstring,Bool,Bool), file.gds.id, file.gds.filename, true,
+		verbose)
+end
+
 # Set a filter on variants or samples with sample or variant IDs
 """
 	seqFilterSet(file; sample_id, variant_id, intersect, verbose)
@@ -351,6 +422,93 @@ end
 
 
 
+# Set a filter on variants within chromosomes or genomic regions
+"""
+	seqFilterChrom(file, chrom; from_bp, to_bp, intersect, verbose)
+Sets a filter to variant by chromosomes or genomic regions.
+# Arguments
+* `file::TSeqGDSFile`: a SeqArray julia object
+* `chrom::Union{String, Vector{String}}`: chromosome(s)
+* `from_bp::Union{Void, Int, Vector{Int}}=nothing`: the starting position(s) of regions, or `nothing` for the start of chromosome
+* `to_bp::Union{Void, Int, Vector{Int}}=nothing`: the ending position(s) of regions (inclusive), or `nothing` for the end of chromosome
+* `intersect::Bool=false`: if false, the candidate variants for selection are all variants; if true, the candidate variants are from the selected variants defined via the previous call
+* `verbose::Bool=true`: if true, show information
+# Details
+`from_bp` and `to_bp` have the same length as `chrom` if they are vectors. When the positions are sorted within each chromosome, the variants in a region are located by binary search, so the cost does not depend on the total number of variants.
+# Examples
+```julia
+julia> f = seqOpen(seqExample(:kg));
+
+julia> seqFilterChrom(f, "22", from_bp=20000000, to_bp=30000000)
+
+julia> seqClose(f)
+```
+"""
+function seqFilterChrom(file::TSeqGDSFile,
+		chrom::Union{String, Vector{String}};
+		from_bp::Union{Void, Int, Vector{Int}}=nothing,
+		to_bp::Union{Void, Int, Vector{Int}}=nothing,
+		intersect::Bool=false, verbose::Bool=true)
+	if isa(chrom, String)
+		chrom = [ chrom ]
+	end
+	n = length(chrom)
+	bp1 = from_bp == nothing ? fill(typemin(Int32), n) : Vector{Int32}(
+		isa(from_bp, Int) ? fill(from_bp, n) : from_bp)
+	bp2 = to_bp == nothing ? fill(typemax(Int32), n) : Vector{Int32}(
+		isa(to_bp, Int) ? fill(to_bp, n) : to_bp)
+	if length(bp1)!=n || length(bp2)!=n
+		throw(ArgumentError("'from_bp' and 'to_bp' should have the same length as 'chrom'."))
+	end
+	ccall((:SEQ_SetChrom, LibSeqArray), Void, (Cint,Any,Any,Any,Bool,Bool),
+		file.gds.id, chrom, bp1, bp2, intersect, verbose)
+	return nothing
+end
+
+# Set a filter on variants within the regions of a BED file
+"""
+	seqFilterBED(file, bed; intersect, region_id, verbose)
+Sets a filter to variant by the genomic regions in a BED file.
+# Arguments
+* `file::TSeqGDSFile`: a SeqArray julia object
+* `bed::String`: the file name of BED, with 0-based starting and 1-based ending positions in the first three columns
+* `intersect::Bool=false`: if false, the candidate variants for selection are all variants; if true, the candidate variants are from the selected variants defined via the previous call
+* `region_id::Bool=false`: if true, returns the region of each selected variant
+* `verbose::Bool=true`: if true, show information
+# Details
+The overlapping or adjacent regions of each chromosome are merged into a sorted array, and the variants are selected by a merge-join with the positions. If `region_id=true`, returns `Vector{Any}[id, chrom, start, end]`, where `id::Vector{Int32}` is the index of merged region for each selected variant, and `chrom`, `start` and `end` are the merged regions with 1-based positions; otherwise returns `nothing`.
+# Examples
+```julia
+julia> f = seqOpen(seqExample(:kg));
+
+julia> rv = seqFilterBED(f, "exome.bed", region_id=true);
+
+julia> seqClose(f)
+```
+"""
+function seqFilterBED(file::TSeqGDSFile, bed::String; intersect::Bool=false,
+		region_id::Bool=false, verbose::Bool=true)
+	chrom = Vector{String}(); bp1 = Vector{Int32}(); bp2 = Vector{Int32}()
+	open(bed, "r") do io
+		for ln in eachline(io)
+			if isempty(strip(ln)) || startswith(ln, "#") ||
+					startswith(ln, "track") || startswith(ln, "browser")
+				continue
+			end
+			ss = split(chomp(ln), '\t')
+			if length(ss) < 3
+				throw(ArgumentError("Invalid BED line: $ln"))
+			end
+			push!(chrom, ss[1])
+			push!(bp1, parse(Int32, ss[2]) + 1)
+			push!(bp2, parse(Int32, ss[3]))
+		end
+	end
+	return ccall((:SEQ_SetRegionSet, LibSeqArray), Any,
+		(Cint,Any,Any,Any,Bool,Bool,Bool), file.gds.id, chrom, bp1, bp2,
+		intersect, region_id, verbose)
+end
+
 # Reset the filter
 """
 	seqFilterReset(file; sample, variant, verbose)
@@ -435,6 +593,15 @@ The variable name should be
 * "genotype" for 3-dim UInt8 array (ploidy, sample, variant) where 0 is the reference allele, 1 is the first alternative allele, 0xFF is missing value
 * "annotation/id", "annotation/qual", "annotation/filter", "annotation/info/VARIABLE_NAME", "annotation/format/VARIABLE_NAME"
 * "#dosage" for a dosage matrix (sample, variant) of reference allele (UInt8: 0, 1 and 2 for diploid genotypes, 0xFF for missing values)
+* "\$dosage_alt" for a dosage matrix (sample, variant) of all alternative alleles (UInt8, 0xFF for missing values)
+* "\$dosage_sp" for `TVarData` of dosages of each alternative allele, where `index` is the number of alternative alleles per variant and `data` is a UInt8 matrix (sample, allele) with the columns of variants concatenated
+* "\$af" and "\$missing_rate" for Float64 vectors (variant) of reference allele frequencies and missing rates, "\$sample_af" and "\$sample_missing_rate" for those of samples
+* "\$geno_count" for an Int32 matrix (ploidy+2, variant) with the numbers of samples carrying 0, 1, ..., ploidy reference alleles and missing genotypes
+* "\$genotype_packed" for a UInt8 matrix (byte, variant) of 2-bit genotype codes, 4 codes per byte from the lowest bits in the order of "genotype" (0 for the reference allele, 1 for the first alternative allele, 2 for other alleles, 3 for missing value)
+* "\$ref", "\$alt" and "\$allele_offsets" for `TAlleleData` of the reference, alternative and all alleles respectively, which are stored in a contiguous byte buffer without allocating a string per variant
+* "#chrom_pos" and "#chrom_pos_allele" for String vectors of "chromosome:position" and "chromosome:position_ref_alt"
+* "\$variant_key" for a UInt64 vector (variant) of variant keys, see `seqVariantKey()`
+* "\$chrom_code" for an Int32 vector (variant) of chromosome codes, indexing "\$chrom_table" which is a String vector of distinct chromosomes in the order of first appearance
 * "#num_allele" returns an integer vector with the numbers of distinct alleles
 # Examples
 ```jldoctest
@@ -456,16 +623,101 @@ function seqGetData(file::TSeqGDSFile, name::String)
 	rv = ccall((:SEQ_GetData, LibSeqArray), Any, (Cint,Cstring),
 		file.gds.id, name)
 	if isa(rv, Vector{Any})
-		rv = TVarData(rv[1], rv[2])
+		rv = to_vardata(name, rv)
 	end
 	return rv
 end
 
 
 
+# Get data into a preallocated array
+"""
+	seqGetData!(file, name, out)
+Gets data from a SeqArray GDS file, and saves it to the preallocated array `out` which can be reused across blocks.
+# Arguments
+* `file::TSeqGDSFile`: a SeqArray julia object
+* `name::String`: the variable name, see the details
+* `out::Array`: the output array with the element type and dimension of the selected data
+# Details
+The variable name should be
+* "position" and "\$chrom_code" for `Vector{Int32}` (variant)
+* "genotype" for `Array{UInt8,3}` (ploidy, sample, variant)
+* "#dosage" for `Matrix{UInt8}` (sample, variant)
+* "\$genotype_packed" for `Matrix{UInt8}` (cld(ploidy*sample, 4), variant)
+* "annotation/format/VARIABLE_NAME" for the data part (sample, the total length of "annotation/format/@VARIABLE_NAME"), any numeric element type
+# Examples
+```jldoctest
+julia> f = seqOpen(seqExample(:kg));
+
+julia> seqFilterSet2(f, variant=1:100, verbose=false);
+
+julia> geno = Array{UInt8}(2, 1092, 100);
+
+julia> seqGetData!(f, "genotype", geno) == seqGetData(f, "genotype")
+true
+
+julia> seqClose(f)
+```
+"""
+function seqGetData!(file::TSeqGDSFile, name::String, out::Array)
+	ccall((:SEQ_GetDataInto, LibSeqArray), Void, (Cint,Cstring,Any),
+		file.gds.id, name, out)
+	return out
+end
+
+
+
+# Get 64-bit keys of external variants
+"""
+	seqVariantKey(file, chrom, pos, allele)
+Gets 64-bit variant keys of external variants, comparable with "\$variant_key" of the file.
+# Arguments
+* `file::TSeqGDSFile`: a SeqArray julia object
+* `chrom::Vector{String}`: chromosomes
+* `pos::Vector{Int}`: positions
+* `allele::Vector{String}`: alleles separated by comma, e.g., "A,G" for the reference and alternative alleles
+# Details
+A key consists of the chromosome code in the file (13 bits), position (31 bits) and a 20-bit hash of alleles (case-insensitive), and the chromosomes not in the file have no matched variant. Different alleles at the same position could have the same key, see `seqMatchVariant()` for exact matching. It is an error if the file has more than 8191 distinct chromosomes.
+"""
+function seqVariantKey(file::TSeqGDSFile, chrom::Vector{String},
+		pos::Vector{Int}, allele::Vector{String})
+	return ccall((:SEQ_VariantKey, LibSeqArray), Vector{UInt64},
+		(Cint,Any,Any,Any), file.gds.id, chrom, Vector{Int32}(pos), allele)
+end
+
+
+
+# Match external variants to the selected variants
+"""
+	seqMatchVariant(file, chrom, pos, allele)
+Matches external variants to the selected variants by a hash join of variant keys.
+# Arguments
+* `file::TSeqGDSFile`: a SeqArray julia object
+* `chrom::Vector{String}`: chromosomes
+* `pos::Vector{Int}`: positions
+* `allele::Vector{String}`: alleles separated by comma, e.g., "A,G" for the reference and alternative alleles
+# Details
+Returns an integer vector with the same length as `chrom`, which are the indices of selected variants starting from 1, or 0 if not found. A variant matches only if the chromosome, position and alleles (case-insensitive) are all equal, since different alleles could have the same key. If a selected variant is duplicated, the first variant is used.
+# Examples
+```julia
+julia> f = seqOpen(seqExample(:kg));
+
+julia> seqMatchVariant(f, ["22", "22"], [16050408, 16050612], ["T,C", "C,G"])
+
+julia> seqClose(f)
+```
+"""
+function seqMatchVariant(file::TSeqGDSFile, chrom::Vector{String},
+		pos::Vector{Int}, allele::Vector{String})
+	return ccall((:SEQ_MatchVariant, LibSeqArray), Vector{Int32},
+		(Cint,Any,Any,Any), file.gds.id, chrom, Vector{Int32}(pos), allele)
+end
+
+
+
 # Apply function over array margins
 """
-	seqApply(fun, file, name, args...; asis, bsize, verbose, kwargs...)
+	seqApply(fun, file, name, args...; asis, bsize, prefetch, verbose, kwargs...)
 Applies the user-defined function over array margins.
 # Arguments
 * `fun::Function`: the user-defined function
@@ -474,6 +726,7 @@ Applies the user-defined function over array margins.
 * `args`: the optional arguments passed to the user-defined function
 * `asis::Symbol=:none`: `:none` (no return), `:unlist` (returns a vector which contains all the atomic components) or `:list` (returns a vector according to each block)
 * `bsize::Int=1024`: block size for the number of variants in a block
+* `prefetch::Int=0`: if > 0, "genotype", "\$genotype_packed", "#dosage" and "\$dosage_alt" of the following blocks are decoded in a separate thread while the user-defined function is running, and `prefetch` is the maximum number of blocks queued; the user-defined function should not read data from `file` in this mode
 * `verbose::Bool=true`: if true, show progress information
 * `kwargs`: the keyword optional arguments passed to the user-defined function
 # Details
@@ -482,6 +735,15 @@ The variable name should be
 * "genotype" for 3-dim UInt8 array (ploidy, sample, variant) where 0 is the reference allele, 1 is the first alternative allele, 0xFF is missing value
 * "annotation/id", "annotation/qual", "annotation/filter", "annotation/info/VARIABLE_NAME", "annotation/format/VARIABLE_NAME"
 * "#dosage" for a dosage matrix (sample, variant) of reference allele (UInt8: 0, 1 and 2 for diploid genotypes, 0xFF for missing values)
+* "\$dosage_alt" for a dosage matrix (sample, variant) of all alternative alleles (UInt8, 0xFF for missing values)
+* "\$dosage_sp" for `TVarData` of dosages of each alternative allele, where `index` is the number of alternative alleles per variant and `data` is a UInt8 matrix (sample, allele) with the columns of variants concatenated
+* "\$af" and "\$missing_rate" for Float64 vectors (variant) of reference allele frequencies and missing rates, "\$sample_af" and "\$sample_missing_rate" for those of samples
+* "\$geno_count" for an Int32 matrix (ploidy+2, variant) with the numbers of samples carrying 0, 1, ..., ploidy reference alleles and missing genotypes
+* "\$genotype_packed" for a UInt8 matrix (byte, variant) of 2-bit genotype codes, 4 codes per byte from the lowest bits in the order of "genotype" (0 for the reference allele, 1 for the first alternative allele, 2 for other alleles, 3 for missing value)
+* "\$ref", "\$alt" and "\$allele_offsets" for `TAlleleData` of the reference, alternative and all alleles respectively, which are stored in a contiguous byte buffer without allocating a string per variant
+* "#chrom_pos" and "#chrom_pos_allele" for String vectors of "chromosome:position" and "chromosome:position_ref_alt"
+* "\$variant_key" for a UInt64 vector (variant) of variant keys, see `seqVariantKey()`
+* "\$chrom_code" for an Int32 vector (variant) of chromosome codes, indexing "\$chrom_table" which is a String vector of distinct chromosomes in the order of first appearance
 * "#num_allele" returns an integer vector with the numbers of distinct alleles
 The algorithm is highly optimized by blocking the computations to exploit the high-speed memory instead of disk.
 # Examples
@@ -500,7 +762,7 @@ julia> seqClose(f)
 """
 function seqApply(fun::Function, file::TSeqGDSFile,
 		name::Union{String, Vector{String}}, args...; asis::Symbol=:none,
-		bsize::Int=1024, verbose::Bool=true, kwargs...)
+		bsize::Int=1024, prefetch::Int=0, verbose::Bool=true, kwargs...)
 	# check
 	if asis!=:none && asis!=:unlist && asis!=:list
 		throw(ArgumentError("'asis' should be :none, :unlist or :list."))
@@ -508,39 +770,26 @@ function seqApply(fun::Function, file::TSeqGDSFile,
 	if bsize <= 0
 		throw(ArgumentError("'bsize' should be greater than 0."))
 	end
+	if prefetch < 0
+		throw(ArgumentError("'prefetch' should be >= 0."))
+	end
 	if isa(name, String)
 		name = [ name ]
 	end
-	# initialize
-	dm = gds_seldim(file)[3]  # the number of selected variants
-	bnum = div(dm, bsize)
-	bnum += mod(dm, bsize) != 0
-	rv = asis==:none ? nothing : Vector{Any}(bnum)
-	# run
-	seqFilterPush(file)
-	progress = progress_init(bnum, verbose)
-	try
-		idx = find(seqFilterGet(file, false))
-		st = 1
-		
-		for i in 1:bnum
-			ed = st + bsize - 1
-			if ed > dm
-				ed = dm
-			end
-			seqFilterSet2(file, variant=idx[st:ed], verbose=false)
-			st += bsize
-			x = [ seqGetData(file, nm) for nm in name ]
-			v = fun(x..., args...; kwargs...)
-			if rv != nothing
-				rv[i] = v
-			end
-			progress_forward(progress)
-		end
-	finally
-		seqFilterPop(file)
-		progress_done(progress)
+	if gds_seldim(file)[3] <= 0
+		return asis==:none ? nothing : Vector{Any}()
 	end
+	# the variables are passed to the user-defined function in the C loop
+	nv = length(name)
+	f = function(x...)
+		vs = [ isa(x[i], Vector{Any}) ? to_vardata(name[i], x[i]) : x[i]
+			for i in 1:nv ]
+		return fun(vs..., x[(nv+1):end]...; kwargs...)
+	end
+	rv = ccall((:SEQ_BApply_Variant, LibSeqArray), Any,
+		(Cint, Any, Any, Cstring, Cint, Cint, Bool, Any),
+		file.gds.id, name, f, string(asis), bsize, prefetch, verbose,
+		Any[ args... ])
 	# output
 	if asis == :unlist
 		rv = vcat(rv...)
@@ -550,6 +799,89 @@ end
 
 
 
+# Iterate over variants
+"""
+	seqIterate(file, name)
+Returns an iterator over the selected variants, which reads the data of a variant to the arrays allocated once.
+# Arguments
+* `file::TSeqGDSFile`: a SeqArray julia object
+* `name::Union{String, Vector{String}}`: the variable name(s), see the details
+# Details
+The variable name should be
+* "genotype" for a UInt8 matrix (ploidy, sample), 0xFF is missing value
+* "phase" for a UInt8 vector (sample), or a UInt8 matrix (ploidy-1, sample) if ploidy > 2
+* "#dosage" for a UInt8 vector (sample) of reference allele dosages
+* "position" and "#num_allele" for an Int32 vector of length one, "chromosome" for a String vector of length one
+* "annotation/info/VARIABLE_NAME" for a view of numeric vector (entry) or matrix (base, entry), and "annotation/format/VARIABLE_NAME" for a view of numeric matrix (sample, entry), where the number of entries varies by variant
+Each step yields the data of a variant, or a tuple of them if `name` is a vector. The arrays are overwritten in the next step, so use `copy()` to keep the data. The variant selection is fixed when the iterator is created. The iterator can be released by `close()` before garbage collection.
+# Examples
+```jldoctest
+julia> f = seqOpen(seqExample(:kg));
+
+julia> seqFilterSet2(f, variant=1:100, verbose=false);
+
+julia> n = 0; for g in seqIterate(f, "genotype") n += countnz(g .== 0) end;
+
+julia> n == countnz(seqGetData(f, "genotype") .== 0)
+true
+
+julia> seqClose(f)
+```
+"""
+function seqIterate(file::TSeqGDSFile, name::Union{String, Vector{String}})
+	nm = isa(name, String) ? [ name ] : name
+	ptr = ccall((:SEQ_Apply_Variant_Init, LibSeqArray), Ptr{Void},
+		(Cint, Any), file.gds.id, nm)
+	it = TVarIter(ptr, isa(name, String), Vector{Any}(),
+		fill(Int32(-1), length(nm)), gds_seldim(file)[3])
+	finalizer(it, close)
+	for i in 1:length(nm)
+		push!(it.buffer, ccall((:SEQ_Apply_Variant_Buffer, LibSeqArray), Any,
+			(Ptr{Void}, Cint), ptr, i-1))
+	end
+	return it
+end
+
+# the data of the current variant
+function iter_view(a::Array, num::Int32)
+	if num < 0
+		return a
+	elseif ndims(a) == 1
+		return view(a, 1:num)
+	else
+		return view(a, :, 1:num)
+	end
+end
+
+start(it::TVarIter) = 1
+
+done(it::TVarIter, i::Int) = i > it.count
+
+function next(it::TVarIter, i::Int)
+	if it.ptr == C_NULL
+		throw(ArgumentError("The iterator has been closed."))
+	end
+	ccall((:SEQ_Apply_Variant_Read, LibSeqArray), Void,
+		(Ptr{Void}, Int64, Any), it.ptr, i-1, it.num)
+	if it.single
+		v = iter_view(it.buffer[1], it.num[1])
+	else
+		v = ntuple(k -> iter_view(it.buffer[k], it.num[k]), length(it.buffer))
+	end
+	return (v, i+1)
+end
+
+length(it::TVarIter) = it.count
+
+function close(it::TVarIter)
+	ccall((:SEQ_Apply_Variant_Done, LibSeqArray), Void, (Ptr{Void},), it.ptr)
+	it.ptr = C_NULL
+	empty!(it.buffer)
+	return nothing
+end
+
+
+
 ####  Parallel functions  ####
 
 # internal variables used for identifying processes
@@ -567,24 +899,30 @@ end
 
 # Apply Functions in Parallel
 """
-	seqParallel(fun, file, args...; split, combine, kwargs...)
+	seqParallel(fun, file, args...; split, combine, shared, chunk, kwargs...)
 Applies a user-defined function in parallel.
 # Arguments
 * `fun::Function`: the user-defined function
 * `file::TSeqGDSFile`: a SeqArray julia object
 * `args`: the optional arguments passed to the user-defined function
-* `split::Symbol=:byvariant`: `:none` for no split, `:byvariant` for spliting the dataset by variant according to multiple processes
-* `combine::Union{Symbol, Function}=:unlist`: `:none` (no return), `:unlist` (returns a vector which contains all the atomic components) or `:list` (returns a vector according to each process)
+* `split::Symbol=:byvariant`: `:none` for no split, `:byvariant` for spliting the dataset by variant according to multiple processes, `:dynamic` for spliting the dataset into chunks of variants which are pulled from a shared queue by idle processes
+* `combine::Union{Symbol, Function}=:unlist`: `:none` (no return), `:unlist` (returns a vector which contains all the atomic components) or `:list` (returns a vector according to each process, or each chunk if `split=:dynamic`)
+* `shared::Bool=false`: if true, the indexing objects and the sample and variant selection are built once, and saved to a temporary file which is loaded by the workers, instead of sending the selection to each worker and rebuilding the indexing objects there; the file is created by `tempname()`, so the temporary directory (e.g., `TMPDIR`) must be on a filesystem the workers can read
+* `chunk::Int=4096`: the number of selected variants in a chunk if `split=:dynamic`
 * `kwargs`: the keyword optional arguments passed to the user-defined function
 # Details
+If `split=:dynamic`, the user-defined function is called once per chunk, and the results of chunks are combined in the order of variants.
 # Examples
 """
 function seqParallel(fun::Function, file::TSeqGDSFile, args...;
 		split::Symbol=:byvariant, combine::Union{Symbol, Function}=:unlist,
-		kwargs...)
+		shared::Bool=false, chunk::Int=4096, kwargs...)
 	# check
-	if split!=:byvariant && split!=:none
-		throw(ArgumentError("'split' should be :byvaraint or :none."))
+	if split!=:byvariant && split!=:dynamic && split!=:none
+		throw(ArgumentError("'split' should be :byvariant, :dynamic or :none."))
+	end
+	if chunk < 1
+		throw(ArgumentError("'chunk' should be > 0."))
 	end
 	if isa(combine, Symbol)
 		if combine!=:none && combine!=:unlist && combine!=:list
@@ -596,21 +934,65 @@ function seqParallel(fun::Function, file::TSeqGDSFile, args...;
 	ws = workers()
 	rc = Vector{Any}(length(ws))
 	fn = file.gds.filename
-	ssel = seqFilterGet(file, true)
-	vsel = seqFilterGet(file, false)
+	if shared
+		# the indexing objects and selection are loaded by workers
+		idxfn = tempname() * ".seqidx"
+		ccall((:SEQ_File_SaveShared, LibSeqArray), Void, (Cint,Cstring,Cstring),
+			file.gds.id, fn, idxfn)
+		ssel = vsel = nothing
+	else
+		idxfn = ""
+		ssel = seqFilterGet(file, true)
+		vsel = seqFilterGet(file, false)
+	end
+	if split == :dynamic
+		# the chunks of variants in a shared queue, 0 for the end
+		ss = ccall((:SEQ_SplitVariant, LibSeqArray), Vector{Int64},
+			(Cint,Cint), file.gds.id, chunk)
+		queue = RemoteChannel(()->Channel{Int}(length(ss)-1+length(ws)))
+		for k in 1:(length(ss)-1)
+			put!(queue, k)
+		end
+		for i in 1:length(ws)
+			put!(queue, 0)
+		end
+	else
+		ss = queue = nothing
+	end
 	for i in 1:length(ws)
-		rc[i] = remotecall(ws[i], i, length(ws), fn, ssel, vsel, fun, split,
-					args, kwargs) do i, cnt, fn, ssel, vsel, fun, split, args, kwargs
+		rc[i] = remotecall(ws[i], i, length(ws), fn, idxfn, ssel, vsel, fun,
+					split, ss, queue, args, kwargs) do i, cnt, fn, idxfn, ssel,
+					vsel, fun, split, ss, queue, args, kwargs
 			set_proc_index(i)
 			set_proc_count(cnt)
 			rv = nothing
 			ff = seqOpen(fn, true, true)
-			seqFilterSet2(ff, sample=ssel, variant=vsel, verbose=false)
+			if idxfn != ""
+				ccall((:SEQ_File_LoadShared, LibSeqArray), Void,
+					(Cint,Cstring,Cstring), ff.gds.id, fn, idxfn)
+			else
+				seqFilterSet2(ff, sample=ssel, variant=vsel, verbose=false)
+			end
 			if split==:byvariant
 				seqFilterSplit(ff, i, cnt, verbose=false)
 			end
 			try
-				rv = fun(ff, args...; kwargs...)
+				if split == :dynamic
+					# pull chunks until the end, return (chunk index, result)
+					rv = Any[]
+					while (k = take!(queue)) > 0
+						seqFilterPush(ff)
+						try
+							ccall((:SEQ_SetVariantSpan, LibSeqArray), Void,
+								(Cint,Int64,Int64), ff.gds.id, ss[k], ss[k+1])
+							push!(rv, (k, fun(ff, args...; kwargs...)))
+						finally
+							seqFilterPop(ff)
+						end
+					end
+				else
+					rv = fun(ff, args...; kwargs...)
+				end
 			finally
 				seqClose(ff)
 			end
@@ -618,7 +1000,7 @@ function seqParallel(fun::Function, file::TSeqGDSFile, args...;
 		end
 	end
 	# remote run
-	if isa(combine, Symbol)
+	try
 		rv = [ fetch(r) for r in rc ]
 		err = false
 		for i in rv
@@ -630,9 +1012,25 @@ function seqParallel(fun::Function, file::TSeqGDSFile, args...;
 		if err
 			error("RemoteException")
 		end
-		rv = combine==:none ? nothing : (combine==:unlist ? vcat(rv...) : rv)
-	else
-		rv = reduce(combine, map(fetch, rc))
+		if split == :dynamic
+			# reassemble the results of chunks in order
+			rs = Vector{Any}(length(ss)-1)
+			for r in rv
+				for (k, v) in r
+					rs[k] = v
+				end
+			end
+			rv = rs
+		end
+		if isa(combine, Symbol)
+			rv = combine==:none ? nothing : (combine==:unlist ? vcat(rv...) : rv)
+		else
+			rv = reduce(combine, rv)
+		end
+	finally
+		if idxfn != ""
+			rm(idxfn, force=true)
+		end
 	end
 	# output
 	return rv
@@ -640,6 +1038,71 @@ end
 
 
 
+####  Statistical methods  ####
+
+# Genetic relationship matrix
+"""
+	seqGRM(file; bsize, nthread, verbose)
+Calculates the genetic relationship matrix (GRM) of selected samples for principal component analysis.
+# Arguments
+* `file::TSeqGDSFile`: a SeqArray julia object
+* `bsize::Int=1024`: block size for the number of variants in a block
+* `nthread::Int=1`: the number of threads used in accumulating the matrix
+* `verbose::Bool=true`: if true, show progress information
+# Details
+The dosages of reference allele are standardized by the allele frequency `p` of each variant, i.e., `(g - 2p) / sqrt(p(1-p))` for diploid genotypes, where missing genotypes and monomorphic variants contribute zeros. The cross products are accumulated block by block in the native library, and the matrix is scaled by the average of its diagonal.
+# Examples
+```jldoctest
+julia> f = seqOpen(seqExample(:kg));
+
+julia> grm = seqGRM(f, verbose=false); println(typeof(grm), ", ", size(grm))
+Array{Float64,2}, (1092,1092)
+
+julia> seqClose(f)
+```
+"""
+function seqGRM(file::TSeqGDSFile; bsize::Int=1024, nthread::Int=1,
+		verbose::Bool=true)
+	return ccall((:SEQ_GRM, LibSeqArray), Matrix{Float64},
+		(Cint,Cint,Cint,Bool), file.gds.id, bsize, nthread, verbose)
+end
+
+
+
+# Linkage disequilibrium
+"""
+	seqLD(file; method, window, maxvar, threshold, verbose)
+Calculates linkage disequilibrium (LD) between selected variants in sliding windows.
+# Arguments
+* `file::TSeqGDSFile`: a SeqArray julia object
+* `method::Symbol=:r2`: `:r2` for the squared correlation, `:r` for the correlation, `:dprime` for D' of composite LD
+* `window::Int=500000`: the window size in basepair
+* `maxvar::Int=1000`: the maximum number of preceding variants compared with a variant
+* `threshold::Float64=0.2`: the pairs with the absolute value >= `threshold` are returned
+* `verbose::Bool=true`: if true, show progress information
+# Details
+LD is calculated from the dosages of reference allele, using the samples without missing genotypes in both variants. A window never crosses chromosomes. Returns a sparse matrix (variant, variant) where the entry `(i, j)` with `i < j` is the LD between the i-th and j-th selected variants.
+# Examples
+```jldoctest
+julia> f = seqOpen(seqExample(:kg));
+
+julia> ld = seqLD(f, verbose=false); println(typeof(ld))
+SparseMatrixCSC{Float64,Int64}
+
+julia> seqClose(f)
+```
+"""
+function seqLD(file::TSeqGDSFile; method::Symbol=:r2, window::Int=500000,
+		maxvar::Int=1000, threshold::Float64=0.2, verbose::Bool=true)
+	rv = ccall((:SEQ_LD, LibSeqArray), Vector{Any},
+		(Cint,Cstring,Cint,Cint,Float64,Bool), file.gds.id, string(method),
+		window, maxvar, threshold, verbose)
+	n = gds_seldim(file)[3]
+	return sparse(Vector{Int}(rv[1]), Vector{Int}(rv[2]), rv[3], n, n)
+end
+
+
+
 ####  Summary  ####
 
 # Return the specified attribute value
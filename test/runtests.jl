@@ -1,4 +1,5 @@
 using Base.Test
+using jugds
 using JSeqArray
 using StatsBase
 
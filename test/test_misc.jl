@@ -37,6 +37,75 @@ end
 
 
 
+## Test: allele frequencies, missing rates and genotype counts in the decoder
+
+# compare two vectors of rates, where NaN matches NaN
+function same_rate(x::Vector{Float64}, y::Vector{Float64})
+	length(x) == length(y) || return false
+	for i in 1:length(x)
+		if isnan(x[i]) || isnan(y[i])
+			(isnan(x[i]) && isnan(y[i])) || return false
+		elseif abs(x[i] - y[i]) > 1e-10
+			return false
+		end
+	end
+	return true
+end
+
+# reference allele frequencies, missing rates and genotype counts from
+#   a (ploidy, sample, variant) genotype array
+function rate_from_geno(geno::Array{UInt8,3})
+	P, N, M = size(geno)
+	af = Vector{Float64}(M); mr = Vector{Float64}(M)
+	saf = Vector{Float64}(N); smr = Vector{Float64}(N)
+	cnt = zeros(Int32, P+2, M)
+	for k in 1:M
+		g = geno[:,:,k]
+		nmiss = sum(g .== 0xFF)
+		af[k] = sum(g .== 0) / (length(g) - nmiss)
+		mr[k] = nmiss / length(g)
+		for j in 1:N
+			gj = g[:,j]
+			cnt[any(gj .== 0xFF) ? P+2 : sum(gj .== 0)+1, k] += 1
+		end
+	end
+	for j in 1:N
+		g = geno[:,j,:]
+		nmiss = sum(g .== 0xFF)
+		saf[j] = sum(g .== 0) / (length(g) - nmiss)
+		smr[j] = nmiss / length(g)
+	end
+	return af, mr, saf, smr, cnt
+end
+
+f = seqOpen(seqExample(:kg))
+println("Allele frequencies, missing rates and genotype counts in the decoder")
+
+try
+	for sel in (false, true)
+		if sel
+			seqFilterSet2(f, sample=1:3:1092, variant=1:2000, verbose=false)
+		end
+		af, mr, saf, smr, cnt = rate_from_geno(seqGetData(f, "genotype"))
+
+		@test same_rate(seqGetData(f, "\$af"), af)
+		@test same_rate(seqGetData(f, "\$missing_rate"), mr)
+		@test same_rate(seqGetData(f, "\$sample_af"), saf)
+		@test same_rate(seqGetData(f, "\$sample_missing_rate"), smr)
+		@test seqGetData(f, "\$geno_count") == cnt
+
+		af2 = seqApply(f, "\$af", asis=:unlist, verbose=false) do x
+			return x
+		end
+		@test same_rate(af2, af)
+	end
+finally
+	seqClose(f)
+end
+
+
+
+
 ## Test: the calculation of covariance matrix for PCA
 
 f = seqOpen(seqExample(:kg))
@@ -75,8 +144,728 @@ try
 	@test s.q25    ≈ -0.030999663540459556
 	@test s.q75    ≈ 0.016731842043406
 
+	# native implementation
+	grm = seqGRM(f, nthread=2, verbose=false)
+	@test grm ≈ cov1
+
+finally
+	seqClose(f)
+end
+
+
+
+
+
+
+## Test: variant keys and the hash join
+
+f = seqOpen(seqExample(:kg))
+println("Matching variants by keys")
+
+try
+	chr = seqGetData(f, "chromosome")
+	pos = Vector{Int}(seqGetData(f, "position"))
+	allele = seqGetData(f, "allele")
+	key = seqGetData(f, "\$variant_key")
+	@test seqVariantKey(f, chr, pos, allele) == key
+
+	idx = seqMatchVariant(f, chr, pos, allele)
+	@test all(idx .> 0)
+	@test key[idx] == key
+	@test pos[idx] == pos
+	@test uppercase.(allele[idx]) == uppercase.(allele)
+	@test seqMatchVariant(f, chr[1:1], pos[1:1], [lowercase(allele[1])]) == [1]
+	# the same position with different alleles, and an unknown chromosome
+	@test seqMatchVariant(f, chr[1:1], pos[1:1], [allele[1] * "T"]) == [0]
+	@test seqMatchVariant(f, ["X"], [1], ["A,G"]) == [0]
+
 finally
 	seqClose(f)
 end
 
 
+
+
+## Test: alleles in a contiguous buffer
+
+f = seqOpen(seqExample(:kg))
+println("Reference and alternative alleles")
+
+try
+	allele = [ split(s, ',') for s in seqGetData(f, "allele") ]
+	ref = seqGetData(f, "\$ref")
+	@test isa(ref, TAlleleData)
+	@test ref.index == collect(Int32, 1:(length(allele)+1))
+	@test [ String(ref.data[ref.offset[i]:(ref.offset[i+1]-1)])
+		for i in 1:length(allele) ] == [ a[1] for a in allele ]
+
+	alt = seqGetData(f, "\$alt")
+	@test diff(alt.index) == [ length(a)-1 for a in allele ]
+	v = seqGetData(f, "\$allele_offsets")
+	@test length(v.data) == sum([ sum(map(length, a)) for a in allele ])
+
+	# wrapped by the variable name in seqApply
+	r = seqApply(f, [ "\$ref", "\$alt" ], asis=:list, bsize=5000,
+			verbose=false) do x, y
+		return (typeof(x), typeof(y), length(x.index) - 1)
+	end
+	@test all(v -> v[1] == TAlleleData && v[2] == TAlleleData, r)
+	@test sum([ v[3] for v in r ]) == length(allele)
+
+finally
+	seqClose(f)
+end
+
+
+
+
+## Test: iterating over variants
+
+f = seqOpen(seqExample(:kg))
+println("Variant by variant")
+
+try
+	seqFilterSet2(f, variant=1:200, verbose=false)
+	geno = seqGetData(f, "genotype")
+	dosage = seqGetData(f, "#dosage")
+	pos = seqGetData(f, "position")
+	chr = seqGetData(f, "chromosome")
+	phase = seqGetData(f, "phase")
+
+	it = seqIterate(f, [ "genotype", "#dosage", "position", "chromosome",
+		"phase" ])
+	@test length(it) == 200
+	i = 0
+	for (g, d, p, c, h) in it
+		i += 1
+		@test g == geno[:, :, i]
+		@test d == dosage[:, i]
+		@test p[1] == pos[i]
+		@test c[1] == chr[i]
+		@test h == phase[:, i]
+	end
+	@test i == 200
+	close(it)
+
+finally
+	seqClose(f)
+end
+
+
+# variable-length annotations in a copy of the example file
+fn = tempname() * ".gds"
+cp(seqExample(:kg), fn)
+println("Variant by variant, annotation/info and annotation/format")
+
+try
+	f = seqOpen(fn, false)
+	try
+		nv = seqAttr(f, :nvar)
+		root = root_gdsn(f.gds)
+		# 0, 1 or 2 entries per variant
+		len = Int32[ i % 3 for i in 1:nv ]
+		info = index_gdsn(root, "annotation/info")
+		add_gdsn(info, "NE", collect(Int32, 1:Int(sum(len))))
+		add_gdsn(info, "@NE", len)
+		# 1 or 2 entries per variant
+		len2 = Int32[ 1 + (i % 2) for i in 1:nv ]
+		fmt = addfolder_gdsn(index_gdsn(root, "annotation/format"), "DP")
+		add_gdsn(fmt, "data", rand(Int32(0):Int32(99), 1092, Int(sum(len2))))
+		add_gdsn(fmt, "@data", len2)
+	finally
+		seqClose(f)
+	end
+
+	f = seqOpen(fn)
+	try
+		seqFilterSet2(f, sample=1:2:1092, variant=1:100, verbose=false)
+		ne = seqGetData(f, "annotation/info/NE")
+		dp = seqGetData(f, "annotation/format/DP")
+		i = 0; st = 0; st2 = 0
+		for (x, y) in seqIterate(f, [ "annotation/info/NE",
+				"annotation/format/DP" ])
+			i += 1
+			n = ne.index[i]; n2 = dp.index[i]
+			@test length(x) == n
+			@test x == ne.data[(st+1):(st+n)]
+			@test size(y) == (546, n2)
+			@test y == dp.data[:, (st2+1):(st2+n2)]
+			st += n; st2 += n2
+		end
+		@test i == 100
+	finally
+		seqClose(f)
+	end
+
+finally
+	rm(fn, force=true)
+end
+
+
+
+
+## Test: the index cache file
+
+fn = tempname() * ".gds"
+cp(seqExample(:kg), fn)
+println("Index cache file")
+
+try
+	f = seqOpen(fn)
+	geno = seqGetData(f, "genotype")
+	pos = seqGetData(f, "position")
+	chr = seqGetData(f, "chromosome")
+	seqClose(f)
+
+	# the first creates the cache file, and the second loads it
+	for i in 1:2
+		f = seqOpen(fn, index_cache=true)
+		try
+			@test seqGetData(f, "genotype") == geno
+			@test seqGetData(f, "position") == pos
+			@test seqGetData(f, "chromosome") == chr
+		finally
+			seqClose(f)
+		end
+	end
+	@test isfile(fn * ".seqidx")
+
+finally
+	rm(fn, force=true)
+	rm(fn * ".seqidx", force=true)
+end
+
+
+
+
+## Test: dynamically scheduled chunks in parallel
+
+addprocs(2)
+f = seqOpen(seqExample(:kg))
+println("Parallel with dynamic chunks")
+
+try
+	seqFilterSet2(f, variant=1:3:19773, verbose=false)
+	pos = seqGetData(f, "position")
+	p1 = seqParallel(ff -> seqGetData(ff, "position"), f, split=:byvariant)
+	p2 = seqParallel(ff -> seqGetData(ff, "position"), f, split=:dynamic,
+		chunk=500)
+	@test p1 == pos
+	@test p2 == pos
+
+	# the indexing objects and selection shared via a temporary file
+	seqFilterSet2(f, sample=2:5:1092, verbose=false)
+	fun = ff -> Any[ (seqGetData(ff, "position"), seqGetData(ff, "#dosage")) ]
+	loc = fun(f)[1]
+	for sp in [ :byvariant, :dynamic ]
+		r1 = seqParallel(fun, f, split=sp, chunk=500)
+		r2 = seqParallel(fun, f, split=sp, chunk=500, shared=true)
+		@test length(r2) == length(r1)
+		for i in 1:length(r1)
+			@test r2[i] == r1[i]
+		end
+		@test vcat([ x[1] for x in r2 ]...) == loc[1]
+		@test hcat([ x[2] for x in r2 ]...) == loc[2]
+	end
+
+finally
+	seqClose(f)
+	rmprocs(workers())
+end
+
+
+
+
+## Test: packed 2-bit genotypes
+
+# unpack "$genotype_packed" to a (ploidy, sample, variant) array
+function unpack_geno(p::Matrix{UInt8}, ploidy::Int, nsamp::Int)
+	n = ploidy * nsamp
+	rv = Array{UInt8}(ploidy, nsamp, size(p, 2))
+	for v in 1:size(p, 2), i in 1:n
+		rv[i + (v-1)*n] = (p[div(i-1, 4) + 1, v] >> (2*((i-1) % 4))) & 0x03
+	end
+	return rv
+end
+
+# the 2-bit codes of genotypes
+geno_code(geno::Array{UInt8}) = map(g -> g==0xFF ? 0x03 : min(g, 0x02), geno)
+
+f = seqOpen(seqExample(:kg))
+println("Packed genotypes")
+
+try
+	seqFilterSet2(f, variant=1:1000, verbose=false)
+	geno = seqGetData(f, "genotype")
+	p = seqGetData(f, "\$genotype_packed")
+	@test size(p) == (cld(2*1092, 4), 1000)
+	@test unpack_geno(p, 2, 1092) == geno_code(geno)
+
+finally
+	seqClose(f)
+end
+
+
+
+
+## Test: a few scattered samples
+
+f = seqOpen(seqExample(:kg))
+println("Scattered sample selection")
+
+try
+	seqFilterSet2(f, variant=1:2000, verbose=false)
+	geno = seqGetData(f, "genotype")
+	dosage = seqGetData(f, "#dosage")
+
+	samp = [ 1, 5, 300, 1092 ]
+	seqFilterSet2(f, sample=samp, verbose=false)
+	g = seqGetData(f, "genotype")
+	@test g == geno[:, samp, :]
+	@test seqGetData(f, "#dosage") == dosage[samp, :]
+	@test unpack_geno(seqGetData(f, "\$genotype_packed"), 2, length(samp)) ==
+		geno_code(geno[:, samp, :])
+
+finally
+	seqClose(f)
+end
+
+
+
+
+## Test: the sample-major genotype file
+
+fn = tempname() * ".gds"
+cp(seqExample(:kg), fn)
+println("Sample-major genotype file")
+
+try
+	# genotypes without the sample-major file
+	samp = collect(1:10:1092)  # <= 1/8 of samples
+	local geno
+	f = seqOpen(fn)
+	try
+		seqFilterSet2(f, sample=samp, variant=100:3:9000, verbose=false)
+		geno = seqGetData(f, "genotype")
+		@test seqSampleCache(f, verbose=false)
+	finally
+		seqClose(f)
+	end
+
+	f = seqOpen(fn, sample_cache=true)
+	try
+		seqFilterSet2(f, sample=samp, variant=100:3:9000, verbose=false)
+		@test seqGetData(f, "genotype") == geno
+		# all samples, not using the sample-major file
+		seqFilterSet2(f, sample=1:1092, verbose=false)
+		@test seqGetData(f, "genotype")[:, samp, :] == geno
+	finally
+		seqClose(f)
+	end
+
+finally
+	rm(fn, force=true)
+	rm(fn * ".seqsamp", force=true)
+end
+
+
+
+
+## Test: dosages of alternative alleles
+
+f = seqOpen(seqExample(:kg))
+println("Dosages of alternative alleles")
+
+try
+	seqFilterSet2(f, variant=1:2000, verbose=false)
+	dosage = seqGetData(f, "#dosage")
+	alt = seqGetData(f, "\$dosage_alt")
+	miss = dosage .== 0xFF
+	@test (alt .== 0xFF) == miss
+	@test all((alt + dosage)[!miss] .== 2)
+
+	sp = seqGetData(f, "\$dosage_sp")
+	@test isa(sp, TVarData)
+	@test length(sp.index) == 2000
+	st = 0
+	for i in 1:2000
+		d = sp.data[:, (st+1):(st+sp.index[i])]
+		st += sp.index[i]
+		if sp.index[i] == 1
+			# biallelic
+			@test d[:, 1] == alt[:, i]
+		end
+		@test vec(sum(Matrix{Int}(d), 2))[!miss[:, i]] == alt[!miss[:, i], i]
+	end
+	@test st == size(sp.data, 2)
+
+finally
+	seqClose(f)
+end
+
+
+
+
+## Test: filters by chromosome and position
+
+f = seqOpen(seqExample(:kg))
+println("Filters by chromosome and position")
+
+try
+	pos = seqGetData(f, "position")
+	a = 20000000; b = 30000000
+	seqFilterChrom(f, "22", from_bp=a, to_bp=b, verbose=false)
+	mask = (pos .>= a) & (pos .<= b)
+	@test seqFilterGet(f, false) == mask
+	@test seqGetData(f, "position") == pos[mask]
+
+	# two regions
+	seqFilterChrom(f, ["22", "22"], from_bp=[a, 40000000],
+		to_bp=[25000000, 45000000], verbose=false)
+	mask2 = ((pos .>= a) & (pos .<= 25000000)) |
+		((pos .>= 40000000) & (pos .<= 45000000))
+	@test seqFilterGet(f, false) == mask2
+
+	# intersect with the previous selection
+	seqFilterChrom(f, "22", from_bp=a, to_bp=b, verbose=false)
+	seqFilterChrom(f, "22", from_bp=22000000, intersect=true, verbose=false)
+	@test seqFilterGet(f, false) == (mask & (pos .>= 22000000))
+
+	# no variant
+	seqFilterChrom(f, "X", verbose=false)
+	@test !any(seqFilterGet(f, false))
+
+finally
+	seqClose(f)
+end
+
+
+
+
+## Test: filters by a BED file
+
+f = seqOpen(seqExample(:kg))
+bed = tempname() * ".bed"
+println("Filters by a BED file")
+
+try
+	open(bed, "w") do io
+		println(io, "# overlapping and adjacent regions")
+		println(io, "22\t20000000\t20100000")
+		println(io, "22\t20050000\t20200000")
+		println(io, "22\t20200000\t20300000")
+		println(io, "22\t30000000\t30500000")
+	end
+	pos = seqGetData(f, "position")
+	m1 = (pos .>= 20000001) & (pos .<= 20300000)
+	m2 = (pos .>= 30000001) & (pos .<= 30500000)
+	mask = m1 | m2
+
+	@test seqFilterBED(f, bed, verbose=false) == nothing
+	@test seqFilterGet(f, false) == mask
+
+	rv = seqFilterBED(f, bed, region_id=true, verbose=false)
+	@test rv[2] == [ "22", "22" ]
+	@test rv[3] == Int32[ 20000001, 30000001 ]
+	@test rv[4] == Int32[ 20300000, 30500000 ]
+	@test rv[1] == Int32[ p <= 20300000 ? 1 : 2 for p in pos[mask] ]
+
+	# intersect with the previous selection
+	seqFilterChrom(f, "22", to_bp=25000000, verbose=false)
+	seqFilterBED(f, bed, intersect=true, verbose=false)
+	@test seqFilterGet(f, false) == m1
+
+finally
+	seqClose(f)
+	rm(bed, force=true)
+end
+
+
+
+
+## Test: linkage disequilibrium
+
+f = seqOpen(seqExample(:kg))
+println("Linkage disequilibrium")
+
+try
+	seqFilterSet2(f, variant=1:300, verbose=false)
+	dosage = seqGetData(f, "#dosage")
+	pos = seqGetData(f, "position")
+	maxvar = 10; window = 20000; threshold = 0.1
+
+	# r^2 over the samples non-missing in both variants
+	function ld_r2(i::Int, j::Int)
+		x = dosage[:, i]; y = dosage[:, j]
+		k = (x .!= 0xFF) & (y .!= 0xFF)
+		return cor(Vector{Float64}(x[k]), Vector{Float64}(y[k]))^2
+	end
+
+	ld = seqLD(f, window=window, maxvar=maxvar, threshold=threshold,
+		verbose=false)
+	@test size(ld) == (300, 300)
+	I, J, V = findnz(ld)
+	@test !isempty(V)
+	@test all(I .< J)
+	@test all(J - I .<= maxvar)
+	@test all(pos[J] - pos[I] .<= window)
+	for k in 1:length(V)
+		@test isapprox(V[k], ld_r2(I[k], J[k]))
+	end
+
+	# all pairs in the windows over the threshold are returned
+	for j in 2:300, i in max(1, j-maxvar):(j-1)
+		if pos[j] - pos[i] <= window
+			r2 = ld_r2(i, j)
+			if !isnan(r2) && (r2 >= threshold + 1e-8)
+				@test ld[i, j] > 0
+			end
+		end
+	end
+
+finally
+	seqClose(f)
+end
+
+
+
+
+## Test: chromosome codes
+
+f = seqOpen(seqExample(:kg))
+println("Chromosome codes")
+
+try
+	tab = seqGetData(f, "\$chrom_table")
+	code = seqGetData(f, "\$chrom_code")
+	@test isa(code, Vector{Int32})
+	@test tab == unique(tab)
+	@test tab[code] == seqGetData(f, "chromosome")
+
+	# with a variant filter
+	seqFilterSet2(f, variant=[ 1, 10, 500, 19773 ], verbose=false)
+	code = seqGetData(f, "\$chrom_code")
+	@test length(code) == 4
+	@test seqGetData(f, "\$chrom_table")[code] ==
+		seqGetData(f, "chromosome")
+
+finally
+	seqClose(f)
+end
+
+
+
+
+## Test: get data into preallocated arrays
+
+f = seqOpen(seqExample(:kg))
+println("Get data into preallocated arrays")
+
+try
+	seqFilterSet2(f, variant=1:100, verbose=false)
+	geno = Array{UInt8}(2, 1092, 100)
+	@test seqGetData!(f, "genotype", geno) === geno
+	@test geno == seqGetData(f, "genotype")
+	dosage = Array{UInt8}(1092, 100)
+	seqGetData!(f, "#dosage", dosage)
+	@test dosage == seqGetData(f, "#dosage")
+	pos = Vector{Int32}(100)
+	seqGetData!(f, "position", pos)
+	@test pos == seqGetData(f, "position")
+
+	# reuse the arrays with another block of variants
+	seqFilterSet2(f, variant=101:200, verbose=false)
+	seqGetData!(f, "genotype", geno)
+	@test geno == seqGetData(f, "genotype")
+	seqGetData!(f, "position", pos)
+	@test pos == seqGetData(f, "position")
+
+	# wrong shape or element type
+	@test_throws ErrorException seqGetData!(f, "genotype",
+		Array{UInt8}(2, 1092, 99))
+	@test_throws ErrorException seqGetData!(f, "genotype",
+		Array{UInt8}(1092, 100))
+	@test_throws ErrorException seqGetData!(f, "genotype",
+		Array{Int32}(2, 1092, 100))
+	@test_throws ErrorException seqGetData!(f, "#dosage",
+		Array{UInt8}(1091, 100))
+	@test_throws ErrorException seqGetData!(f, "position", Vector{Int64}(100))
+
+finally
+	seqClose(f)
+end
+
+
+
+
+## Test: prefetching blocks in seqApply
+
+f = seqOpen(seqExample(:kg))
+println("seqApply with prefetch")
+
+try
+	seqFilterSet2(f, sample=1:3:1092, variant=1:3000, verbose=false)
+	for name in [ "genotype", "#dosage" ]
+		s0 = seqApply(f, name, asis=:unlist, bsize=256, verbose=false) do g
+			return Int(sum(g))
+		end
+		s2 = seqApply(f, name, asis=:unlist, bsize=256, prefetch=2,
+				verbose=false) do g
+			return Int(sum(g))
+		end
+		@test s2 == s0
+	end
+
+	# copies of blocks with a variable not decoded in the prefetch thread
+	l0 = seqApply(f, [ "genotype", "#dosage", "position" ], asis=:list,
+			bsize=256, verbose=false) do g, d, p
+		return (copy(g), copy(d), copy(p))
+	end
+	l2 = seqApply(f, [ "genotype", "#dosage", "position" ], asis=:list,
+			bsize=256, prefetch=2, verbose=false) do g, d, p
+		return (copy(g), copy(d), copy(p))
+	end
+	@test length(l2) == length(l0) == cld(3000, 256)
+	for i in 1:length(l0)
+		@test l2[i] == l0[i]
+	end
+	@test cat(3, [ x[1] for x in l2 ]...) == seqGetData(f, "genotype")
+	@test hcat([ x[2] for x in l2 ]...) == seqGetData(f, "#dosage")
+
+finally
+	seqClose(f)
+end
+
+
+
+
+## Test: Julia threads follow the filter of the main thread
+
+f = seqOpen(seqExample(:kg))
+println("Filters in Julia threads, with $(Threads.nthreads()) thread(s)")
+
+try
+	nt = 2 * Threads.nthreads()
+	pos = seqGetData(f, "position")
+	res = Vector{Any}(nt)
+
+	seqFilterSet2(f, variant=1:10, verbose=false)
+	Threads.@threads for i in 1:nt
+		res[i] = seqGetData(f, "position")
+	end
+	@test all(x -> x == pos[1:10], res)
+
+	# change the filter between two reads
+	seqFilterSet2(f, variant=101:120, verbose=false)
+	Threads.@threads for i in 1:nt
+		res[i] = seqGetData(f, "position")
+	end
+	@test all(x -> x == pos[101:120], res)
+
+	seqFilterChrom(f, "22", from_bp=20000000, to_bp=20100000, verbose=false)
+	Threads.@threads for i in 1:nt
+		res[i] = (seqAttr(f, :nselvar), seqGetData(f, "position"))
+	end
+	sel = pos[(pos .>= 20000000) & (pos .<= 20100000)]
+	@test all(x -> x == (length(sel), sel), res)
+
+finally
+	seqClose(f)
+end
+
+
+
+
+## Test: an iterator after its file is closed
+
+println("Iterator after closing the file")
+f = seqOpen(seqExample(:kg))
+it = seqIterate(f, [ "genotype", "position" ])
+try
+	@test next(it, 1)[1][2][1] == seqGetData(f, "position")[1]
+	seqClose(f)
+	@test_throws ErrorException next(it, 2)
+
+	# the file ID could be reused by another file
+	f = seqOpen(seqExample(:kg))
+	@test_throws ErrorException next(it, 2)
+finally
+	close(it)
+	seqClose(f)
+end
+
+
+
+
+## Test: the filter after a failed seqApply
+
+f = seqOpen(seqExample(:kg))
+println("Filters after a failed seqApply")
+
+try
+	seqFilterSet2(f, sample=1:100, variant=1:3000, verbose=false)
+	samp = seqFilterGet(f, true)
+	vari = seqFilterGet(f, false)
+
+	# an unsupported variable
+	@test_throws ErrorException seqApply(f, "no_such_variable", bsize=256,
+			verbose=false) do x
+		return nothing
+	end
+	@test seqFilterGet(f, true) == samp
+	@test seqFilterGet(f, false) == vari
+	@test seqAttr(f, :nselvar) == 3000
+
+	# an error in the user-defined function
+	@test_throws ErrorException seqApply(f, "genotype", bsize=256,
+			verbose=false) do g
+		error("stop")
+	end
+	@test seqFilterGet(f, false) == vari
+	@test seqAttr(f, :nselvar) == 3000
+
+finally
+	seqClose(f)
+end
+
+
+
+
+## Test: the numbers of alleles
+
+fn = tempname() * ".gds"
+cp(seqExample(:kg), fn)
+println("The numbers of alleles")
+
+try
+	f = seqOpen(fn)
+	local nale
+	try
+		nale = Int32[ length(split(a, ',')) for a in seqGetData(f, "allele") ]
+		@test seqGetData(f, "#num_allele") == nale
+		# with a variant filter
+		seqFilterSet2(f, variant=[ 1, 10, 500, 19773 ], verbose=false)
+		@test seqGetData(f, "#num_allele") == nale[[ 1, 10, 500, 19773 ]]
+		@test seqGetData(f, "#num_allele") ==
+			Int32[ length(split(a, ',')) for a in seqGetData(f, "allele") ]
+	finally
+		seqClose(f)
+	end
+
+	# the first saves the counts to the cache file, and the second loads them
+	for i in 1:2
+		f = seqOpen(fn, index_cache=true)
+		try
+			@test seqGetData(f, "#num_allele") == nale
+			seqFilterSet2(f, variant=2:2:1000, verbose=false)
+			@test seqGetData(f, "#num_allele") == nale[2:2:1000]
+		finally
+			seqClose(f)
+		end
+		@test isfile(fn * ".seqidx")
+	end
+
+finally
+	rm(fn, force=true)
+	rm(fn * ".seqidx", force=true)
+end